@@ -18,6 +18,7 @@
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Bitcode/BitCodes.h"
+#include "llvm/Support/raw_ostream.h"
 #include <vector>
 
 namespace llvm {
@@ -25,6 +26,14 @@ namespace llvm {
 class BitstreamWriter {
   SmallVectorImpl<char> &Out;
 
+  /// FS - If non-null, the file the contents of Out are moved to once they
+  /// exceed FlushThreshold bytes. FlushedBytes bytes of the stream have been
+  /// written to FS so far, starting at offset FSStart.
+  raw_fd_ostream *FS;
+  uint64_t FSStart;
+  unsigned FlushedBytes;
+  unsigned FlushThreshold;
+
   /// CurBit - Always between 0 and 31 inclusive, specifies the next bit to use.
   unsigned CurBit;
 
@@ -63,6 +72,19 @@ class BitstreamWriter {
   // BackpatchWord - Backpatch a 32-bit word in the output with the specified
   // value.
   void BackpatchWord(unsigned ByteNo, unsigned NewWord) {
+    if (ByteNo < FlushedBytes) {
+      // The word has been flushed already, patch it in the file.
+      assert(ByteNo + 4 <= FlushedBytes && "Backpatch across a flush");
+      char Bytes[4] = {
+        (char)(NewWord >>  0),
+        (char)(NewWord >>  8),
+        (char)(NewWord >> 16),
+        (char)(NewWord >> 24) };
+      FS->pwrite(Bytes, 4, FSStart + ByteNo);
+      return;
+    }
+
+    ByteNo -= FlushedBytes;
     Out[ByteNo++] = (unsigned char)(NewWord >>  0);
     Out[ByteNo++] = (unsigned char)(NewWord >>  8);
     Out[ByteNo++] = (unsigned char)(NewWord >> 16);
@@ -83,7 +105,19 @@ class BitstreamWriter {
   }
 
   unsigned GetBufferOffset() const {
-    return Out.size();
+    return FlushedBytes + Out.size();
+  }
+
+  /// FlushToFile - When writing to a file, move the buffered words to it once
+  /// there are enough of them. Out only ever holds whole words here: partial
+  /// words are kept in CurValue.
+  void FlushToFile() {
+    if (!FS || Out.size() < FlushThreshold)
+      return;
+    assert((Out.size() & 3) == 0 && "Flushing a partial word");
+    FS->write(Out.data(), Out.size());
+    FlushedBytes += Out.size();
+    Out.clear();
   }
 
   unsigned GetWordIndex() const {
@@ -94,7 +128,20 @@ class BitstreamWriter {
 
 public:
   explicit BitstreamWriter(SmallVectorImpl<char> &O)
-    : Out(O), CurBit(0), CurValue(0), CurCodeSize(2) {}
+    : Out(O), FS(nullptr), FSStart(0), FlushedBytes(0), FlushThreshold(0),
+      CurBit(0), CurValue(0), CurCodeSize(2) {}
+
+  /// Create a writer that streams to \p FS: whenever a block or a record is
+  /// complete and \p O holds at least \p FlushThreshold bytes, they are
+  /// written to \p FS, and block sizes are backpatched in the file. \p O must
+  /// be empty, \p FS must support seeking, and the caller must write what is
+  /// left in \p O to \p FS once the writer is destroyed.
+  BitstreamWriter(SmallVectorImpl<char> &O, raw_fd_ostream &FS,
+                  unsigned FlushThreshold = 1 << 20)
+    : Out(O), FS(&FS), FSStart(FS.tell()), FlushedBytes(0),
+      FlushThreshold(FlushThreshold), CurBit(0), CurValue(0), CurCodeSize(2) {
+    assert(Out.empty() && FS.supportsSeeking() && "Cannot stream to FS");
+  }
 
   ~BitstreamWriter() {
     assert(CurBit == 0 && "Unflushed data remaining");
@@ -224,6 +271,7 @@ public:
       CurAbbrevs.insert(CurAbbrevs.end(), Info->Abbrevs.begin(),
                         Info->Abbrevs.end());
     }
+    FlushToFile();
   }
 
   void ExitBlock() {
@@ -246,6 +294,7 @@ public:
     CurCodeSize = B.PrevCodeSize;
     CurAbbrevs = std::move(B.PrevAbbrevs);
     BlockScope.pop_back();
+    FlushToFile();
   }
 
   //===--------------------------------------------------------------------===//
@@ -380,6 +429,7 @@ private:
     assert(RecordIdx == Vals.size() && "Not all record operands emitted!");
     assert(BlobData == nullptr &&
            "Blob data specified for record that doesn't use it!");
+    FlushToFile();
   }
 
 public:
@@ -397,6 +447,7 @@ public:
       EmitVBR(static_cast<uint32_t>(Vals.size()), 6);
       for (unsigned i = 0, e = static_cast<unsigned>(Vals.size()); i != e; ++i)
         EmitVBR64(Vals[i], 6);
+      FlushToFile();
       return;
     }
 
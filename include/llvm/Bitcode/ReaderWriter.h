@@ -26,6 +26,7 @@ namespace llvm {
   class LLVMContext;
   class Module;
   class ModulePass;
+  class raw_fd_ostream;
   class raw_ostream;
 
   /// Read the header of the specified bitcode buffer and prepare for lazy
@@ -67,6 +68,15 @@ namespace llvm {
   void WriteBitcodeToFile(const Module *M, raw_ostream &Out,
                           bool ShouldPreserveUseListOrder = false);
 
+  /// \brief Write the specified module to the specified file.
+  ///
+  /// If the file supports seeking, the bitstream is written to it as it is
+  /// produced rather than buffered in memory as a whole: only the block sizes
+  /// are written out of order. The file must not have been opened for
+  /// appending. Otherwise, this is the same as the raw_ostream version.
+  void WriteBitcodeToFile(const Module *M, raw_fd_ostream &Out,
+                          bool ShouldPreserveUseListOrder = false);
+
   /// isBitcodeWrapper - Return true if the given bytes are the magic bytes
   /// for an LLVM IR bitcode wrapper.
   ///
@@ -10,6 +10,7 @@
 #ifndef LLVM_LIB_DEBUGINFO_DWARFCONTEXT_H
 #define LLVM_LIB_DEBUGINFO_DWARFCONTEXT_H
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/MapVector.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/DebugInfo/DIContext.h"
@@ -21,6 +22,7 @@
 #include "llvm/DebugInfo/DWARF/DWARFDebugRangeList.h"
 #include "llvm/DebugInfo/DWARF/DWARFSection.h"
 #include "llvm/DebugInfo/DWARF/DWARFTypeUnit.h"
+#include <list>
 #include <vector>
 
 namespace llvm {
@@ -51,6 +53,16 @@ class DWARFContext : public DIContext {
   std::unique_ptr<DWARFDebugAbbrev> AbbrevDWO;
   std::unique_ptr<DWARFDebugLocDWO> LocDWO;
 
+  /// Lazy address lookups, see setLazyAddressLookup().
+  bool LazyAddressLookup;
+  unsigned MaxParsedUnits;
+  /// The address ranges of .debug_aranges alone.
+  std::unique_ptr<DWARFDebugAranges> SectionAranges;
+  /// Units parsed by address lookups, most recently used first.
+  std::list<DWARFCompileUnit *> ParsedUnits;
+  DenseMap<DWARFCompileUnit *, std::list<DWARFCompileUnit *>::iterator>
+      ParsedUnitPositions;
+
   DWARFContext(DWARFContext &) = delete;
   DWARFContext &operator=(DWARFContext &) = delete;
 
@@ -71,7 +83,8 @@ class DWARFContext : public DIContext {
   void parseDWOTypeUnits();
 
 public:
-  DWARFContext() : DIContext(CK_DWARF) {}
+  DWARFContext()
+      : DIContext(CK_DWARF), LazyAddressLookup(false), MaxParsedUnits(0) {}
 
   static bool classof(const DIContext *DICtx) {
     return DICtx->getKind() == CK_DWARF;
@@ -164,6 +177,18 @@ public:
   /// Get a pointer to a parsed line table corresponding to a compile unit.
   const DWARFDebugLine::LineTable *getLineTableForUnit(DWARFUnit *cu);
 
+  /// Switch the address lookups (getLineInfoForAddress and friends) to lazy
+  /// mode. They use .debug_aranges to go straight to the unit covering the
+  /// address, the DIEs of all the units are only looked at for addresses the
+  /// section doesn't describe. At most \p MaxUnits units (no limit if zero)
+  /// keep their DIEs and line table parsed, the least recently used ones are
+  /// released first; DIEs and line tables obtained from the context before an
+  /// address lookup may not be used after it.
+  void setLazyAddressLookup(unsigned MaxUnits = 0) {
+    LazyAddressLookup = true;
+    MaxParsedUnits = MaxUnits;
+  }
+
   DILineInfo getLineInfoForAddress(uint64_t Address,
       DILineInfoSpecifier Specifier = DILineInfoSpecifier()) override;
   DILineInfoTable getLineInfoForAddressRange(uint64_t Address, uint64_t Size,
@@ -214,6 +239,10 @@ private:
   /// Return the compile unit which contains instruction with provided
   /// address.
   DWARFCompileUnit *getCompileUnitForAddress(uint64_t Address);
+
+  /// Mark the unit as the most recently used one by an address lookup, and
+  /// release the least recently used ones beyond MaxParsedUnits.
+  void touchParsedUnit(DWARFCompileUnit *CU);
 };
 
 /// DWARFContextInMemory is the simplest possible implementation of a
@@ -21,6 +21,9 @@ class DWARFContext;
 class DWARFDebugAranges {
 public:
   void generate(DWARFContext *CTX);
+  /// Build the table from the .debug_aranges section only, without looking at
+  /// the units the section doesn't describe.
+  void generateFromSection(DWARFContext *CTX);
   uint32_t findAddress(uint64_t Address) const;
 
 private:
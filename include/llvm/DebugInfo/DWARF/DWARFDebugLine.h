@@ -208,6 +208,9 @@ public:
   const LineTable *getLineTable(uint32_t offset) const;
   const LineTable *getOrParseLineTable(DataExtractor debug_line_data,
                                        uint32_t offset);
+  /// Drop the cached line table at the given offset, it is parsed again by
+  /// the next getOrParseLineTable for it.
+  void clearLineTable(uint32_t offset) { LineTableMap.erase(offset); }
 
 private:
   struct ParsingState {
@@ -201,6 +201,11 @@ public:
     return DieArray.empty() ? nullptr : &DieArray[0];
   }
 
+  /// releaseDIEs - Drop the parsed DIEs, except for the unit DIE, and the
+  /// .dwo file of the unit to keep memory usage low. They are parsed again
+  /// when needed; pointers to the DIEs are invalidated.
+  void releaseDIEs();
+
   const char *getCompilationDir();
   uint64_t getDWOId();
 
@@ -0,0 +1,228 @@
+#ifndef LLVM_IR_SAFEDISPATCHMD_H
+#define LLVM_IR_SAFEDISPATCHMD_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/**
+ * name of the replacement function for __dynamic_cast
+ */
+#define SD_DYNCAST_FUNC_NAME "__ivtbl_dynamic_cast"
+
+/**
+ * metadata names used for the SafeDispatch project
+ */
+#define SD_MD_CAST_FROM  "sd.cast.from"   // class name
+#define SD_MD_TYPEID     "sd.typeid"      // class name
+#define SD_MD_VCALL      "sd.vcall"       // -
+#define SD_MD_VBASE      "sd.vbase"       // class name, original vbase offset
+#define SD_MD_MEMPTR     "sd.memptr"      // class name
+#define SD_MD_MEMPTR2    "sd.memptr2"     // class name 1, class name 2
+#define SD_MD_MEMPTR_OPT "sd.memptr3"     // class name
+#define SD_MD_CHECK      "sd.check"       // class name
+
+/**
+ * named md used to store the vtable info
+ */
+#define SD_MD_CLASSINFO  "sd.class_info."
+
+/**
+ * the new vtable of a cloud is named after its root vtable with this prefix
+ */
+#define SD_NEW_VTABLE_PREFIX "_SD"
+
+/**
+ * vtable the masked checks point failing vptrs at, kept next to the clouds
+ */
+#define SD_SENTINEL_VTABLE_NAME "_SD_sentinel"
+
+/**
+ * Read-only view over the class info record of a single class. Each
+ * sd.class_info.<class> NamedMDNode holds one such tuple:
+ *
+ *   !{!"class", vtable gv or null, [N x i64] packed, !"parent_0", parent_0 gv or null, ...}
+ *
+ * The packed array starts with the number of sub-vtables and the offset of
+ * each sub-vtable record, followed by the records themselves:
+ *
+ *   order, start, end, address point, #parents, (parent ref, parent order)*
+ *
+ * A parent ref is an index into the (name, gv) pairs that follow the packed
+ * array, so every parent class is stored once per record. Since the tuple is
+ * uniqued, identical records coming from different TUs collapse into a single
+ * node and the linker keeps only one copy of them.
+ *
+ * Names are taken from the vtable globals when they are still around, because
+ * linking might have renamed internal vtables.
+ */
+class SDClassInfoMD {
+  const llvm::MDNode* N;
+  const llvm::ConstantDataArray* Packed;
+
+  enum { CLASS_NAME = 0, CLASS_VTBL, PACKED, PARENTS };
+  enum { SUB_ORDER = 0, SUB_START, SUB_END, SUB_ADDRPT, SUB_NPARENTS, SUB_PARENTS };
+
+  uint64_t getPacked(unsigned i) const { return Packed->getElementAsInteger(i); }
+
+  uint64_t getSub(unsigned sub, unsigned field) const {
+    assert(sub < getNumSubVTables());
+    return getPacked(getPacked(1 + sub) + field);
+  }
+
+  static llvm::GlobalVariable* getGV(const llvm::MDOperand& op) {
+    auto cam = llvm::dyn_cast_or_null<llvm::ConstantAsMetadata>(op.get());
+    return cam ? llvm::dyn_cast<llvm::GlobalVariable>(cam->getValue()) : nullptr;
+  }
+
+  static llvm::StringRef getName(const llvm::MDOperand& nameOp, const llvm::MDOperand& gvOp) {
+    if (llvm::GlobalVariable* gv = getGV(gvOp))
+      return gv->getName();
+    llvm::MDString* mds = llvm::dyn_cast<llvm::MDString>(nameOp.get());
+    assert(mds);
+    return mds->getString();
+  }
+
+public:
+  explicit SDClassInfoMD(const llvm::MDNode* N) : N(N) {
+    assert(N && N->getNumOperands() >= PARENTS &&
+           (N->getNumOperands() - PARENTS) % 2 == 0 && "malformed class info");
+    auto cam = llvm::dyn_cast<llvm::ConstantAsMetadata>(N->getOperand(PACKED));
+    assert(cam);
+    Packed = llvm::dyn_cast<llvm::ConstantDataArray>(cam->getValue());
+    assert(Packed);
+  }
+
+  llvm::StringRef getClassName() const {
+    return getName(N->getOperand(CLASS_NAME), N->getOperand(CLASS_VTBL));
+  }
+  llvm::GlobalVariable* getVTable() const { return getGV(N->getOperand(CLASS_VTBL)); }
+
+  unsigned getNumSubVTables() const { return getPacked(0); }
+  uint64_t getOrder(unsigned sub) const        { return getSub(sub, SUB_ORDER); }
+  uint64_t getStart(unsigned sub) const        { return getSub(sub, SUB_START); }
+  uint64_t getEnd(unsigned sub) const          { return getSub(sub, SUB_END); }
+  uint64_t getAddressPoint(unsigned sub) const { return getSub(sub, SUB_ADDRPT); }
+  unsigned getNumParents(unsigned sub) const   { return getSub(sub, SUB_NPARENTS); }
+
+  /**
+   * Name of the given parent of a sub-vtable, "" if the sub-vtable is a root
+   */
+  llvm::StringRef getParentName(unsigned sub, unsigned pt) const {
+    assert(pt < getNumParents(sub));
+    unsigned ref = getSub(sub, SUB_PARENTS + 2 * pt);
+    return getName(N->getOperand(PARENTS + 2 * ref), N->getOperand(PARENTS + 2 * ref + 1));
+  }
+  uint64_t getParentOrder(unsigned sub, unsigned pt) const {
+    assert(pt < getNumParents(sub));
+    return getSub(sub, SUB_PARENTS + 2 * pt + 1);
+  }
+
+  /**
+   * True if both records describe the same class layout, whether or not they
+   * reference the vtables.
+   */
+  bool isSameLayout(const SDClassInfoMD& other) const {
+    if (Packed != other.Packed || N->getNumOperands() != other.N->getNumOperands() ||
+        getClassName() != other.getClassName())
+      return false;
+
+    for (unsigned i = PARENTS; i < N->getNumOperands(); i += 2) {
+      if (getName(N->getOperand(i), N->getOperand(i + 1)) !=
+          getName(other.N->getOperand(i), other.N->getOperand(i + 1)))
+        return false;
+    }
+    return true;
+  }
+
+  /**
+   * Creates the class info tuple. Each entry of subVTables holds the order,
+   * range, address point and the (parent name, parent order) pairs of a
+   * sub-vtable.
+   */
+  template<typename SubVTableVec>
+  static llvm::MDNode* get(llvm::Module& M, const std::string& className,
+                           llvm::GlobalVariable* vtable, const SubVTableVec& subVTables) {
+    llvm::LLVMContext& C = M.getContext();
+    if (!vtable)
+      vtable = M.getGlobalVariable(className, true);
+
+    std::vector<uint64_t> packed(1 + subVTables.size());
+    std::vector<std::string> parentNames;
+
+    packed[0] = subVTables.size();
+    for (unsigned i = 0; i < subVTables.size(); ++i) {
+      const auto& sub = subVTables[i];
+      packed[1 + i] = packed.size();
+      packed.push_back(sub.order);
+      packed.push_back(sub.start);
+      packed.push_back(sub.end);
+      packed.push_back(sub.addressPoint);
+      packed.push_back(sub.parents.size());
+
+      for (auto& pt : sub.parents) {
+        auto pos = std::find(parentNames.begin(), parentNames.end(), pt.first);
+        packed.push_back(pos - parentNames.begin());
+        packed.push_back(pt.second);
+        if (pos == parentNames.end())
+          parentNames.push_back(pt.first);
+      }
+    }
+
+    std::vector<llvm::Metadata*> ops;
+    ops.push_back(llvm::MDString::get(C, className));
+    ops.push_back(vtable ? llvm::ConstantAsMetadata::get(vtable) : nullptr);
+    ops.push_back(llvm::ConstantAsMetadata::get(llvm::ConstantDataArray::get(C, packed)));
+
+    for (auto& ptName : parentNames) {
+      llvm::GlobalVariable* ptVtable =
+        ptName.empty() ? nullptr : M.getGlobalVariable(ptName, true);
+      ops.push_back(llvm::MDString::get(C, ptName));
+      ops.push_back(ptVtable ? llvm::ConstantAsMetadata::get(ptVtable) : nullptr);
+    }
+
+    return llvm::MDTuple::get(C, ops);
+  }
+
+  /**
+   * True if N is a class info tuple, false for the boxed records written by
+   * older compilers.
+   */
+  static bool isClassInfo(const llvm::MDNode* N) {
+    if (N->getNumOperands() < PARENTS)
+      return false;
+    auto cam = llvm::dyn_cast_or_null<llvm::ConstantAsMetadata>(N->getOperand(PACKED).get());
+    return cam && llvm::isa<llvm::ConstantDataArray>(cam->getValue());
+  }
+};
+
+namespace llvm {
+
+/**
+ * Older compilers stored each class as a sequence of operands of its
+ * sd.class_info.<class> node: !{!"class"}, !{vtable gv or !"NO_VTABLE"},
+ * !{i64 #sub-vtables} and then one
+ *
+ *   !{i64 order, i64 start, i64 end, i64 address point,
+ *     !{i64 #parents, (!"parent", i64 parent order, !{parent gv})*}}
+ *
+ * tuple per sub-vtable. Rewrites such nodes into SDClassInfoMD tuples and
+ * returns true if anything changed. A malformed node is left alone.
+ */
+bool UpgradeSDClassInfo(Module &M, NamedMDNode &NMD);
+
+/**
+ * Upgrades every sd.class_info node of the module.
+ */
+bool UpgradeSDClassInfo(Module &M);
+
+} // End llvm namespace
+
+#endif
+
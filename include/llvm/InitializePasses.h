@@ -302,8 +302,11 @@ void initializeFloat2IntPass(PassRegistry&);
 void initializeSDFixPass(PassRegistry&);
 void initializeSDBuildCHAPass(PassRegistry&);
 void initializeSDLayoutBuilderPass(PassRegistry&);
+void initializeSDFoldVbaseOffsetsPass(PassRegistry&);
 void initializeSDUpdateIndicesPass(PassRegistry&);
 void initializeSDSubstModule3Pass(PassRegistry&);
+void initializeSDExportLayoutPass(PassRegistry&);
+void initializeSDApplyLayoutPass(PassRegistry&);
 }
 
 #endif
@@ -188,8 +188,11 @@ namespace {
       (void) llvm::createSDFixPass();
       (void) llvm::createSDBuildCHAPass();
       (void) llvm::createSDLayoutBuilderPass();
+      (void) llvm::createSDFoldVbaseOffsetsPass();
       (void) llvm::createSDUpdateIndicesPass();
       (void) llvm::createSDSubstModule3Pass();
+      (void) llvm::createSDExportLayoutPass();
+      (void) llvm::createSDApplyLayoutPass();
     }
   } ForcePassLinking; // Force link by creating a global definition.
 }
@@ -13,11 +13,17 @@
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/TrackingMDRef.h"
+#include <vector>
 
 namespace llvm {
+class MDString;
 class Module;
+class NamedMDNode;
 class StructType;
+class ThreadPool;
 class Type;
 
 /// This class provides the core functionality of linking in LLVM. It keeps a
@@ -60,6 +66,17 @@ public:
     bool hasType(StructType *Ty);
   };
 
+  /// The debug info types of the composite that have an ODR identifier. The
+  /// compile units are indexed as they are linked in, instead of going over
+  /// all of them again on every link.
+  struct ODRDebugTypeMap {
+    DenseMap<const MDString *, TrackingMDNodeRef> Types;
+    unsigned NumIndexedCUs = 0;
+
+    /// Add the types retained by the compile units linked since last time.
+    void update(const NamedMDNode *CUs);
+  };
+
   Linker(Module *M, DiagnosticHandlerFunction DiagnosticHandler);
   Linker(Module *M);
   ~Linker();
@@ -70,8 +87,12 @@ public:
   /// \brief Link \p Src into the composite. The source is destroyed.
   /// Passing OverrideSymbols as true will have symbols from Src
   /// shadow those in the Dest.
+  /// Passing LinkAllDefinitions as true also links the local, linkonce and
+  /// available_externally definitions that nothing in the composite uses yet,
+  /// for composites that are only a part of the final link.
   /// Returns true on error.
-  bool linkInModule(Module *Src, bool OverrideSymbols = false);
+  bool linkInModule(Module *Src, bool OverrideSymbols = false,
+                    bool LinkAllDefinitions = false);
 
   /// \brief Set the composite to the passed-in module.
   void setModule(Module *Dst);
@@ -81,11 +102,25 @@ public:
 
   static bool LinkModules(Module *Dest, Module *Src);
 
+  /// \brief Link the bitcode modules in \p Parts into one, using the threads
+  /// of \p Pool. Neighbouring parts are linked pairwise in a reduction tree,
+  /// each pair in a context of its own, and the left part is always the
+  /// destination: symbols resolve as if the parts were linked in order.
+  /// No definition is dropped for being unused in a part, see linkInModule;
+  /// the caller may drop the ones the linked module does not use.
+  /// Diagnostics are passed to \p DiagnosticHandler one at a time.
+  /// On success Parts holds the bitcode of the linked module only.
+  /// Returns true on error.
+  static bool LinkBitcodeModules(ThreadPool &Pool,
+                                 std::vector<SmallVector<char, 0>> &Parts,
+                                 DiagnosticHandlerFunction DiagnosticHandler);
+
 private:
   void init(Module *M, DiagnosticHandlerFunction DiagnosticHandler);
   Module *Composite;
 
   IdentifiedStructTypeSet IdentifiedStructTypes;
+  ODRDebugTypeMap ODRDebugTypes;
 
   DiagnosticHandlerFunction DiagnosticHandler;
 };
@@ -19,7 +19,9 @@
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/ProfileData/InstrProf.h"
 #include "llvm/Support/EndianStream.h"
+#include "llvm/Support/AlignOf.h"
 #include "llvm/Support/ErrorOr.h"
+#include "llvm/Support/Host.h"
 #include "llvm/Support/LineIterator.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/OnDiskHashTable.h"
@@ -236,7 +238,8 @@ public:
   }
 
   StringRef ReadKey(const unsigned char *D, offset_type N) {
-    return StringRef((const char *)D, N);
+    // Since version 3 the key is padded with zeros.
+    return StringRef((const char *)D, N).rtrim(StringRef("\0", 1));
   }
 
   data_type ReadData(StringRef K, const unsigned char *D, offset_type N) {
@@ -249,6 +252,13 @@ public:
     // We just treat the data as opaque here. It's simpler to handle in
     // IndexedInstrProfReader.
     unsigned NumEntries = N / sizeof(uint64_t);
+
+    // The counts of version 3 profiles are aligned, use them in place.
+    if (sys::IsLittleEndianHost &&
+        reinterpret_cast<uintptr_t>(D) % alignOf<uint64_t>() == 0)
+      return data_type(K, makeArrayRef(
+                              reinterpret_cast<const uint64_t *>(D), NumEntries));
+
     DataBuffer.reserve(NumEntries);
     for (unsigned I = 0; I < NumEntries; ++I)
       DataBuffer.push_back(endian::readNext<uint64_t, little, unaligned>(D));
@@ -291,6 +301,15 @@ public:
   /// Fill Counts with the profile data for the given function name.
   std::error_code getFunctionCounts(StringRef FuncName, uint64_t FuncHash,
                                     std::vector<uint64_t> &Counts);
+  /// Point Counts at the profile data for the given function name, without
+  /// copying it. For version 3 profiles on little endian hosts the counts are
+  /// read straight from the profile buffer and stay valid as long as the
+  /// reader; otherwise they are only valid until the next lookup.
+  ///
+  /// Iterating over the reader (see InstrProfReader::begin) hands out the
+  /// counts the same way.
+  std::error_code getFunctionCounts(StringRef FuncName, uint64_t FuncHash,
+                                    ArrayRef<uint64_t> &Counts);
   /// Return the maximum of all known function counts.
   uint64_t getMaximumFunctionCount() { return MaxFunctionCount; }
 
@@ -17,6 +17,7 @@
 
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/ProfileData/InstrProf.h"
 #include "llvm/Support/DataTypes.h"
@@ -42,6 +43,12 @@ public:
   std::error_code addFunctionCounts(StringRef FunctionName,
                                     uint64_t FunctionHash,
                                     ArrayRef<uint64_t> Counters);
+  /// Add the counts of all the functions in \p IPW, as if each was passed to
+  /// addFunctionCounts. \p Warn is called for the functions whose counts could
+  /// not be merged.
+  void mergeRecordsFromWriter(
+      InstrProfWriter &&IPW,
+      function_ref<void(StringRef, std::error_code)> Warn);
   /// Write the profile to \c OS
   void write(raw_fd_ostream &OS);
   /// Write the profile, returning the raw data. For testing.
@@ -0,0 +1,125 @@
+//===- llvm/Support/Parallel.h - Parallel algorithms ------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Parallel versions of for_each and sort running on a ThreadPool. Their
+// results do not depend on the number of threads or on the scheduling:
+// parallel_for_each calls the function exactly once per element, and
+// parallel_sort produces the same order as std::stable_sort.
+//
+// These block the calling thread until they are done, so they must not be
+// called from a task of the same pool.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_SUPPORT_PARALLEL_H
+#define LLVM_SUPPORT_PARALLEL_H
+
+#include "llvm/Support/ThreadPool.h"
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <vector>
+
+namespace llvm {
+
+namespace detail {
+/// Number of chunks the helpers split \p Size elements into: a few per thread
+/// so that uneven elements still balance, but none smaller than \p MinChunk.
+inline size_t getParallelChunkCount(const ThreadPool &Pool, size_t Size,
+                                    size_t MinChunk) {
+  size_t Chunks = std::min<size_t>(Pool.getThreadCount() * 4,
+                                   Size / std::max<size_t>(MinChunk, 1));
+  return std::max<size_t>(Chunks, 1);
+}
+}
+
+/// Call \p Fn on every element of [\p Begin, \p End) using the threads of
+/// \p Pool. Elements are handed out in contiguous chunks of at least
+/// \p MinChunk elements.
+template <class IterTy, class FuncTy>
+void parallel_for_each(ThreadPool &Pool, IterTy Begin, IterTy End, FuncTy Fn,
+                       size_t MinChunk = 1) {
+  size_t Size = std::distance(Begin, End);
+  size_t Chunks = detail::getParallelChunkCount(Pool, Size, MinChunk);
+  if (Chunks == 1) {
+    std::for_each(Begin, End, Fn);
+    return;
+  }
+
+  std::vector<std::shared_future<void>> Futures;
+  Futures.reserve(Chunks);
+  for (size_t I = 0; I != Chunks; ++I) {
+    IterTy ChunkBegin = Begin;
+    std::advance(Begin, Size / Chunks + (I < Size % Chunks ? 1 : 0));
+    IterTy ChunkEnd = Begin;
+    Futures.push_back(Pool.async([ChunkBegin, ChunkEnd, &Fn] {
+      std::for_each(ChunkBegin, ChunkEnd, Fn);
+    }));
+  }
+
+  for (std::shared_future<void> &F : Futures)
+    F.wait();
+}
+
+/// Sort [\p Start, \p End) with \p Comp using the threads of \p Pool. The
+/// sort is stable, so the result is the same as with std::stable_sort no
+/// matter how the range was split.
+template <class RandomAccessIterator, class Comparator>
+void parallel_sort(ThreadPool &Pool, RandomAccessIterator Start,
+                   RandomAccessIterator End, const Comparator &Comp,
+                   size_t MinChunk = 1024) {
+  size_t Size = End - Start;
+  size_t Chunks = detail::getParallelChunkCount(Pool, Size, MinChunk);
+
+  // Sort the chunks, then merge neighbours pairwise until one run is left.
+  std::vector<RandomAccessIterator> Bounds;
+  for (size_t I = 0; I <= Chunks; ++I)
+    Bounds.push_back(Start + (Size * I) / Chunks);
+
+  std::vector<std::shared_future<void>> Futures;
+  for (size_t I = 0; I != Chunks; ++I) {
+    RandomAccessIterator B = Bounds[I], E = Bounds[I + 1];
+    Futures.push_back(Pool.async([B, E, &Comp] {
+      std::stable_sort(B, E, Comp);
+    }));
+  }
+  for (std::shared_future<void> &F : Futures)
+    F.wait();
+
+  while (Bounds.size() > 2) {
+    std::vector<RandomAccessIterator> Merged;
+    Futures.clear();
+    for (size_t I = 0; I + 2 < Bounds.size(); I += 2) {
+      RandomAccessIterator B = Bounds[I], M = Bounds[I + 1], E = Bounds[I + 2];
+      Merged.push_back(B);
+      Futures.push_back(Pool.async([B, M, E, &Comp] {
+        std::inplace_merge(B, M, E, Comp);
+      }));
+    }
+    // An odd run out is carried over to the next round unchanged.
+    if (Bounds.size() % 2 == 0)
+      Merged.push_back(Bounds[Bounds.size() - 2]);
+    Merged.push_back(Bounds.back());
+
+    for (std::shared_future<void> &F : Futures)
+      F.wait();
+    Bounds.swap(Merged);
+  }
+}
+
+template <class RandomAccessIterator>
+void parallel_sort(ThreadPool &Pool, RandomAccessIterator Start,
+                   RandomAccessIterator End) {
+  typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
+  parallel_sort(Pool, Start, End, std::less<T>());
+}
+}
+
+#endif // LLVM_SUPPORT_PARALLEL_H
@@ -0,0 +1,113 @@
+//===-- llvm/Support/ThreadPool.h - A ThreadPool implementation -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines a crude C++11 based thread pool.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_SUPPORT_THREADPOOL_H
+#define LLVM_SUPPORT_THREADPOOL_H
+
+#include "llvm/Config/llvm-config.h"
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#if LLVM_ENABLE_THREADS
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#endif
+
+namespace llvm {
+
+/// A ThreadPool for asynchronous parallel execution on a defined number of
+/// threads.
+///
+/// The pool keeps a fixed set of worker threads that pick tasks from a single
+/// FIFO queue. Tasks are started in the order they were submitted, but may
+/// finish in any order; results are handed back through futures.
+///
+/// When LLVM is built without thread support, tasks run synchronously on the
+/// calling thread as they are submitted.
+///
+/// Tasks must not wait on the pool or on futures of other tasks of the same
+/// pool, all the workers may be blocked that way.
+class ThreadPool {
+public:
+  typedef std::function<void()> TaskTy;
+
+  /// Construct a pool with one thread per hardware thread.
+  ThreadPool();
+
+  /// Construct a pool of \p ThreadCount threads (at least one).
+  explicit ThreadPool(unsigned ThreadCount);
+
+  /// Blocking destructor: the pool will wait for all the threads to complete.
+  ~ThreadPool();
+
+  /// Asynchronous submission of a task to the pool. The returned future can be
+  /// used to wait for the task to finish and to get its result.
+  template <typename Function, typename... Args>
+  std::shared_future<typename std::result_of<Function(Args...)>::type>
+  async(Function &&F, Args &&... ArgList) {
+    typedef typename std::result_of<Function(Args...)>::type ResultTy;
+
+    auto Task = std::make_shared<std::packaged_task<ResultTy()>>(
+        std::bind(std::forward<Function>(F), std::forward<Args>(ArgList)...));
+    std::shared_future<ResultTy> Future = Task->get_future().share();
+    asyncImpl([Task]() { (*Task)(); });
+    return Future;
+  }
+
+  /// Blocking wait for all the tasks submitted so far to complete.
+  void wait();
+
+  /// Number of worker threads of the pool.
+  unsigned getThreadCount() const { return ThreadCount; }
+
+private:
+  /// Queue the task, or run it right away without thread support.
+  void asyncImpl(TaskTy F);
+
+  unsigned ThreadCount;
+
+#if LLVM_ENABLE_THREADS
+  /// Threads in flight
+  std::vector<std::thread> Threads;
+
+  /// Tasks waiting for execution in the pool.
+  std::queue<TaskTy> Tasks;
+
+  /// Locking and signaling for accessing the Tasks queue.
+  std::mutex QueueLock;
+  std::condition_variable QueueCondition;
+
+  /// Locking and signaling for job completion
+  std::mutex CompletionLock;
+  std::condition_variable CompletionCondition;
+
+  /// Keep track of the number of thread actually busy
+  std::atomic<unsigned> ActiveThreads;
+
+  /// Signal for the destruction of the pool, asking thread to exit.
+  bool EnableFlag;
+
+  void runWorker();
+#endif
+};
+}
+
+#endif // LLVM_SUPPORT_THREADPOOL_H
@@ -207,8 +207,11 @@ ModulePass *createLowerBitSetsPass();
 ModulePass* createSDFixPass();
 ModulePass* createSDBuildCHAPass();
 ModulePass* createSDLayoutBuilderPass(bool interleave = false);
+ModulePass* createSDFoldVbaseOffsetsPass();
 ModulePass* createSDUpdateIndicesPass();
 ModulePass* createSDSubstModule3Pass();
+ModulePass* createSDExportLayoutPass();
+ModulePass* createSDApplyLayoutPass();
 
 } // End llvm namespace
 
@@ -1,8 +1,31 @@
 #ifndef LLVM_TRANSFORMS_IPO_SAFEDISPATCH_H
 #define LLVM_TRANSFORMS_IPO_SAFEDISPATCH_H
 
-#include "SafeDispatchMD.h"
+#include "llvm/IR/SafeDispatchMD.h"
+
+#include <cstdint>
 
 #define BITCAST_OPCODE  44
+
+namespace llvm {
+  class CallInst;
+  class Constant;
+  class Module;
+
+  /**
+   * Address point of the sentinel vtable that masked checks substitute for
+   * invalid vptrs. All of its function entries call __sd_vtbl_violation.
+   */
+  Constant* sd_getSentinelVptr(Module& M);
+
+  /**
+   * Replace a call to sd_get_checked_vptr with
+   * select(sd_subst_check_range(vptr, start, width, alignment), vptr, sentinel).
+   * When start is NULL no valid vptr exists and the sentinel is used directly.
+   */
+  void sd_lowerCheckedVptr(Module& M, CallInst* CI, Constant* start,
+                           int64_t width, int64_t alignment);
+}
+
 #endif
 
@@ -1,3 +1,6 @@
+#ifndef LLVM_TRANSFORMS_IPO_SAFEDISPATCH_CHA_H
+#define LLVM_TRANSFORMS_IPO_SAFEDISPATCH_CHA_H
+
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/IPO/SafeDispatch.h"
 #include "llvm/Transforms/IPO.h"
@@ -14,6 +17,7 @@
 #include "llvm/Transforms/Utils/Local.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/CallSite.h"
+#include "llvm/IR/PassManager.h"
 
 #include "llvm/Transforms/IPO/SafeDispatchLog.h"
 
@@ -27,6 +31,7 @@
 #include <math.h>
 #include <algorithm>
 #include <deque>
+#include <memory>
 
 #include <iostream>
 
@@ -76,22 +81,6 @@ private:
     unsigned vcallMDId;
     std::set<Function*> vthunksToRemove;
 
-    // these should match the structs defined at SafeDispatchVtblMD.h
-    struct nmd_sub_t {
-      uint64_t order;
-      vtbl_name_t parentName;
-      uint64_t parentOrder;
-      vtbl_set_t parents;
-      uint64_t start; // range boundaries are inclusive
-      uint64_t end;
-      uint64_t addressPoint;
-    };
-
-    struct nmd_t {
-      vtbl_name_t className;
-      std::vector<nmd_sub_t> subVTables;
-    };
-
     /**
      * Reads the NamedMDNodes in the given module and creates the class hierarchy
      */
@@ -106,6 +95,11 @@ private:
      * TODO(dbounov): After we add multiple range checks remove this
      */
     void removeDiamonds(Module &M);
+    /**
+     * With -sd-cha-referenced-only, drop the clouds that none of the SafeDispatch
+     * intrinsics and none of the live vtables refer to
+     */
+    void pruneUnreferencedClouds(Module &M);
     vtbl_t findLeastCommonAncestor(
       const vtbl_set_t &vtbls,
       cloud_map_t &ptMap);
@@ -117,10 +111,6 @@ private:
 
     void printClouds(const std::string &suffix);
 
-    /**
-     * Extract the vtable info from the metadata and put it into a struct
-     */
-    std::vector<nmd_t> static extractMetadata(NamedMDNode* md);
 
 public:
     SDBuildCHA() : ModulePass(ID) {
@@ -150,10 +140,12 @@ public:
 
       vcallMDId = M.getMDKindID(SD_MD_VCALL);
 
+      UpgradeSDClassInfo(M);
       buildClouds(M);
       printClouds("with_diamonds");
       removeDiamonds(M);
       printClouds("without_diamonds");
+      pruneUnreferencedClouds(M);
 
       for (auto rootName : roots) {
         calculateChildrenCounts(vtbl_t(rootName, 0));
@@ -284,6 +276,20 @@ public:
     const vtbl_name_t& getLayoutClassName(const vtbl_name_t &name, uint64_t ind) {
       return subObjNameMap[name][ind];
     }
+    bool hasLayoutClassName(const vtbl_t &vtbl) {
+      auto itr = subObjNameMap.find(vtbl.first);
+      return itr != subObjNameMap.end() && itr->second.size() > vtbl.second;
+    }
+    /*
+     * Cloud Map Accessors
+     */
+    cloud_map_t::const_iterator cloudMap_begin() {
+      return cloudMap.cbegin();
+    }
+
+    cloud_map_t::const_iterator cloudMap_end() {
+      return cloudMap.cend();
+    }
 
     /**
      * Return a list that contains the preorder traversal of the tree
@@ -295,9 +301,10 @@ public:
     /**
      * Return the number of vtables in a given primary vtable's cloud(including
      * the vtable itself). This is effectively the width of the range in which
-     * the vtable pointer must lie in.
+     * the vtable pointer must lie in. Returns 0 for vtables without a
+     * computed size (unknown or pruned ones).
      */
-    int64_t getCloudSize(const vtbl_name_t& vtbl);
+    int64_t getCloudSize(const vtbl_name_t& vtbl) const;
     /**
      * Get the start of the valid range for vptrs for a (potentially non-primary) vtable.
      * In practice we are always interested in primary vtables here.
@@ -309,4 +316,35 @@ public:
     int64_t getSubVTableIndex(const vtbl_name_t& derived, const vtbl_name_t &base);
   };
 
+  /**
+   * SDBuildCHA for the new pass manager. Like any other analysis, the result
+   * is dropped unless the pass that ran declares it preserved, so passes that
+   * leave the sd.class_info records and the vtables alone should preserve it.
+   * With -sd-cha-referenced-only the pruning is not redone either; that is
+   * fine as long as the passes in between don't add new SafeDispatch
+   * intrinsics.
+   */
+  class SDBuildCHAAnalysis {
+  public:
+    class Result {
+      std::unique_ptr<SDBuildCHA> cha;
+
+    public:
+      explicit Result(Module &M);
+      Result(Result &&R) : cha(std::move(R.cha)) {}
+
+      SDBuildCHA& getCHA() { return *cha; }
+    };
+
+    static void *ID() { return (void *)&PassID; }
+    static StringRef name() { return "SafeDispatch CHA"; }
+
+    Result run(Module &M) { return Result(M); }
+
+  private:
+    static char PassID;
+  };
+
 }
+
+#endif
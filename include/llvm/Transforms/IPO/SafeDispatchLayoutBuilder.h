@@ -1,3 +1,6 @@
+#ifndef LLVM_TRANSFORMS_IPO_SAFEDISPATCH_LAYOUTBUILDER_H
+#define LLVM_TRANSFORMS_IPO_SAFEDISPATCH_LAYOUTBUILDER_H
+
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/IPO/SafeDispatch.h"
 #include "llvm/Transforms/IPO/SafeDispatchCHA.h"
@@ -50,12 +53,14 @@ namespace llvm {
     typedef std::map<vtbl_name_t, interleaving_list_t>      interleaving_map_t;
     typedef std::map<vtbl_t, Constant*>                     vtbl_start_map_t;
     typedef std::map<vtbl_name_t, GlobalVariable*>          cloud_start_map_t;
+    typedef std::map<vtbl_name_t, uint64_t>                 cloud_hotness_map_t;
 
     new_layout_inds_t newLayoutInds;                   // (vtbl,ind) -> [new ind inside interleaved vtbl]
     interleaving_map_t interleavingMap;                // root -> new layouts map
     vtbl_start_map_t newVTableStartAddrMap;            // Starting addresses of all new vtables
     cloud_start_map_t cloudStartMap;                   // Mapping from new vtable names to their corresponding cloud starts
     std::map<vtbl_name_t, unsigned> alignmentMap;
+    cloud_hotness_map_t cloudHotness;                  // root -> estimated # of dispatches
     vtbl_t dummyVtable;
     bool interleave;
 
@@ -68,8 +73,16 @@ namespace llvm {
     virtual ~SDLayoutBuilder() { }
 
     bool runOnModule(Module &M) {
+      return run(M, getAnalysis<SDBuildCHA>());
+    }
+
+    /**
+     * Build the layout on top of the given CHA, which has to outlive the
+     * uses of the layout.
+     */
+    bool run(Module &M, SDBuildCHA &CHA) {
       sd_print("Started build layout\n");
-      cha = &getAnalysis<SDBuildCHA>();
+      cha = &CHA;
 
       buildNewLayouts(M);
       verifyNewLayouts(M);
@@ -89,12 +102,29 @@ namespace llvm {
     virtual void removeOldLayouts(Module &M);
 
     virtual int64_t translateVtblInd(vtbl_t vtbl, int64_t offset, bool isRelative);
+
+    /**
+     * translateVtblInd of every entry of the old sub-vtable, relative to the
+     * address point. addrPt is set to the position of the address point in
+     * the old sub-vtable. Returns false if the sub-vtable keeps its indices.
+     */
+    bool getTranslatedInds(const vtbl_t& vtbl, int64_t& addrPt,
+                           std::vector<int64_t>& inds);
+
     /**
      * Get the start of the valid range for vptrs for a (potentially non-primary) vtable.
      * In practice we are always interested in primary vtables here.
      */
     llvm::Constant* getVTableRangeStart(const vtbl_t& vtbl);
 
+    /**
+     * Number of consecutive slots of a class that are kept together when
+     * interleaving the cloud. The address points of the cloud end up this
+     * many entries apart, which becomes the stride of the range checks.
+     * -sd-ivtbl-block-for overrides -sd-ivtbl-block for a given root.
+     */
+    uint64_t getInterleaveBlock(const vtbl_name_t& root, const order_t& order);
+
   private:
     /**
      * New starting address point inside the interleaved vtable
@@ -135,8 +165,24 @@ namespace llvm {
      * @param part        : A list reference to record the <vtbl_t, element index> pairs
      * @param order       : A list that contains the preorder traversal
      * @param positiveOff : true if we're filling the positive (function pointers) part
+     * @param block       : number of consecutive elements of a vtable placed together
      */
-    void fillVtablePart(interleaving_list_t& part, const order_t& order, bool positiveOff);
+    void fillVtablePart(interleaving_list_t& part, const order_t& order, bool positiveOff,
+                        uint64_t block = 1);
+
+    /**
+     * Estimate how often each cloud is dispatched through. The counts come from
+     * the dispatch profile when one is given, otherwise from the number of
+     * static check and index sites referring to the cloud.
+     */
+    void calculateCloudHotness(Module& M);
+
+    /**
+     * Move the interleaved vtables into their dedicated section, hottest
+     * cloud first, so that the hot tables share as few pages as possible.
+     * Every hot table is aligned to -sd-vtbl-hot-align.
+     */
+    void placeNewVTables(Module& M);
 
     /**
      * These functions and variables used to deal with duplication
@@ -145,10 +191,30 @@ namespace llvm {
     unsigned vcallMDId;
     std::set<Function*> vthunksToRemove;
 
+    /**
+     * Cloned vthunks are merged when their rewritten bodies are identical.
+     * thunkBodies maps a structural hash to the surviving clones with that
+     * hash and mergedThunks maps the name of every dropped clone to the one
+     * that replaced it.
+     */
+    std::map<uint64_t, std::vector<Function*> > thunkBodies;
+    std::map<std::string, Function*> mergedThunks;
+    uint64_t numMergedThunks = 0;
+
     void createThunkFunctions(Module&, const vtbl_name_t& rootName);
     Function* getVthunkFunction(Constant* vtblElement);
+    Function* getNewThunkFunction(Module& M, const std::string& newThunkName);
 
     SDBuildCHA *cha;
   };
 
+  /**
+   * Replace the vbase offsets read through vptrs of classes without derived
+   * classes with constants. Has to run before SDUpdateIndices, returns the
+   * number of folded reads.
+   */
+  unsigned sd_foldVbaseOffsets(Module& M, SDBuildCHA& cha);
+
 }
+
+#endif
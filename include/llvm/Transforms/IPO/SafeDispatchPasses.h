@@ -0,0 +1,60 @@
+#ifndef LLVM_TRANSFORMS_IPO_SAFEDISPATCH_PASSES_H
+#define LLVM_TRANSFORMS_IPO_SAFEDISPATCH_PASSES_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/PassManager.h"
+
+/**
+ * The SafeDispatch LTO pipeline for the new pass manager:
+ *
+ *   sd-fix, sd-ivtbl or sd-ovtbl, <LTO optimizations>, sd-subst
+ *
+ * The CHA is taken from SDBuildCHAAnalysis, so passes running in between can
+ * use it without rebuilding it. It is kept by sd-subst and by the passes that
+ * preserve all analyses (verify, print, a pass that changed nothing). sd-fix
+ * rewrites the destructors in the vtables and the layout passes replace the
+ * vtables, so both drop it when they change the module.
+ *
+ * Function passes never touch the vtables, but a function pass adaptor that
+ * changed any function preserves no module analysis. The CHA is then
+ * rebuilt by the next pass that asks for it.
+ */
+
+namespace llvm {
+
+  class Module;
+
+  /**
+   * Fixes the vtables before the hierarchy is built (see SDFix)
+   */
+  class SDFixPass {
+  public:
+    static StringRef name() { return "SDFixPass"; }
+    PreservedAnalyses run(Module &M);
+  };
+
+  /**
+   * Interleaves or orders the vtables and rewrites the intrinsics against the
+   * new layout (SDLayoutBuilder, SDFoldVbaseOffsets and SDUpdateIndices)
+   */
+  class SDLayoutPass {
+    bool interleave;
+
+  public:
+    explicit SDLayoutPass(bool interleave) : interleave(interleave) {}
+
+    static StringRef name() { return "SDLayoutPass"; }
+    PreservedAnalyses run(Module &M, ModuleAnalysisManager *AM);
+  };
+
+  /**
+   * Lowers the remaining range checks and indices (see SDSubstModule3)
+   */
+  class SDSubstPass {
+  public:
+    static StringRef name() { return "SDSubstPass"; }
+    PreservedAnalyses run(Module &M);
+  };
+}
+
+#endif
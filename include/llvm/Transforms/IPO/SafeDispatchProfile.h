@@ -0,0 +1,48 @@
+#ifndef LLVM_TRANSFORMS_IPO_SAFEDISPATCH_PROFILE_H
+#define LLVM_TRANSFORMS_IPO_SAFEDISPATCH_PROFILE_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Dispatch profiles consist of two kinds of lines, '#' starts a comment:
+ *
+ *   <vtable> <count>
+ *   site <function> <index> <class> <root> <vtable> <order> <count>
+ *
+ * The first one gives the number of dispatches through a vtable. The second
+ * one is written by the libsdprof runtime (-sd-prof-instrument) and gives the
+ * number of dispatches at the index-th check site of function (checking for
+ * class) that saw the order-th sub-vtable of vtable, laid out in the cloud of
+ * root. Vptrs that aren't part of any cloud are recorded with root and vtable
+ * "-".
+ */
+
+namespace llvm {
+
+  class MemoryBuffer;
+
+  class SDDispatchProfile {
+  public:
+    struct site_t {
+      std::string function;   // function containing the check
+      uint64_t index;         // check site number inside the function
+      std::string className;  // static class of the check
+      std::string root;       // root of the observed vtable, "-" if unknown
+      std::string vtable;     // observed vtable, "-" if unknown
+      uint64_t order;         // sub-vtable index of the observed vptr
+      uint64_t count;
+    };
+
+    std::map<std::string, uint64_t> vtables;  // vtable -> # of dispatches
+    std::vector<site_t> sites;
+
+    /**
+     * Parse a profile, returns false and sets err on malformed input
+     */
+    bool read(const MemoryBuffer& buf, std::string& err);
+  };
+}
+
+#endif
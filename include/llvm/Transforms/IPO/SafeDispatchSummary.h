@@ -0,0 +1,107 @@
+#ifndef LLVM_TRANSFORMS_IPO_SAFEDISPATCH_SUMMARY_H
+#define LLVM_TRANSFORMS_IPO_SAFEDISPATCH_SUMMARY_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Split (summary based) SafeDispatch builds work in three steps:
+ *
+ * 1. Each module is reduced to a class summary: its sd.class_info records,
+ *    the initializers of the vtables they describe and the bodies of the
+ *    virtual thunks in them. Everything else becomes a declaration
+ *    (sd_buildClassSummary).
+ * 2. The summaries are linked and SDBuildCHA/SDLayoutBuilder run on the
+ *    result. This produces the module that defines the new vtables and the
+ *    rewritten thunks, and a layout file describing where each old vtable
+ *    ended up and how its indices changed (SDExportLayout).
+ * 3. Every module is rewritten independently against the layout file
+ *    (SDApplyLayout, followed by SDSubstModule3).
+ *
+ * Local symbols referenced from the vtables are promoted to hidden globals in
+ * steps 1 and 3 with the same (module identifier based) name, so both steps
+ * must see the same module identifier.
+ */
+
+namespace llvm {
+
+  class MemoryBuffer;
+
+  /**
+   * Global vtable layout computed from the class summaries
+   */
+  class SDLayoutSummary {
+  public:
+    typedef std::pair<std::string, uint64_t> vtbl_t;
+
+    struct cloud_t {
+      uint64_t alignment;  // alignment of the new vtable in bytes
+      uint64_t size;       // number of entries in the new vtable
+    };
+
+    struct vtbl_info_t {
+      bool defined;             // does the module define the old vtable
+      uint64_t addrPt;          // address point inside the old vtable
+      std::string root;         // root of the cloud, "" when unknown
+      int64_t start;            // index of the range start in the new vtable, -1 if none
+      int64_t width;            // range width in number of vtables
+      std::string layoutClass;  // class that decides the layout of the sub-vtable
+
+      // new index of each entry of the old sub-vtable relative to the new
+      // address point, empty if the indices are unchanged
+      int64_t indsAddrPt;       // position of the address point in inds
+      std::vector<int64_t> inds;
+    };
+
+    std::map<std::string, cloud_t> clouds;  // root -> new vtable
+    std::map<vtbl_t, vtbl_info_t> vtbls;    // (vtbl,ind) -> layout info
+
+    /**
+     * Index of the sub-vtable of derived that is laid out as base, -1 if there
+     * is none. Mirrors SDBuildCHA::getSubVTableIndex.
+     */
+    int64_t getSubVTableIndex(const std::string& derived, const std::string& base) const;
+
+    /**
+     * New index of the entry at the given offset from the address point of
+     * the sub-vtable. Mirrors SDLayoutBuilder::translateVtblInd.
+     */
+    int64_t translateVtblInd(const vtbl_t& vtbl, int64_t offset) const;
+
+    void write(raw_ostream& out) const;
+
+    /**
+     * Parse a layout file, returns false and sets err on malformed input
+     */
+    bool read(const MemoryBuffer& buf, std::string& err);
+  };
+
+  /**
+   * The layout file given with -sd-layout. It is parsed once per process and
+   * shared read-only by every module SDApplyLayout rewrites.
+   */
+  const SDLayoutSummary& sd_getLayout();
+
+  /**
+   * Give the local symbols used by the vtables described in sd.class_info
+   * and by their virtual thunks (and the local vtables themselves) hidden
+   * external linkage, so that the new vtables and thunks can refer to them
+   * from another module.
+   */
+  void sd_promoteVTableLocals(Module& M);
+
+  /**
+   * Reduce the module to what the layout step needs: the sd.class_info
+   * records, the vtables they describe and their virtual thunks. All other
+   * functions and globals become declarations.
+   */
+  void sd_buildClassSummary(Module& M);
+}
+
+#endif
@@ -4,7 +4,11 @@
 #include "llvm/ADT/StringRef.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/SafeDispatchMD.h"
 
+#include <cstring>
 #include <string>
 
 #include "SafeDispatchLog.h"
@@ -28,5 +32,46 @@ static bool sd_isVtableName(std::string& className) {
 
   return sd_isVtableName_ref(name);
 }
+
+/**
+ * True for the new vtable of a cloud, i.e. SD_NEW_VTABLE_PREFIX followed by
+ * the name of the root vtable. The sentinel vtable is not one.
+ */
+static bool sd_isNewVtableName(const llvm::StringRef& name) {
+  return name.startswith(SD_NEW_VTABLE_PREFIX) &&
+         sd_isVtableName_ref(name.drop_front(strlen(SD_NEW_VTABLE_PREFIX)));
+}
+
+/**
+ * Extracts the vtable name from a (class name, vtable global variable) tuple
+ * attached to the sd intrinsics. Note that the global variable isn't always
+ * emitted, in which case the plain class name is returned.
+ */
+static std::string
+sd_getClassNameFromMD(llvm::MDNode* mdNode, unsigned operandNo = 0) {
+  llvm::MDTuple* mdTuple = llvm::cast<llvm::MDTuple>(mdNode);
+  assert(mdTuple->getNumOperands() > operandNo + 1);
+
+  llvm::MDNode* nameMdNode = llvm::cast<llvm::MDNode>(mdTuple->getOperand(operandNo).get());
+  llvm::MDString* mdStr = llvm::cast<llvm::MDString>(nameMdNode->getOperand(0));
+
+  llvm::StringRef strRef = mdStr->getString();
+  assert(sd_isVtableName_ref(strRef));
+
+  llvm::MDNode* gvMd = llvm::cast<llvm::MDNode>(mdTuple->getOperand(operandNo+1).get());
+
+  llvm::ConstantAsMetadata* vtblConsMd =
+    llvm::dyn_cast_or_null<llvm::ConstantAsMetadata>(gvMd->getOperand(0).get());
+  if (vtblConsMd == NULL) {
+    return strRef.str();
+  }
+
+  llvm::GlobalVariable* vtbl = llvm::cast<llvm::GlobalVariable>(vtblConsMd->getValue());
+
+  llvm::StringRef vtblNameRef = vtbl->getName();
+  assert(vtblNameRef.startswith(strRef));
+
+  return vtblNameRef.str();
+}
 #endif
 
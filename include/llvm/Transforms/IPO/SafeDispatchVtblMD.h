@@ -8,7 +8,7 @@
 
 #include "llvm/Transforms/IPO/SafeDispatchLog.h"
 #include "llvm/Transforms/IPO/SafeDispatchTools.h"
-#include "llvm/Transforms/IPO/SafeDispatchMD.h"
+#include "llvm/IR/SafeDispatchMD.h"
 #include "llvm/Transforms/IPO/SafeDispatchGVMd.h"
 
 #include <iostream>
@@ -37,27 +37,6 @@ namespace {
       order(_order), parents(_parents), start(_start),
       end(_end), addressPoint(_addrPt) {}
 
-    llvm::MDNode* getMDNode(llvm::Module& M, llvm::LLVMContext& C) {
-      std::vector<llvm::Metadata*> tuple;
-      std::vector<llvm::Metadata*> parentsTuple;
-
-      parentsTuple.push_back(sd_getMDNumber(C, parents.size()));
-
-      for (auto it: parents) {
-        parentsTuple.push_back(sd_getMDString(C, it.first));
-        parentsTuple.push_back(sd_getMDNumber(C, it.second));
-        parentsTuple.push_back(sd_getClassVtblGVMD(it.first, M));
-      }
-
-      tuple.push_back(sd_getMDNumber(C, order));
-      tuple.push_back(sd_getMDNumber(C, start));
-      tuple.push_back(sd_getMDNumber(C, end));
-      tuple.push_back(sd_getMDNumber(C, addressPoint));
-      tuple.push_back(llvm::MDNode::get(C, parentsTuple));
-
-      return llvm::MDNode::get(C, tuple);
-    }
-
     void dump(std::ostream& out) {
       out << order << ", "
           << parents.size() << ":{";
@@ -244,32 +223,14 @@ sd_insertVtableMD(clang::CodeGen::CodeGenModule* CGM, llvm::GlobalVariable* VTab
 
   // don't produce any duplicate md
   if (classInfo->getNumOperands() > 0) {
-    std::set<uint64_t> aps;
-    for (auto &&AP : VTLayout->getAddressPoints()) {
-      aps.insert(AP.second);
-    }
-    // last 1 is for class vtable
-    assert(classInfo->getNumOperands() == (2 + aps.size() + 1));
+    assert(classInfo->getNumOperands() == 1);
     return;
   }
 
-  llvm::LLVMContext& C = CGM->getLLVMContext();
-
   llvm::Module& M = CGM->getModule();
 
-  // first put the class name
-  classInfo->addOperand(llvm::MDNode::get(C, sd_getMDString(C, className)));
-
-  // second put the vtable global variable
-  classInfo->addOperand(sd_getClassVtblGVMD(className,M,VTable));
-
-  // third put the size of the tuple
-  classInfo->addOperand(llvm::MDNode::get(C, sd_getMDNumber(C, subVtables.size())));
-
-  // then add md for each sub-vtable
-  for (unsigned i = 0; i < subVtables.size(); ++i) {
-    classInfo->addOperand(subVtables[i].getMDNode(M,C));
-  }
+  // a single tuple holds the class name, its vtable and the packed sub-vtable info
+  classInfo->addOperand(SDClassInfoMD::get(M, className, VTable, subVtables));
 
   // make sure parent class' metadata is added too
   for (auto &&AP : VTLayout->getAddressPoints()) {
@@ -2449,6 +2449,21 @@ static void EmitDarwinBCHeaderAndTrailer(SmallVectorImpl<char> &Buffer,
     Buffer.push_back(0);
 }
 
+static void WriteBitcodeHeaderAndModule(const Module *M,
+                                        BitstreamWriter &Stream,
+                                        bool ShouldPreserveUseListOrder) {
+  // Emit the file header.
+  Stream.Emit((unsigned)'B', 8);
+  Stream.Emit((unsigned)'C', 8);
+  Stream.Emit(0x0, 4);
+  Stream.Emit(0xC, 4);
+  Stream.Emit(0xE, 4);
+  Stream.Emit(0xD, 4);
+
+  // Emit the module.
+  WriteModule(M, Stream, ShouldPreserveUseListOrder);
+}
+
 /// WriteBitcodeToFile - Write the specified module to the specified output
 /// stream.
 void llvm::WriteBitcodeToFile(const Module *M, raw_ostream &Out,
@@ -2465,17 +2480,7 @@ void llvm::WriteBitcodeToFile(const Module *M, raw_ostream &Out,
   // Emit the module into the buffer.
   {
     BitstreamWriter Stream(Buffer);
-
-    // Emit the file header.
-    Stream.Emit((unsigned)'B', 8);
-    Stream.Emit((unsigned)'C', 8);
-    Stream.Emit(0x0, 4);
-    Stream.Emit(0xC, 4);
-    Stream.Emit(0xE, 4);
-    Stream.Emit(0xD, 4);
-
-    // Emit the module.
-    WriteModule(M, Stream, ShouldPreserveUseListOrder);
+    WriteBitcodeHeaderAndModule(M, Stream, ShouldPreserveUseListOrder);
   }
 
   if (TT.isOSDarwin())
@@ -2484,3 +2489,23 @@ void llvm::WriteBitcodeToFile(const Module *M, raw_ostream &Out,
   // Write the generated bitstream to "Out".
   Out.write((char*)&Buffer.front(), Buffer.size());
 }
+
+/// WriteBitcodeToFile - Write the specified module to the specified file,
+/// streaming the bitstream to it when the file supports seeking.
+void llvm::WriteBitcodeToFile(const Module *M, raw_fd_ostream &Out,
+                              bool ShouldPreserveUseListOrder) {
+  // The darwin wrapper header needs the size of the whole bitstream up front.
+  if (!Out.supportsSeeking() || Triple(M->getTargetTriple()).isOSDarwin())
+    return WriteBitcodeToFile(M, static_cast<raw_ostream &>(Out),
+                              ShouldPreserveUseListOrder);
+
+  SmallVector<char, 0> Buffer;
+  Buffer.reserve(256*1024);
+  {
+    BitstreamWriter Stream(Buffer, Out);
+    WriteBitcodeHeaderAndModule(M, Stream, ShouldPreserveUseListOrder);
+  }
+
+  // Write the words that were not flushed yet.
+  Out.write(Buffer.data(), Buffer.size());
+}
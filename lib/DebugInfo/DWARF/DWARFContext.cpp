@@ -374,9 +374,50 @@ DWARFCompileUnit *DWARFContext::getCompileUnitForOffset(uint32_t Offset) {
 
 DWARFCompileUnit *DWARFContext::getCompileUnitForAddress(uint64_t Address) {
   // First, get the offset of the compile unit.
-  uint32_t CUOffset = getDebugAranges()->findAddress(Address);
+  uint32_t CUOffset = -1U;
+  if (LazyAddressLookup) {
+    // Building the full table parses the unit DIE of every unit that isn't in
+    // .debug_aranges, only do it when the section doesn't know the address.
+    if (!SectionAranges) {
+      SectionAranges.reset(new DWARFDebugAranges());
+      SectionAranges->generateFromSection(this);
+    }
+    CUOffset = SectionAranges->findAddress(Address);
+  }
+  if (CUOffset == -1U)
+    CUOffset = getDebugAranges()->findAddress(Address);
   // Retrieve the compile unit.
-  return getCompileUnitForOffset(CUOffset);
+  DWARFCompileUnit *CU = getCompileUnitForOffset(CUOffset);
+  if (CU && LazyAddressLookup)
+    touchParsedUnit(CU);
+  return CU;
+}
+
+void DWARFContext::touchParsedUnit(DWARFCompileUnit *CU) {
+  if (!MaxParsedUnits)
+    return;
+  auto Pos = ParsedUnitPositions.find(CU);
+  if (Pos != ParsedUnitPositions.end()) {
+    ParsedUnits.splice(ParsedUnits.begin(), ParsedUnits, Pos->second);
+    return;
+  }
+  ParsedUnits.push_front(CU);
+  ParsedUnitPositions[CU] = ParsedUnits.begin();
+
+  while (ParsedUnits.size() > MaxParsedUnits) {
+    DWARFCompileUnit *LRU = ParsedUnits.back();
+    ParsedUnits.pop_back();
+    ParsedUnitPositions.erase(LRU);
+    // The unit DIE is kept, it still knows where the line table is.
+    const DWARFDebugInfoEntryMinimal *CUDie = LRU->getCompileUnitDIE();
+    if (Line && CUDie) {
+      uint32_t StmtOffset =
+          CUDie->getAttributeValueAsSectionOffset(LRU, DW_AT_stmt_list, -1U);
+      if (StmtOffset != -1U)
+        Line->clearLineTable(StmtOffset);
+    }
+    LRU->releaseDIEs();
+  }
 }
 
 static bool getFunctionNameForAddress(DWARFCompileUnit *CU, uint64_t Address,
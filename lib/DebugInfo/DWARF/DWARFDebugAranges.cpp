@@ -61,6 +61,16 @@ void DWARFDebugAranges::generate(DWARFContext *CTX) {
   construct();
 }
 
+void DWARFDebugAranges::generateFromSection(DWARFContext *CTX) {
+  clear();
+  if (!CTX)
+    return;
+
+  DataExtractor ArangesData(CTX->getARangeSection(), CTX->isLittleEndian(), 0);
+  extract(ArangesData);
+  construct();
+}
+
 void DWARFDebugAranges::clear() {
   Endpoints.clear();
   Aranges.clear();
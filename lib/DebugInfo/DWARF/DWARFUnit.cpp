@@ -309,6 +309,11 @@ void DWARFUnit::clearDIEs(bool KeepCUDie) {
   }
 }
 
+void DWARFUnit::releaseDIEs() {
+  clearDIEs(true);
+  DWO.reset();
+}
+
 void DWARFUnit::collectAddressRanges(DWARFAddressRangesVector &CURanges) {
   // First, check if CU DIE describes address ranges for the unit.
   const auto &CUDIERanges = getCompileUnitDIE()->getAddressRanges(this);
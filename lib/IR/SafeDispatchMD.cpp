@@ -0,0 +1,142 @@
+//===-- SafeDispatchMD.cpp - SafeDispatch class info metadata -------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file upgrades the sd.class_info records written by older compilers.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/IR/SafeDispatchMD.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+using namespace llvm;
+
+namespace {
+struct OldSubVTable {
+  uint64_t order;
+  uint64_t start;
+  uint64_t end;
+  uint64_t addressPoint;
+  std::set<std::pair<std::string, uint64_t> > parents;
+};
+}
+
+static bool getNumber(const Metadata *MD, uint64_t &Val) {
+  auto *CI = mdconst::dyn_extract_or_null<ConstantInt>(MD);
+  if (!CI)
+    return false;
+  Val = CI->getZExtValue();
+  return true;
+}
+
+/// Reads a !{i64 N} operand.
+static bool getBoxedNumber(const MDNode *N, uint64_t &Val) {
+  return N && N->getNumOperands() == 1 && getNumber(N->getOperand(0), Val);
+}
+
+/// Returns the vtable of a !{gv} operand, null for !{!"NO_VTABLE"}.
+static GlobalVariable *getBoxedVTable(const Metadata *MD) {
+  auto *N = dyn_cast_or_null<MDNode>(MD);
+  if (!N || N->getNumOperands() != 1)
+    return nullptr;
+  return mdconst::dyn_extract_or_null<GlobalVariable>(N->getOperand(0));
+}
+
+static bool readOldSubVTable(const MDNode *N, OldSubVTable &Sub) {
+  if (N->getNumOperands() != 5 ||
+      !getNumber(N->getOperand(0), Sub.order) ||
+      !getNumber(N->getOperand(1), Sub.start) ||
+      !getNumber(N->getOperand(2), Sub.end) ||
+      !getNumber(N->getOperand(3), Sub.addressPoint))
+    return false;
+
+  auto *Parents = dyn_cast_or_null<MDNode>(N->getOperand(4));
+  uint64_t NumParents;
+  if (!Parents || Parents->getNumOperands() == 0 ||
+      !getNumber(Parents->getOperand(0), NumParents) ||
+      Parents->getNumOperands() != 1 + 3 * NumParents)
+    return false;
+
+  for (unsigned i = 0; i < NumParents; ++i) {
+    auto *Name = dyn_cast_or_null<MDString>(Parents->getOperand(1 + 3 * i));
+    uint64_t Order;
+    if (!Name || !getNumber(Parents->getOperand(2 + 3 * i), Order))
+      return false;
+
+    // linking might have renamed internal vtables
+    std::string PtName = Name->getString();
+    if (GlobalVariable *GV = getBoxedVTable(Parents->getOperand(3 + 3 * i)))
+      PtName = GV->getName();
+    Sub.parents.insert(std::make_pair(PtName, Order));
+  }
+
+  return true;
+}
+
+bool llvm::UpgradeSDClassInfo(Module &M, NamedMDNode &NMD) {
+  bool IsOld = false;
+  for (const MDNode *N : NMD.operands())
+    IsOld |= !SDClassInfoMD::isClassInfo(N);
+  if (!IsOld)
+    return false;
+
+  std::vector<MDNode *> Records;
+  std::set<MDNode *> Seen;
+  unsigned Op = 0, E = NMD.getNumOperands();
+
+  // the old linker simply concatenated these sequences
+  while (Op < E) {
+    MDNode *NameN = NMD.getOperand(Op);
+    if (SDClassInfoMD::isClassInfo(NameN)) {
+      if (Seen.insert(NameN).second)
+        Records.push_back(NameN);
+      ++Op;
+      continue;
+    }
+
+    uint64_t NumSubs;
+    if (Op + 3 > E || NameN->getNumOperands() != 1 ||
+        !getBoxedNumber(NMD.getOperand(Op + 2), NumSubs) ||
+        Op + 3 + NumSubs > E)
+      return false;
+    auto *Name = dyn_cast_or_null<MDString>(NameN->getOperand(0));
+    if (!Name)
+      return false;
+
+    GlobalVariable *VTable = getBoxedVTable(NMD.getOperand(Op + 1));
+    std::string ClassName = VTable ? VTable->getName() : Name->getString();
+
+    std::vector<OldSubVTable> Subs(NumSubs);
+    for (unsigned i = 0; i < NumSubs; ++i)
+      if (!readOldSubVTable(NMD.getOperand(Op + 3 + i), Subs[i]))
+        return false;
+    Op += 3 + NumSubs;
+
+    MDNode *N = SDClassInfoMD::get(M, ClassName, VTable, Subs);
+    if (Seen.insert(N).second)
+      Records.push_back(N);
+  }
+
+  NMD.dropAllReferences();
+  for (MDNode *N : Records)
+    NMD.addOperand(N);
+  return true;
+}
+
+bool llvm::UpgradeSDClassInfo(Module &M) {
+  bool Changed = false;
+  for (NamedMDNode &NMD : M.named_metadata())
+    if (NMD.getName().startswith(SD_MD_CLASSINFO))
+      Changed |= UpgradeSDClassInfo(M, NMD);
+  return Changed;
+}
@@ -0,0 +1,111 @@
+//===- lib/Linker/LinkBitcodeModules.cpp - Parallel bitcode linking -------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file links serialized modules into one on several threads. An
+// LLVMContext may only be used by one thread at a time, so the modules are
+// handed from one merge to the next as bitcode.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Linker/Linker.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+#include <mutex>
+using namespace llvm;
+
+namespace {
+/// Forwards the diagnostics of all the merges to the caller's handler, which
+/// is not expected to be thread safe.
+struct LockedDiagnostics {
+  DiagnosticHandlerFunction Handler;
+  std::mutex Lock;
+
+  void report(const DiagnosticInfo &DI) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    Handler(DI);
+  }
+};
+}
+
+static void contextDiagnosticHandler(const DiagnosticInfo &DI, void *Context) {
+  static_cast<LockedDiagnostics *>(Context)->report(DI);
+}
+
+static std::unique_ptr<Module> parsePart(const SmallVectorImpl<char> &Part,
+                                         LLVMContext &Context) {
+  ErrorOr<Module *> MOrErr = parseBitcodeFile(
+      MemoryBufferRef(StringRef(Part.data(), Part.size()), "<linked part>"),
+      Context);
+  if (std::error_code EC = MOrErr.getError()) {
+    Context.emitError("could not read linked bitcode: " + EC.message());
+    return nullptr;
+  }
+  return std::unique_ptr<Module>(*MOrErr);
+}
+
+/// Link the module in Right into the one in Left and serialize the result
+/// back into Left. Returns true on error.
+static bool linkPair(SmallVector<char, 0> &Left, SmallVector<char, 0> &Right,
+                     LockedDiagnostics &Diags) {
+  LLVMContext Context;
+  Context.setDiagnosticHandler(contextDiagnosticHandler, &Diags, true);
+
+  std::unique_ptr<Module> Dst = parsePart(Left, Context);
+  if (!Dst)
+    return true;
+  Left = SmallVector<char, 0>();
+  std::unique_ptr<Module> Src = parsePart(Right, Context);
+  if (!Src)
+    return true;
+  Right = SmallVector<char, 0>();
+
+  Linker L(Dst.get(), [&](const DiagnosticInfo &DI) { Diags.report(DI); });
+  if (L.linkInModule(Src.get(), false, true))
+    return true;
+  Src.reset();
+
+  raw_svector_ostream OS(Left);
+  WriteBitcodeToFile(Dst.get(), OS);
+  OS.flush();
+  return false;
+}
+
+bool Linker::LinkBitcodeModules(ThreadPool &Pool,
+                                std::vector<SmallVector<char, 0>> &Parts,
+                                DiagnosticHandlerFunction DiagnosticHandler) {
+  LockedDiagnostics Diags;
+  Diags.Handler = DiagnosticHandler;
+
+  // Each round links the odd parts into their left neighbours; an odd part
+  // out is carried over to the next round unchanged.
+  while (Parts.size() > 1) {
+    std::vector<std::shared_future<bool>> Results;
+    for (size_t I = 0; I + 1 < Parts.size(); I += 2) {
+      SmallVector<char, 0> *Left = &Parts[I], *Right = &Parts[I + 1];
+      Results.push_back(Pool.async(
+          [Left, Right, &Diags] { return linkPair(*Left, *Right, Diags); }));
+    }
+
+    bool Failed = false;
+    for (std::shared_future<bool> &R : Results)
+      Failed |= R.get();
+    if (Failed)
+      return true;
+
+    size_t Kept = 0;
+    for (size_t I = 0; I < Parts.size(); I += 2)
+      Parts[Kept++] = std::move(Parts[I]);
+    Parts.resize(Kept);
+  }
+  return false;
+}
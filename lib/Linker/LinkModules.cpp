@@ -21,10 +21,12 @@
 #include "llvm/ADT/Triple.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/DebugInfoMetadata.h"
 #include "llvm/IR/DiagnosticInfo.h"
 #include "llvm/IR/DiagnosticPrinter.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/SafeDispatchMD.h"
 #include "llvm/IR/TypeFinder.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
@@ -422,18 +424,27 @@ class ModuleLinker {
   /// Functions that have replaced other functions.
   SmallPtrSet<const Function *, 16> OverridingFunctions;
 
+  /// The ODR debug types of DstM, kept by the Linker across links.
+  Linker::ODRDebugTypeMap &DstDebugTypes;
+
   DiagnosticHandlerFunction DiagnosticHandler;
 
   /// For symbol clashes, prefer those from Src.
   bool OverrideFromSrc;
 
+  /// Link the definitions that are otherwise only linked when used.
+  bool LinkAllDefinitions;
+
 public:
-  ModuleLinker(Module *dstM, Linker::IdentifiedStructTypeSet &Set, Module *srcM,
+  ModuleLinker(Module *dstM, Linker::IdentifiedStructTypeSet &Set,
+               Linker::ODRDebugTypeMap &DebugTypes, Module *srcM,
                DiagnosticHandlerFunction DiagnosticHandler,
-               bool OverrideFromSrc)
+               bool OverrideFromSrc, bool LinkAllDefinitions)
       : DstM(dstM), SrcM(srcM), TypeMap(Set),
         ValMaterializer(TypeMap, DstM, LazilyLinkGlobalValues),
-        DiagnosticHandler(DiagnosticHandler), OverrideFromSrc(OverrideFromSrc) {
+        DstDebugTypes(DebugTypes), DiagnosticHandler(DiagnosticHandler),
+        OverrideFromSrc(OverrideFromSrc),
+        LinkAllDefinitions(LinkAllDefinitions) {
   }
 
   bool run();
@@ -504,8 +515,16 @@ private:
   void linkAliasBody(GlobalAlias &Dst, GlobalAlias &Src);
   bool linkGlobalValueBody(GlobalValue &Src);
 
+  void linkSDClassInfo(const NamedMDNode &SrcNMD, NamedMDNode &DestNMD);
   void linkNamedMDNodes();
   void stripReplacedSubprograms();
+
+  void mapODRDebugTypes();
+  bool mapODRMembers(const MDCompositeType &SrcTy,
+                     const MDCompositeType &DstTy);
+  bool isUnchangedByLink(const Metadata *MD,
+                         DenseMap<const Metadata *, bool> &Unchanged);
+  void mapUnchangedMetadata();
 };
 }
 
@@ -1082,7 +1101,7 @@ bool ModuleLinker::linkGlobalValueProto(GlobalValue *SGV) {
   } else {
     // If the GV is to be lazily linked, don't create it just yet.
     // The ValueMaterializerTy will deal with creating it if it's used.
-    if (!DGV && !OverrideFromSrc &&
+    if (!DGV && !OverrideFromSrc && !LinkAllDefinitions &&
         (SGV->hasLocalLinkage() || SGV->hasLinkOnceLinkage() ||
          SGV->hasAvailableExternallyLinkage())) {
       DoNotLinkFromSource.insert(SGV);
@@ -1252,6 +1271,36 @@ bool ModuleLinker::linkGlobalValueBody(GlobalValue &Src) {
   return false;
 }
 
+/// Merge the sd.class_info.<class> records of Src into the one of Dest. The
+/// records of a class only differ in whether their TU referenced the vtables,
+/// unless the class was defined differently.
+void ModuleLinker::linkSDClassInfo(const NamedMDNode &SrcNMD,
+                                   NamedMDNode &DestNMD) {
+  for (unsigned i = 0, e = SrcNMD.getNumOperands(); i != e; ++i) {
+    MDNode *N = MapMetadata(SrcNMD.getOperand(i), ValueMap, RF_None, &TypeMap,
+                            &ValMaterializer);
+    if (DestNMD.getNumOperands() == 0) {
+      DestNMD.addOperand(N);
+      continue;
+    }
+
+    MDNode *DestN = DestNMD.getOperand(0);
+    if (N == DestN)
+      continue;
+
+    SDClassInfoMD Info(N), DestInfo(DestN);
+    if (!DestInfo.isSameLayout(Info)) {
+      emitWarning("SafeDispatch class info of '" + DestInfo.getClassName() +
+                  "' differs between modules, keeping the first one");
+      continue;
+    }
+
+    // prefer the record that still references the vtable of the class
+    if (!DestInfo.getVTable() && Info.getVTable())
+      DestNMD.setOperand(0, N);
+  }
+}
+
 /// Insert all of the named MDNodes in Src into the Dest module.
 void ModuleLinker::linkNamedMDNodes() {
   const NamedMDNode *SrcModFlags = SrcM->getModuleFlagsMetadata();
@@ -1260,6 +1309,14 @@ void ModuleLinker::linkNamedMDNodes() {
     // Don't link module flags here. Do them separately.
     if (&*I == SrcModFlags) continue;
     NamedMDNode *DestNMD = DstM->getOrInsertNamedMetadata(I->getName());
+
+    // SafeDispatch class info: the same class is emitted by every TU that
+    // emits its vtable, keep one record per class.
+    if (I->getName().startswith(SD_MD_CLASSINFO)) {
+      linkSDClassInfo(*I, *DestNMD);
+      continue;
+    }
+
     // Add Src elements into Dest node.
     for (unsigned i = 0, e = I->getNumOperands(); i != e; ++i)
       DestNMD->addOperand(MapMetadata(I->getOperand(i), ValueMap, RF_None,
@@ -1267,6 +1324,147 @@ void ModuleLinker::linkNamedMDNodes() {
   }
 }
 
+/// Key that identifies a member of an ODR type across modules: its tag and its
+/// linkage name, or its name if it has none.
+static std::pair<unsigned, const MDString *>
+getODRMemberKey(const DebugNode *Member) {
+  if (auto *SP = dyn_cast_or_null<MDSubprogram>(Member))
+    return std::make_pair(SP->getTag(), SP->getRawLinkageName()
+                                            ? SP->getRawLinkageName()
+                                            : SP->getRawName());
+  if (auto *Ty = dyn_cast_or_null<MDDerivedType>(Member))
+    return std::make_pair(Ty->getTag(), Ty->getRawName());
+  return std::make_pair(0u, nullptr);
+}
+
+/// Map the members of SrcTy to the ones of DstTy that have the same key, so
+/// that definitions in SrcM point to the declarations DstM already has.
+/// Returns false without mapping anything if SrcTy has a member DstTy lacks:
+/// such a member would be cloned without being in DstTy's elements.
+bool ModuleLinker::mapODRMembers(const MDCompositeType &SrcTy,
+                                 const MDCompositeType &DstTy) {
+  SmallDenseMap<std::pair<unsigned, const MDString *>, DebugNode *, 16>
+      DstMembers;
+  for (DebugNode *Member : DstTy.getElements()) {
+    auto Key = getODRMemberKey(Member);
+    if (Key.second)
+      DstMembers.insert(std::make_pair(Key, Member));
+  }
+
+  SmallVector<std::pair<DebugNode *, DebugNode *>, 16> Members;
+  for (DebugNode *Member : SrcTy.getElements()) {
+    auto Key = getODRMemberKey(Member);
+    if (!Key.second)
+      continue;
+    auto I = DstMembers.find(Key);
+    if (I == DstMembers.end())
+      return false;
+    Members.push_back(std::make_pair(Member, I->second));
+  }
+
+  for (const auto &I : Members)
+    ValueMap.MD()[I.first].reset(I.second);
+  return true;
+}
+
+void Linker::ODRDebugTypeMap::update(const NamedMDNode *CUs) {
+  for (unsigned e = CUs->getNumOperands(); NumIndexedCUs < e; ++NumIndexedCUs) {
+    auto *CU = cast<MDCompileUnit>(CUs->getOperand(NumIndexedCUs));
+    for (DebugNode *Node : CU->getRetainedTypes()) {
+      auto *Ty = dyn_cast_or_null<MDCompositeType>(Node);
+      if (!Ty || !Ty->getRawIdentifier())
+        continue;
+
+      // A definition has priority over a declaration.
+      auto P = Types.insert(std::make_pair(Ty->getRawIdentifier(),
+                                           TrackingMDNodeRef(Ty)));
+      if (!P.second && !Ty->isForwardDecl())
+        P.first->second.reset(Ty);
+    }
+  }
+}
+
+/// Map the debug info types of SrcM that DstM already has, by their ODR
+/// identifier, to the destination types. Every TU emits its own copy of such
+/// a type, and the copies rarely unique to the same node even when they
+/// describe the same members. Mapping them up front keeps one copy and spares
+/// MapMetadata the walk over the source one. Copies with members the
+/// destination lacks, e.g. implicit members only one TU used, are linked as
+/// before.
+void ModuleLinker::mapODRDebugTypes() {
+  const NamedMDNode *SrcCUs = SrcM->getNamedMetadata("llvm.dbg.cu");
+  const NamedMDNode *DstCUs = DstM->getNamedMetadata("llvm.dbg.cu");
+  if (!SrcCUs || !DstCUs)
+    return;
+
+  DstDebugTypes.update(DstCUs);
+  auto &DstTypes = DstDebugTypes.Types;
+  if (DstTypes.empty())
+    return;
+
+  for (const MDNode *N : SrcCUs->operands()) {
+    DebugNodeArray Retain = cast<MDCompileUnit>(N)->getRetainedTypes();
+    for (DebugNode *Node : Retain) {
+      auto *SrcTy = dyn_cast_or_null<MDCompositeType>(Node);
+      if (!SrcTy || !SrcTy->getRawIdentifier())
+        continue;
+      auto I = DstTypes.find(SrcTy->getRawIdentifier());
+      if (I == DstTypes.end())
+        continue;
+
+      // A definition has priority over a declaration.
+      auto *DstTy = cast_or_null<MDCompositeType>(I->second.get());
+      if (!DstTy || (DstTy->isForwardDecl() && !SrcTy->isForwardDecl()))
+        continue;
+      if (mapODRMembers(*SrcTy, *DstTy))
+        ValueMap.MD()[SrcTy].reset(DstTy);
+    }
+  }
+}
+
+/// Returns whether mapping MD into DstM gives MD back, i.e. MD is built only
+/// of strings, integer and floating point constants, uniqued nodes of those
+/// and nodes already mapped to themselves. Nodes on a cycle are treated as
+/// changing.
+bool ModuleLinker::isUnchangedByLink(
+    const Metadata *MD, DenseMap<const Metadata *, bool> &Unchanged) {
+  if (!MD || isa<MDString>(MD))
+    return true;
+
+  auto Insert = Unchanged.insert(std::make_pair(MD, false));
+  if (!Insert.second)
+    return Insert.first->second;
+
+  if (Metadata *Mapped = ValueMap.MD().lookup(MD).get())
+    return Unchanged[MD] = Mapped == MD;
+
+  bool Result = false;
+  if (auto *C = dyn_cast<ConstantAsMetadata>(MD)) {
+    Result = isa<ConstantInt>(C->getValue()) || isa<ConstantFP>(C->getValue());
+  } else if (auto *N = dyn_cast<MDNode>(MD)) {
+    Result = N->isUniqued() && N->isResolved();
+    for (unsigned I = 0, E = N->getNumOperands(); Result && I != E; ++I)
+      Result = isUnchangedByLink(N->getOperand(I), Unchanged);
+  }
+  return Unchanged[MD] = Result;
+}
+
+/// Map the nodes reachable from the named metadata of SrcM that linking
+/// cannot change to themselves. Most of the debug info (types, files, scopes)
+/// is in the same context in both modules and references nothing from SrcM,
+/// so MapMetadata can take those subgraphs as they are instead of cloning
+/// and uniquing every node again.
+void ModuleLinker::mapUnchangedMetadata() {
+  DenseMap<const Metadata *, bool> Unchanged;
+  for (const NamedMDNode &NMD : SrcM->named_metadata())
+    for (const MDNode *Op : NMD.operands())
+      isUnchangedByLink(Op, Unchanged);
+
+  for (const auto &I : Unchanged)
+    if (I.second && isa<MDNode>(I.first))
+      ValueMap.MD()[I.first].reset(const_cast<Metadata *>(I.first));
+}
+
 /// Drop DISubprograms that have been superseded.
 ///
 /// FIXME: this creates an asymmetric result: we strip functions from losing
@@ -1486,6 +1684,11 @@ bool ModuleLinker::run() {
   assert(DstM && "Null destination module");
   assert(SrcM && "Null source module");
 
+  // SafeDispatch class info written by older compilers isn't uniqued per
+  // class; bring it into the current form before merging the records. The
+  // composite was upgraded when it was handed to the Linker.
+  UpgradeSDClassInfo(*SrcM);
+
   // Inherit the target data from the source module if the destination module
   // doesn't have one already.
   if (DstM->getDataLayout().isDefault())
@@ -1582,6 +1785,11 @@ bool ModuleLinker::run() {
   // OverridingFunctions has been built.
   stripReplacedSubprograms();
 
+  // Map the metadata that needs no linking before anything else maps
+  // metadata, so that MapMetadata stops at those nodes.
+  mapODRDebugTypes();
+  mapUnchangedMetadata();
+
   // Link in the function bodies that are defined in the source module into
   // DstM.
   for (Function &SF : *SrcM) {
@@ -1728,6 +1936,9 @@ bool Linker::IdentifiedStructTypeSet::hasType(StructType *Ty) {
 void Linker::init(Module *M, DiagnosticHandlerFunction DiagnosticHandler) {
   this->Composite = M;
   this->DiagnosticHandler = DiagnosticHandler;
+  ODRDebugTypes = ODRDebugTypeMap();
+
+  UpgradeSDClassInfo(*M);
 
   TypeFinder StructTypes;
   StructTypes.run(*M, true);
@@ -1757,9 +1968,11 @@ void Linker::deleteModule() {
   Composite = nullptr;
 }
 
-bool Linker::linkInModule(Module *Src, bool OverrideSymbols) {
-  ModuleLinker TheLinker(Composite, IdentifiedStructTypes, Src,
-                         DiagnosticHandler, OverrideSymbols);
+bool Linker::linkInModule(Module *Src, bool OverrideSymbols,
+                          bool LinkAllDefinitions) {
+  ModuleLinker TheLinker(Composite, IdentifiedStructTypes, ODRDebugTypes, Src,
+                         DiagnosticHandler, OverrideSymbols,
+                         LinkAllDefinitions);
   bool RetCode = TheLinker.run();
   Composite->dropTriviallyDeadConstantArrays();
   return RetCode;
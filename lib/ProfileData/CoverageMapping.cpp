@@ -183,11 +183,11 @@ CoverageMapping::load(CoverageMappingReader &CoverageReader,
                       IndexedInstrProfReader &ProfileReader) {
   auto Coverage = std::unique_ptr<CoverageMapping>(new CoverageMapping());
 
-  std::vector<uint64_t> Counts;
   for (const auto &Record : CoverageReader) {
     CounterMappingContext Ctx(Record.Expressions);
 
-    Counts.clear();
+    // The counts are referenced in place in the indexed profile when possible.
+    ArrayRef<uint64_t> Counts;
     if (std::error_code EC = ProfileReader.getFunctionCounts(
             Record.FunctionName, Record.FunctionHash, Counts)) {
       if (EC == instrprof_error::hash_mismatch) {
@@ -200,6 +200,7 @@ CoverageMapping::load(CoverageMappingReader &CoverageReader,
 
     assert(!Record.MappingRegions.empty() && "Function has no regions");
     FunctionRecord Function(Record.FunctionName, Record.Filenames);
+    Function.CountedRegions.reserve(Record.MappingRegions.size());
     for (const auto &Region : Record.MappingRegions) {
       ErrorOr<int64_t> ExecutionCount = Ctx.evaluate(Region.Count);
       if (!ExecutionCount)
@@ -220,7 +221,13 @@ CoverageMapping::load(CoverageMappingReader &CoverageReader,
 ErrorOr<std::unique_ptr<CoverageMapping>>
 CoverageMapping::load(StringRef ObjectFilename, StringRef ProfileFilename,
                       Triple::ArchType Arch) {
-  auto CounterMappingBuff = MemoryBuffer::getFileOrSTDIN(ObjectFilename);
+  // Map the object without asking for a null terminator, this keeps the
+  // coverage sections the records point into out of the heap.
+  auto CounterMappingBuff =
+      ObjectFilename == "-"
+          ? MemoryBuffer::getSTDIN()
+          : MemoryBuffer::getFile(ObjectFilename, /*FileSize=*/-1,
+                                  /*RequiresNullTerminator=*/false);
   if (std::error_code EC = CounterMappingBuff.getError())
     return EC;
   auto CoverageReaderOrErr =
@@ -47,7 +47,9 @@ static inline uint64_t ComputeHash(HashT Type, StringRef K) {
 }
 
 const uint64_t Magic = 0x8169666f72706cff; // "\xfflprofi\x81"
-const uint64_t Version = 2;
+// Version 3 pads the function names so that the counts of every record start
+// 8-byte aligned in the file.
+const uint64_t Version = 3;
 const HashT HashType = HashT::MD5;
 }
 
@@ -68,8 +68,12 @@ InstrProfReader::create(std::unique_ptr<MemoryBuffer> Buffer) {
 
 ErrorOr<std::unique_ptr<IndexedInstrProfReader>>
 IndexedInstrProfReader::create(std::string Path) {
-  // Set up the buffer to read.
-  auto BufferOrError = setupMemoryBuffer(Path);
+  // Set up the buffer to read. The indexed format doesn't need a null
+  // terminator, so the file can always be mapped.
+  ErrorOr<std::unique_ptr<MemoryBuffer>> BufferOrError =
+      Path == "-" ? MemoryBuffer::getSTDIN()
+                  : MemoryBuffer::getFile(Path, -1,
+                                          /*RequiresNullTerminator=*/false);
   if (std::error_code EC = BufferOrError.getError())
     return EC;
   return IndexedInstrProfReader::create(std::move(BufferOrError.get()));
@@ -352,6 +356,15 @@ std::error_code IndexedInstrProfReader::readHeader() {
 
 std::error_code IndexedInstrProfReader::getFunctionCounts(
     StringRef FuncName, uint64_t FuncHash, std::vector<uint64_t> &Counts) {
+  ArrayRef<uint64_t> Data;
+  if (std::error_code EC = getFunctionCounts(FuncName, FuncHash, Data))
+    return EC;
+  Counts.assign(Data.begin(), Data.end());
+  return success();
+}
+
+std::error_code IndexedInstrProfReader::getFunctionCounts(
+    StringRef FuncName, uint64_t FuncHash, ArrayRef<uint64_t> &Counts) {
   auto Iter = Index->find(FuncName);
   if (Iter == Index->end())
     return error(instrprof_error::unknown_function);
@@ -16,6 +16,7 @@
 #include "InstrProfIndexed.h"
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/EndianStream.h"
+#include "llvm/Support/MathExtras.h"
 #include "llvm/Support/OnDiskHashTable.h"
 
 using namespace llvm;
@@ -41,7 +42,11 @@ public:
     using namespace llvm::support;
     endian::Writer<little> LE(Out);
 
-    offset_type N = K.size();
+    // Pad the key with zeros so that the data starts 8-byte aligned, the
+    // reader can then use the counts in place. The item's hash was just
+    // written, the two lengths come next.
+    uint64_t DataStart = Out.tell() + 2 * sizeof(offset_type) + K.size();
+    offset_type N = K.size() + OffsetToAlignment(DataStart, sizeof(uint64_t));
     LE.write<offset_type>(N);
 
     offset_type M = 0;
@@ -53,7 +58,9 @@ public:
   }
 
   static void EmitKey(raw_ostream &Out, key_type_ref K, offset_type N){
-    Out.write(K.data(), N);
+    Out.write(K.data(), K.size());
+    for (offset_type I = K.size(); I < N; ++I)
+      Out << '\0';
   }
 
   static void EmitData(raw_ostream &Out, key_type_ref, data_type_ref V,
@@ -106,6 +113,16 @@ InstrProfWriter::addFunctionCounts(StringRef FunctionName,
   return instrprof_error::success;
 }
 
+void InstrProfWriter::mergeRecordsFromWriter(
+    InstrProfWriter &&IPW,
+    function_ref<void(StringRef, std::error_code)> Warn) {
+  for (auto &Function : IPW.FunctionData)
+    for (auto &Counts : Function.getValue())
+      if (std::error_code EC =
+              addFunctionCounts(Function.getKey(), Counts.first, Counts.second))
+        Warn(Function.getKey(), EC);
+}
+
 std::pair<uint64_t, uint64_t> InstrProfWriter::writeImpl(raw_ostream &OS) {
   OnDiskChainedHashTableGenerator<InstrProfRecordTrait> Generator;
 
@@ -0,0 +1,133 @@
+//==-- llvm/Support/ThreadPool.cpp - A ThreadPool implementation -*- C++ -*-==//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a crude C++11 based thread pool.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Support/ThreadPool.h"
+
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cassert>
+
+#if LLVM_ENABLE_THREADS
+#include <thread>
+#endif
+
+using namespace llvm;
+
+static unsigned getDefaultThreadCount() {
+#if LLVM_ENABLE_THREADS
+  return std::thread::hardware_concurrency();
+#else
+  return 1;
+#endif
+}
+
+ThreadPool::ThreadPool() : ThreadPool(getDefaultThreadCount()) {}
+
+#if LLVM_ENABLE_THREADS
+
+ThreadPool::ThreadPool(unsigned ThreadCount)
+    : ThreadCount(ThreadCount ? ThreadCount : 1), ActiveThreads(0),
+      EnableFlag(true) {
+  // Create ThreadCount threads that will loop forever, wait on QueueCondition
+  // for tasks to be queued or the Pool to be destroyed.
+  Threads.reserve(this->ThreadCount);
+  for (unsigned ThreadID = 0; ThreadID < this->ThreadCount; ++ThreadID)
+    Threads.emplace_back([this] { runWorker(); });
+}
+
+void ThreadPool::runWorker() {
+  while (true) {
+    TaskTy Task;
+    {
+      std::unique_lock<std::mutex> LockGuard(QueueLock);
+      // Wait for tasks to be pushed in the queue
+      QueueCondition.wait(LockGuard,
+                          [&] { return !EnableFlag || !Tasks.empty(); });
+      // Exit condition
+      if (!EnableFlag && Tasks.empty())
+        return;
+      // Yeah, we have a task, grab it and release the lock on the queue
+
+      // We first need to signal that we are active before popping the queue
+      // in order for wait() to properly detect that even if the queue is
+      // empty, there is still a task in flight.
+      ++ActiveThreads;
+      Task = std::move(Tasks.front());
+      Tasks.pop();
+    }
+    // Run the task we just grabbed
+    Task();
+
+    {
+      // Adjust `ActiveThreads`, in case someone waits on ThreadPool::wait()
+      std::unique_lock<std::mutex> LockGuard(CompletionLock);
+      --ActiveThreads;
+    }
+
+    // Notify task completion, in case someone waits on ThreadPool::wait()
+    CompletionCondition.notify_all();
+  }
+}
+
+void ThreadPool::wait() {
+  // Wait for all threads to complete and the queue to be empty
+  std::unique_lock<std::mutex> LockGuard(CompletionLock);
+  CompletionCondition.wait(LockGuard, [&] {
+    std::unique_lock<std::mutex> QueueLockGuard(QueueLock);
+    return Tasks.empty() && !ActiveThreads;
+  });
+}
+
+void ThreadPool::asyncImpl(TaskTy Task) {
+  {
+    // Lock the queue and push the new task
+    std::unique_lock<std::mutex> LockGuard(QueueLock);
+
+    // Don't allow enqueueing after disabling the pool
+    assert(EnableFlag && "Queuing a thread during ThreadPool destruction");
+
+    Tasks.push(std::move(Task));
+  }
+  QueueCondition.notify_one();
+}
+
+// The destructor joins all threads, waiting for completion.
+ThreadPool::~ThreadPool() {
+  {
+    std::unique_lock<std::mutex> LockGuard(QueueLock);
+    EnableFlag = false;
+  }
+  QueueCondition.notify_all();
+  for (auto &Worker : Threads)
+    Worker.join();
+}
+
+#else // LLVM_ENABLE_THREADS Disabled
+
+ThreadPool::ThreadPool(unsigned ThreadCount) : ThreadCount(1) {
+  if (ThreadCount > 1)
+    errs() << "Warning: request a ThreadPool with " << ThreadCount
+           << " threads, but LLVM_ENABLE_THREADS has been turned off\n";
+}
+
+void ThreadPool::wait() {
+  // Tasks already ran when they were submitted.
+}
+
+void ThreadPool::asyncImpl(TaskTy Task) {
+  Task();
+}
+
+ThreadPool::~ThreadPool() {}
+
+#endif
@@ -46,6 +46,14 @@ void llvm::initializeIPO(PassRegistry &Registry) {
   initializeStripDeadDebugInfoPass(Registry);
   initializeStripNonDebugSymbolsPass(Registry);
   initializeBarrierNoopPass(Registry);
+  initializeSDFixPass(Registry);
+  initializeSDBuildCHAPass(Registry);
+  initializeSDLayoutBuilderPass(Registry);
+  initializeSDFoldVbaseOffsetsPass(Registry);
+  initializeSDUpdateIndicesPass(Registry);
+  initializeSDSubstModule3Pass(Registry);
+  initializeSDExportLayoutPass(Registry);
+  initializeSDApplyLayoutPass(Registry);
 }
 
 void LLVMInitializeIPO(LLVMPassRegistryRef R) {
@@ -530,6 +530,7 @@ void PassManagerBuilder::populateLTOPassManager(legacy::PassManagerBase &PM) {
     PM.add(llvm::createSDFixPass());
     PM.add(llvm::createSDBuildCHAPass());
     PM.add(llvm::createSDLayoutBuilderPass(EmitIVTBLs));
+    PM.add(llvm::createSDFoldVbaseOffsetsPass());
     PM.add(llvm::createSDUpdateIndicesPass());
   }
 
@@ -15,8 +15,11 @@
 #include "llvm/Transforms/Utils/Local.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/CallSite.h"
+#include "llvm/IR/SafeDispatchMD.h"
+#include "llvm/Support/CommandLine.h"
 
 #include "llvm/Transforms/IPO/SafeDispatchLog.h"
+#include "llvm/Transforms/IPO/SafeDispatchTools.h"
 
 #include "llvm/Transforms/Utils/ValueMapper.h"
 #include "llvm/Transforms/Utils/Cloning.h"
@@ -38,6 +41,11 @@ using namespace llvm;
 
 #include <iostream>
 
+static cl::opt<bool>
+SDReferencedOnly("sd-cha-referenced-only", cl::init(false), cl::Hidden,
+  cl::desc("Only build the clouds of classes that are used by a SafeDispatch "
+           "intrinsic or whose vtable is still referenced"));
+
 char SDBuildCHA::ID = 0;
 
 INITIALIZE_PASS(SDBuildCHA, "sdcha", "Build CHA pass for SafeDispatch", false, false)
@@ -46,6 +54,16 @@ ModulePass* llvm::createSDBuildCHAPass() {
   return new SDBuildCHA();
 }
 
+/// ----------------------------------------------------------------------------
+/// SDBuildCHAAnalysis implementation
+/// ----------------------------------------------------------------------------
+
+char SDBuildCHAAnalysis::PassID;
+
+SDBuildCHAAnalysis::Result::Result(Module &M) : cha(new SDBuildCHA()) {
+  cha->runOnModule(M);
+}
+
 /**
  * Calculates the vtable order number given the index relative to
  * the beginning of the vtable
@@ -82,26 +100,6 @@ std::vector<SDBuildCHA::vtbl_t> SDBuildCHA::preorder(const vtbl_t& root) {
   return nodes;
 }
 
-static inline uint64_t
-sd_getNumberFromMDTuple(const MDOperand& op) {
-  Metadata* md = op.get();
-  assert(md);
-  ConstantAsMetadata* cam = dyn_cast_or_null<ConstantAsMetadata>(md);
-  assert(cam);
-  ConstantInt* ci = dyn_cast<ConstantInt>(cam->getValue());
-  assert(ci);
-
-  return ci->getSExtValue();
-}
-
-static inline SDBuildCHA::vtbl_name_t
-sd_getStringFromMDTuple(const MDOperand& op) {
-  MDString* mds = dyn_cast_or_null<MDString>(op.get());
-  assert(mds);
-
-  return mds->getString().str();
-}
-
 void SDBuildCHA::verifyClouds(Module &M) {
   for (auto rootName : roots) {
     vtbl_t root(rootName, 0);
@@ -215,63 +213,56 @@ void SDBuildCHA::buildClouds(Module &M) {
 
     //sd_print("GOT METADATA: %s\n", md->getName().data());
 
-    std::vector<nmd_t> infoVec = extractMetadata(md);
+    // after linking, the node might hold records of renamed internal vtables
+    std::set<vtbl_name_t> classes;
 
-    for (const nmd_t& info : infoVec) {
-      // record the old vtable array
-      GlobalVariable* oldVtable = M.getGlobalVariable(info.className, true);
+    for (unsigned op = 0; op < md->getNumOperands(); ++op) {
+      SDClassInfoMD info(md->getOperand(op));
+      vtbl_name_t className = info.getClassName();
 
-      //sd_print("class %s with %d subtables\n", info.className.c_str(), info.subVTables.size());
+      if (classes.count(className))
+        continue;
+      classes.insert(className);
 
-      /*
-      sd_print("oldvtables: %p, %d, class %s\n",
-               oldVtable,
-               oldVtable ? oldVtable->hasInitializer() : -1,
-               info.className.c_str());
-      */
+      // record the old vtable array
+      GlobalVariable* oldVtable = M.getGlobalVariable(className, true);
 
       if (oldVtable && oldVtable->hasInitializer()) {
         ConstantArray* vtable = dyn_cast<ConstantArray>(oldVtable->getInitializer());
         assert(vtable);
-        oldVTables[info.className] = vtable;
+        oldVTables[className] = vtable;
       } else {
-        undefinedVTables.insert(info.className);
+        undefinedVTables.insert(className);
       }
 
-      for(unsigned ind = 0; ind < info.subVTables.size(); ind++) {
-        const nmd_sub_t* subInfo = & info.subVTables[ind];
-        vtbl_t name(info.className, ind);
-        /*
-        sd_print("SubVtable[%d] Order: %d Parents[%d]: %s [%d-%d] AddrPt: %d\n",
-          ind, 
-          subInfo->order,
-          subInfo->parents.size(),
-          "NYI",
-          subInfo->start,
-          subInfo->end,
-          subInfo->addressPoint);
-        */
+      for(unsigned ind = 0; ind < info.getNumSubVTables(); ind++) {
+        vtbl_t name(className, ind);
+        uint64_t start = info.getStart(ind);
+        uint64_t end = info.getEnd(ind);
+        uint64_t addressPoint = info.getAddressPoint(ind);
+
+        assert(start <= addressPoint && addressPoint <= end);
+        assert(ind == 0 || info.getEnd(ind - 1) < start);
 
         if (build_undefinedVtables.find(name) != build_undefinedVtables.end()) {
-          //sd_print("Removing %s,%d from build_udnefinedVtables\n", name.first.c_str(), name.second);
           build_undefinedVtables.erase(name);
         }
 
         if (cloudMap.find(name) == cloudMap.end()){
-          //sd_print("Inserting %s, %d in cloudMap\n", name.first.c_str(), name.second);
           cloudMap[name] = std::set<vtbl_t>();
         }
 
         vtbl_set_t parents;
-        for (auto it : subInfo->parents) {
-          if (it.first != "") {
-            vtbl_t &parent = it;
+        for (unsigned pt = 0; pt < info.getNumParents(ind); pt++) {
+          StringRef ptName = info.getParentName(ind, pt);
+
+          if (ptName != "") {
+            vtbl_t parent(ptName, info.getParentOrder(ind, pt));
             parents.insert(parent);
 
             // if the parent class is not defined yet, add it to the
             // undefined vtable set
             if (cloudMap.find(parent) == cloudMap.end()) {
-              //sd_print("Inserting %s, %d in cloudMap - undefined parent\n", parent.first.c_str(), parent.second);
               cloudMap[parent] = std::set<vtbl_t>();
               build_undefinedVtables.insert(parent);
             }
@@ -281,17 +272,17 @@ void SDBuildCHA::buildClouds(Module &M) {
           } else {
             assert(ind == 0); // make sure secondary vtables have a direct parent
             // add the class to the root set
-            roots.insert(info.className);
+            roots.insert(className);
           }
         }
 
-        parentMap[info.className].push_back(parents);
+        parentMap[className].push_back(parents);
 
         // record the original address points
-        addrPtMap[info.className].push_back(subInfo->addressPoint);
+        addrPtMap[className].push_back(addressPoint);
 
         // record the sub-vtable ends
-        rangeMap[info.className].push_back(range_t(subInfo->start, subInfo->end));
+        rangeMap[className].push_back(range_t(start, end));
       }
     }
   }
@@ -339,96 +330,101 @@ void SDBuildCHA::buildClouds(Module &M) {
   }
 }
 
-static llvm::GlobalVariable* sd_mdnodeToGV(Metadata* vtblMd) {
-  llvm::MDNode* mdNode = dyn_cast<llvm::MDNode>(vtblMd);
-  assert(mdNode);
-  Metadata* md = mdNode->getOperand(0).get();
-
-  if(!md) {
-    return NULL;
+/**
+ * Classes the rest of the pipeline needs in the hierarchy: the ones named by
+ * the SafeDispatch intrinsics and the ones whose vtable still has uses (after
+ * GlobalDCE those are the vtables stored by live constructors)
+ */
+static void sd_collectReferencedClasses(Module &M, std::set<std::string>& classes) {
+  for (const GlobalVariable& gv : M.globals()) {
+    if (!gv.use_empty() && sd_isVtableName_ref(gv.getName()))
+      classes.insert(gv.getName());
   }
 
-  if(dyn_cast<llvm::MDString>(md)) {
-    return NULL;
-  }
+  // (intrinsic, metadata argument, class operands in the tuple)
+  struct { Intrinsic::ID id; unsigned arg; unsigned ops; } sites[] = {
+    { Intrinsic::sd_get_vtbl_index,   1, 1 },
+    { Intrinsic::sd_check_vtbl,       1, 1 },
+    { Intrinsic::sd_check_vtbl,       2, 1 },
+    { Intrinsic::sd_get_checked_vptr, 1, 2 },  // class and precise class
+  };
+
+  for (auto& site : sites) {
+    Function* F = M.getFunction(Intrinsic::getName(site.id));
+    if (!F)
+      continue;
+
+    std::set<MDNode*> seen;
+    for (User* U : F->users()) {
+      MDNode* mdNode = cast<MDNode>(cast<MetadataAsValue>(
+        cast<CallInst>(U)->getArgOperand(site.arg))->getMetadata());
+      if (!seen.insert(mdNode).second)
+        continue;
 
-  llvm::ConstantAsMetadata* vtblCAM = dyn_cast_or_null<ConstantAsMetadata>(md);
-  if(! vtblCAM) {
-    md->dump();
-    assert(false);
+      for (unsigned op = 0; op < site.ops; op++)
+        classes.insert(sd_getClassNameFromMD(mdNode, 2 * op));
+    }
   }
-  Constant* vtblC = vtblCAM->getValue();
-  GlobalVariable* vtblGV = dyn_cast<GlobalVariable>(vtblC);
-  assert(vtblGV);
-  return vtblGV;
 }
 
-std::vector<SDBuildCHA::nmd_t>
-SDBuildCHA::extractMetadata(NamedMDNode* md) {
-  std::set<vtbl_name_t> classes;
-  std::vector<SDBuildCHA::nmd_t> infoVec;
-
-  unsigned op = 0;
-
-  do {
-    SDBuildCHA::nmd_t info;
-    MDString* infoMDstr = dyn_cast_or_null<MDString>(md->getOperand(op++)->getOperand(0));
-    assert(infoMDstr);
-    info.className = infoMDstr->getString().str();
-    GlobalVariable* classVtbl = sd_mdnodeToGV(md->getOperand(op++));
-
-    if (classVtbl) {
-      info.className = classVtbl->getName();
-    }
+void SDBuildCHA::pruneUnreferencedClouds(Module &M) {
+  if (!SDReferencedOnly)
+    return;
 
-    unsigned numOperands = sd_getNumberFromMDTuple(md->getOperand(op++)->getOperand(0));
+  std::set<vtbl_name_t> referenced;
+  sd_collectReferencedClasses(M, referenced);
 
-    for (unsigned i = op; i < op + numOperands; ++i) {
-      SDBuildCHA::nmd_sub_t subInfo;
-      llvm::MDTuple* tup = dyn_cast<llvm::MDTuple>(md->getOperand(i));
-      assert(tup);
-      assert(tup->getNumOperands() == 5);
+  // a class keeps all the clouds its sub-vtables are in, which keeps every
+  // other class in them
+  std::set<vtbl_name_t> liveClasses;
+  std::set<vtbl_name_t> liveRoots;
+  std::deque<vtbl_name_t> worklist(referenced.begin(), referenced.end());
 
-      subInfo.order = sd_getNumberFromMDTuple(tup->getOperand(0));
-      subInfo.start = sd_getNumberFromMDTuple(tup->getOperand(1));
-      subInfo.end = sd_getNumberFromMDTuple(tup->getOperand(2));
-      subInfo.addressPoint = sd_getNumberFromMDTuple(tup->getOperand(3));
-      llvm::MDTuple* parentsTup = dyn_cast<llvm::MDTuple>(tup->getOperand(4));
+  while (!worklist.empty()) {
+    vtbl_name_t className = worklist.front();
+    worklist.pop_front();
 
-      unsigned numParents = sd_getNumberFromMDTuple(parentsTup->getOperand(0));
-      for (int j = 0; j < numParents; j++) {
-        vtbl_name_t ptName = sd_getStringFromMDTuple(parentsTup->getOperand(1+j*3));
-        unsigned ptIdx = sd_getNumberFromMDTuple(parentsTup->getOperand(1+j*3+1));
-        GlobalVariable* parentVtable = sd_mdnodeToGV(parentsTup->getOperand(1+j*3+2).get());
+    if (!liveClasses.insert(className).second || !rangeMap.count(className))
+      continue;
 
-        if (parentVtable) {
-          ptName = parentVtable->getName();
-        }
-        subInfo.parents.insert(vtbl_t(ptName, ptIdx));
-      }
+    for (uint64_t ind = 0; ind < rangeMap[className].size(); ind++) {
+      auto itr = ancestorMap.find(vtbl_t(className, ind));
+      if (itr == ancestorMap.end() || !liveRoots.insert(itr->second).second)
+        continue;
 
-      bool currRangeCheck = (subInfo.start <= subInfo.addressPoint &&
-                     subInfo.addressPoint <= subInfo.end);
-      bool prevVtblCheck = (i == op || (--info.subVTables.end())->end < subInfo.start);
+      for (const vtbl_t& member : preorder(vtbl_t(itr->second, 0)))
+        worklist.push_back(member.first);
+    }
+  }
 
-      assert(currRangeCheck && prevVtblCheck);
+  std::vector<vtbl_name_t> deadClasses;
+  for (auto& itr : rangeMap) {
+    if (!liveClasses.count(itr.first))
+      deadClasses.push_back(itr.first);
+  }
 
-      info.subVTables.push_back(subInfo);
+  for (const vtbl_name_t& className : deadClasses) {
+    for (uint64_t ind = 0; ind < rangeMap[className].size(); ind++) {
+      cloudMap.erase(vtbl_t(className, ind));
+      ancestorMap.erase(vtbl_t(className, ind));
     }
-    op += numOperands;
 
-    if (classes.count(info.className) == 0) {
-      classes.insert(info.className);
-      infoVec.push_back(info);
-    }
-  } while (op < md->getNumOperands());
+    roots.erase(className);
+    parentMap.erase(className);
+    subObjNameMap.erase(className);
+    addrPtMap.erase(className);
+    rangeMap.erase(className);
+    oldVTables.erase(className);
+    undefinedVTables.erase(className);
+  }
 
-  return infoVec;
+  sd_print("Pruned %lu unreferenced classes, %lu clouds left\n",
+           deadClasses.size(), roots.size());
 }
 
-int64_t SDBuildCHA::getCloudSize(const SDBuildCHA::vtbl_name_t& vtbl) {
-  vtbl_t v(vtbl, 0);
-  return cloudSizeMap[v];
+int64_t SDBuildCHA::getCloudSize(const SDBuildCHA::vtbl_name_t& vtbl) const {
+  auto itr = cloudSizeMap.find(vtbl_t(vtbl, 0));
+  return itr != cloudSizeMap.end() ? itr->second : 0;
 }
 
 uint32_t SDBuildCHA::calculateChildrenCounts(const SDBuildCHA::vtbl_t& root){
@@ -1,5 +1,6 @@
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/IPO/SafeDispatch.h"
+#include "llvm/Transforms/IPO/SafeDispatchPasses.h"
 #include "llvm/Transforms/IPO.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/IR/InstIterator.h"
@@ -30,7 +31,7 @@ using namespace llvm;
 
 #define WORD_WIDTH 8
 
-#define NEW_VTABLE_NAME(vtbl) ("_SD" + vtbl)
+#define NEW_VTABLE_NAME(vtbl) (SD_NEW_VTABLE_PREFIX + vtbl)
 
 static Constant*
 sd_isRTTI(Constant* vtblElement) {
@@ -145,6 +146,11 @@ ModulePass* llvm::createSDFixPass() {
   return new SDFix();
 }
 
+PreservedAnalyses SDFixPass::run(Module &M) {
+  SDFix fix;
+  return fix.runOnModule(M) ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
+
 namespace {
   struct DestructorInfo {
     DestructorInfo() :
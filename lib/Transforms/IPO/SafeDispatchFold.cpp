@@ -0,0 +1,155 @@
+#include "llvm/Transforms/IPO.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Transforms/Utils/Local.h"
+
+#include "llvm/Transforms/IPO/SafeDispatch.h"
+#include "llvm/Transforms/IPO/SafeDispatchLayoutBuilder.h"
+#include "llvm/Transforms/IPO/SafeDispatchLog.h"
+#include "llvm/Transforms/IPO/SafeDispatchTools.h"
+
+#include <map>
+#include <vector>
+
+using namespace llvm;
+
+#define WORD_WIDTH 8
+
+namespace {
+  /**
+   * Module pass folding the vbase offsets read from vtables whose identity is
+   * known at link time (see sd_foldVbaseOffsets)
+   */
+  struct SDFoldVbaseOffsets : public ModulePass {
+    static char ID; // Pass identification, replacement for typeid
+
+    SDFoldVbaseOffsets() : ModulePass(ID) {
+      initializeSDFoldVbaseOffsetsPass(*PassRegistry::getPassRegistry());
+    }
+
+    bool runOnModule(Module &M) override {
+      return sd_foldVbaseOffsets(M, getAnalysis<SDBuildCHA>()) > 0;
+    }
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.addRequired<SDBuildCHA>();
+      AU.addPreserved<SDLayoutBuilder>();
+      AU.addPreserved<SDBuildCHA>();
+    }
+  };
+}
+
+char SDFoldVbaseOffsets::ID = 0;
+
+INITIALIZE_PASS_BEGIN(SDFoldVbaseOffsets, "sdfoldvbase", "Fold SafeDispatch vbase offsets of known vtables", false, false)
+INITIALIZE_PASS_DEPENDENCY(SDBuildCHA)
+INITIALIZE_PASS_END(SDFoldVbaseOffsets, "sdfoldvbase", "Fold SafeDispatch vbase offsets of known vtables", false, false)
+
+ModulePass* llvm::createSDFoldVbaseOffsetsPass() {
+  return new SDFoldVbaseOffsets();
+}
+
+/**
+ * Integer stored in a vtable entry, false if the entry is a pointer
+ */
+static bool sd_getVtblInt(Constant* c, int64_t& value) {
+  if (c->isNullValue()) {
+    value = 0;
+    return true;
+  }
+
+  ConstantExpr* ce = dyn_cast<ConstantExpr>(c);
+  if (!ce || ce->getOpcode() != Instruction::IntToPtr)
+    return false;
+
+  ConstantInt* ci = dyn_cast<ConstantInt>(ce->getOperand(0));
+  if (!ci)
+    return false;
+
+  value = ci->getSExtValue();
+  return true;
+}
+
+/**
+ * Clang reads the offset of a virtual base at
+ *
+ *   vptr + sd_get_vtbl_index(index, class) * WORD_WIDTH
+ *
+ * When the class has no derived classes, its own vtable is the only one that
+ * passes the checks, so the offset is taken from the old vtable.
+ *
+ * Reads through a vptr that is a constant address point are left alone: this
+ * runs before the LTO optimizations, so such vptrs are rare here, and once
+ * SDUpdateIndices made the index constant, GVN and instcombine fold those
+ * loads from the new (constant) vtables anyway.
+ */
+unsigned llvm::sd_foldVbaseOffsets(Module& M, SDBuildCHA& cha) {
+  typedef SDBuildCHA::vtbl_t vtbl_t;
+
+  Function* sd_vtbl_indexF =
+      M.getFunction(Intrinsic::getName(Intrinsic::sd_get_vtbl_index));
+  if (!sd_vtbl_indexF)
+    return 0;
+
+  std::vector<std::pair<LoadInst*, int64_t>> folds;
+
+  for (User* U : sd_vtbl_indexF->users()) {
+    CallInst* CI = cast<CallInst>(U);
+    ConstantInt* index = dyn_cast<ConstantInt>(CI->getArgOperand(0));
+    assert(index);
+    MDNode* mdNode = cast<MDNode>(
+      cast<MetadataAsValue>(CI->getArgOperand(1))->getMetadata());
+
+    vtbl_t cls(sd_getClassNameFromMD(mdNode,0), 0);
+    if (!cha.knowsAbout(cls) || !cha.isDefined(cls) ||
+        cha.getCloudSize(cls.first) != 1 || !cha.hasOldVTable(cls.first))
+      continue;
+
+    ConstantArray* vtable = cha.getOldVTable(cls.first);
+    int64_t entry = (int64_t) cha.addrPt(cls) + index->getSExtValue();
+    int64_t value;
+    if (entry < 0 || entry >= (int64_t) vtable->getNumOperands() ||
+        !sd_getVtblInt(vtable->getOperand(entry), value))
+      continue;
+
+    for (User* mulU : CI->users()) {
+      BinaryOperator* mul = dyn_cast<BinaryOperator>(mulU);
+      ConstantInt* width = mul && mul->getOpcode() == Instruction::Mul ?
+        dyn_cast<ConstantInt>(mul->getOperand(1)) : NULL;
+      if (!width || width->getSExtValue() != WORD_WIDTH)
+        continue;
+
+      for (User* gepU : mul->users()) {
+        GetElementPtrInst* gep = dyn_cast<GetElementPtrInst>(gepU);
+        if (!gep || gep->getNumIndices() != 1 || gep->getOperand(1) != mul)
+          continue;
+
+        for (User* castU : gep->users()) {
+          BitCastInst* bc = dyn_cast<BitCastInst>(castU);
+          if (!bc)
+            continue;
+
+          for (User* loadU : bc->users()) {
+            LoadInst* load = dyn_cast<LoadInst>(loadU);
+            if (load && !load->isVolatile() && load->getType()->isIntegerTy())
+              folds.push_back(std::make_pair(load, value));
+          }
+        }
+      }
+    }
+  }
+
+  for (auto& fold : folds) {
+    LoadInst* load = fold.first;
+    Value* ptr = load->getPointerOperand();
+    load->replaceAllUsesWith(ConstantInt::get(load->getType(), fold.second, true));
+    load->eraseFromParent();
+    RecursivelyDeleteTriviallyDeadInstructions(ptr);
+  }
+
+  sd_print("SDFoldVbaseOffsets: folded %lu vbase offsets\n", folds.size());
+  return folds.size();
+}
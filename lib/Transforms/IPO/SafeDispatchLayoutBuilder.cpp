@@ -1,6 +1,11 @@
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Transforms/IPO.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Hashing.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Metadata.h"
 #include "llvm/IR/Constant.h"
@@ -17,6 +22,7 @@
 
 #include "llvm/Transforms/IPO/SafeDispatchLayoutBuilder.h"
 #include "llvm/Transforms/IPO/SafeDispatchLog.h"
+#include "llvm/Transforms/IPO/SafeDispatchProfile.h"
 #include "llvm/Transforms/IPO/SafeDispatchTools.h"
 
 #include "llvm/Transforms/Utils/ValueMapper.h"
@@ -31,10 +37,41 @@
 using namespace llvm;
 
 #define WORD_WIDTH 8
-#define NEW_VTABLE_NAME(vtbl) ("_SD" + vtbl)
+#define NEW_VTABLE_NAME(vtbl) (SD_NEW_VTABLE_PREFIX + vtbl)
 #define NEW_VTHUNK_NAME(fun,parent) ("_SVT" + parent + fun->getName().str())
 #define GEP_OPCODE      29
 
+static cl::opt<std::string>
+SDVTableSection("sd-vtbl-section", cl::init(""), cl::Hidden,
+  cl::desc("Place the interleaved vtables in the given section (e.g. "
+           ".data.rel.ro.sdvtbl), ordered by dispatch hotness"));
+
+static cl::opt<std::string>
+SDVTableProfile("sd-vtbl-profile", cl::init(""), cl::Hidden,
+  cl::desc("Dispatch profile used to order the interleaved vtables (see "
+           "SafeDispatchProfile.h)"));
+
+static cl::opt<unsigned>
+SDVTableHotAlign("sd-vtbl-hot-align", cl::init(0), cl::Hidden,
+  cl::desc("Align every hot interleaved vtable to the given power of 2 "
+           "number of bytes (e.g. 2097152 for huge pages)"));
+
+static cl::opt<unsigned>
+SDInterleaveBlock("sd-ivtbl-block", cl::init(1), cl::Hidden,
+  cl::desc("Keep this many consecutive slots of a class together when "
+           "interleaving (power of 2, 0 picks one per cloud)"));
+
+static cl::opt<unsigned>
+SDInterleaveBlockMaxPad("sd-ivtbl-block-max-pad", cl::init(25), cl::Hidden,
+  cl::desc("Padding (in percent of the cloud size) a cloud may grow by when "
+           "-sd-ivtbl-block=0 picks its block size"));
+
+static cl::list<std::string>
+SDInterleaveBlockFor("sd-ivtbl-block-for", cl::CommaSeparated, cl::Hidden,
+  cl::value_desc("root vtable=block"),
+  cl::desc("Override -sd-ivtbl-block for the cloud of the given root vtable "
+           "(e.g. _ZTV1A=4)"));
+
 char SDLayoutBuilder::ID = 0;
 
 INITIALIZE_PASS_BEGIN(SDLayoutBuilder, "sdovt", "Oredered VTable Layout Builder for SafeDispatch", false, false)
@@ -183,6 +220,95 @@ Function* SDLayoutBuilder::getVthunkFunction(Constant* vtblElement) {
   return NULL;
 }
 
+/**
+ * Structural hash of a cloned vthunk, in the spirit of FunctionComparator:
+ * the signature followed by the opcode, type and operands of every
+ * instruction. Constants (callees included) are uniqued and hashed by
+ * address, local values only contribute their kind. Clones with the same
+ * hash still have to be compared with sd_isSameThunk.
+ */
+static uint64_t sd_hashThunk(Function* F) {
+  hash_code H = hash_combine(F->getFunctionType(), F->getCallingConv(),
+                             F->getLinkage(), F->size());
+
+  for (BasicBlock &BB : *F) {
+    H = hash_combine(H, BB.size());
+    for (Instruction &I : BB) {
+      H = hash_combine(H, I.getOpcode(), I.getType(), I.getNumOperands());
+      for (Value *Op : I.operands()) {
+        if (isa<Constant>(Op) || isa<MetadataAsValue>(Op))
+          H = hash_combine(H, Op);
+        else
+          H = hash_combine(H, Op->getValueID());
+      }
+    }
+  }
+
+  return H;
+}
+
+/**
+ * True if both vthunks have the same signature and attributes and their
+ * bodies match instruction by instruction, up to a renaming of the
+ * arguments, blocks and instructions.
+ */
+static bool sd_isSameThunk(Function* L, Function* R) {
+  if (L->getFunctionType() != R->getFunctionType() ||
+      L->getCallingConv() != R->getCallingConv() ||
+      L->getLinkage() != R->getLinkage() ||
+      L->getAttributes() != R->getAttributes() ||
+      L->size() != R->size())
+    return false;
+
+  // pair the local values first, operands may refer to later blocks
+  DenseMap<const Value*, const Value*> locals;
+  for (auto LA = L->arg_begin(), RA = R->arg_begin(); LA != L->arg_end(); ++LA, ++RA)
+    locals[&*LA] = &*RA;
+
+  for (auto LB = L->begin(), RB = R->begin(); LB != L->end(); ++LB, ++RB) {
+    if (LB->size() != RB->size())
+      return false;
+    locals[&*LB] = &*RB;
+    for (auto LI = LB->begin(), RI = RB->begin(); LI != LB->end(); ++LI, ++RI)
+      locals[&*LI] = &*RI;
+  }
+
+  for (auto LB = L->begin(), RB = R->begin(); LB != L->end(); ++LB, ++RB) {
+    for (auto LI = LB->begin(), RI = RB->begin(); LI != LB->end(); ++LI, ++RI) {
+      // opcode, types and the extra state (predicates, alignment, call
+      // attributes, ...) of the instruction
+      if (!LI->isSameOperationAs(&*RI))
+        return false;
+
+      for (unsigned op = 0; op < LI->getNumOperands(); op++) {
+        const Value* LOp = LI->getOperand(op);
+        const Value* ROp = RI->getOperand(op);
+        auto localItr = locals.find(LOp);
+        if (localItr != locals.end() ? localItr->second != ROp : LOp != ROp)
+          return false;
+      }
+
+      // phi nodes keep their incoming blocks outside the operand list
+      if (const PHINode* LPN = dyn_cast<PHINode>(&*LI)) {
+        const PHINode* RPN = cast<PHINode>(&*RI);
+        for (unsigned in = 0; in < LPN->getNumIncomingValues(); in++)
+          if (locals.lookup(LPN->getIncomingBlock(in)) != RPN->getIncomingBlock(in))
+            return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+Function* SDLayoutBuilder::getNewThunkFunction(Module& M, const std::string& newThunkName) {
+  auto itr = mergedThunks.find(newThunkName);
+  if (itr != mergedThunks.end())
+    return itr->second;
+
+  return M.getFunction(newThunkName);
+}
+
 void SDLayoutBuilder::createThunkFunctions(Module& M, const vtbl_name_t& rootName) {
   // for all defined vtables
   vtbl_t root(rootName,0);
@@ -208,6 +334,14 @@ void SDLayoutBuilder::createThunkFunctions(Module& M, const vtbl_name_t& rootNam
       if (! thunkF)
         continue;
 
+      // class summaries keep the bodies of the virtual thunks, so this is a
+      // thunk defined outside of the linked modules. Its vcall offset can't
+      // be rewritten, the original thunk is used as is.
+      if (thunkF->isDeclaration()) {
+        sd_print("vthunk %s is not defined, keeping it\n", thunkF->getName().data());
+        continue;
+      }
+
       // find the index of the sub-vtable inside the whole
       unsigned order = cha->getVTableOrder(vtbl, vtblInd);
 
@@ -215,7 +349,7 @@ void SDLayoutBuilder::createThunkFunctions(Module& M, const vtbl_name_t& rootNam
       const std::string& parentClass = cha->getLayoutClassName(vtbl, order);
       std::string newThunkName(NEW_VTHUNK_NAME(thunkF, parentClass));
 
-      if (M.getFunction(newThunkName)) {
+      if (getNewThunkFunction(M, newThunkName)) {
         // we already created such function, will use that later
         continue;
       }
@@ -227,16 +361,15 @@ void SDLayoutBuilder::createThunkFunctions(Module& M, const vtbl_name_t& rootNam
       M.getFunctionList().push_back(newThunkF);
 
       CallInst* CI = NULL;
-
-      if(sd_vcall_indexF == NULL)
-        continue;
+      std::vector<CallInst*> vcallIndexCalls;
 
       // go over its instructions and replace the one with the metadata
       for(Function:: iterator bb_itr = newThunkF->begin(); bb_itr != newThunkF->end(); bb_itr++) {
         for(BasicBlock:: iterator i_itr = bb_itr->begin(); i_itr != bb_itr->end(); i_itr++) {
           Instruction* inst = i_itr;
 
-          if ((CI = dyn_cast<CallInst>(inst)) && CI->getCalledFunction() == sd_vcall_indexF) {
+          if (sd_vcall_indexF && (CI = dyn_cast<CallInst>(inst)) &&
+              CI->getCalledFunction() == sd_vcall_indexF) {
             // get the arguments
             llvm::ConstantInt* oldVal = dyn_cast<ConstantInt>(CI->getArgOperand(0));
             assert(oldVal);
@@ -251,14 +384,122 @@ void SDLayoutBuilder::createThunkFunctions(Module& M, const vtbl_name_t& rootNam
             Value* newValue = ConstantInt::get(IntegerType::getInt64Ty(C), newIndex * WORD_WIDTH);
 
             CI->replaceAllUsesWith(newValue);
-
+            vcallIndexCalls.push_back(CI);
           }
         }
       }
 
-      // this function should have a metadata
+      for (CallInst* call : vcallIndexCalls)
+        call->eraseFromParent();
+
+      // merge the clone with an identical one if we already have it
+      std::vector<Function*>& sameHash = thunkBodies[sd_hashThunk(newThunkF)];
+      auto sameItr = std::find_if(sameHash.begin(), sameHash.end(),
+                                  [newThunkF](Function* F) {
+                                    return sd_isSameThunk(F, newThunkF);
+                                  });
+      if (sameItr != sameHash.end()) {
+        mergedThunks[newThunkName] = *sameItr;
+        newThunkF->eraseFromParent();
+        numMergedThunks++;
+      } else {
+        sameHash.push_back(newThunkF);
+      }
+    }
+  }
+}
+
+void SDLayoutBuilder::calculateCloudHotness(Module& M) {
+  if (!SDVTableProfile.empty()) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> bufOrErr =
+        MemoryBuffer::getFile(SDVTableProfile);
+    if (std::error_code EC = bufOrErr.getError())
+      report_fatal_error("Could not read SD dispatch profile " +
+                         SDVTableProfile + ": " + EC.message());
+
+    SDDispatchProfile profile;
+    std::string err;
+    if (!profile.read(**bufOrErr, err))
+      report_fatal_error("Could not parse SD dispatch profile " +
+                         SDVTableProfile + ": " + err);
+
+    for (auto& itr : profile.vtables) {
+      vtbl_t vtbl(itr.first, 0);
+      if (cha->knowsAbout(vtbl) && cha->hasAncestor(vtbl))
+        cloudHotness[cha->getAncestor(vtbl)] += itr.second;
+    }
+
+    // the observed sub-vtable decides the cloud, the root may have changed
+    for (const SDDispatchProfile::site_t& site : profile.sites) {
+      vtbl_t vtbl(site.vtable, site.order);
+      if (cha->knowsAbout(vtbl) && cha->hasAncestor(vtbl))
+        cloudHotness[cha->getAncestor(vtbl)] += site.count;
+    }
+    return;
+  }
+
+  // without a profile, every check or index site counts as one dispatch
+  Intrinsic::ID intrinsics[] = {Intrinsic::sd_check_vtbl,
+                                Intrinsic::sd_get_checked_vptr,
+                                Intrinsic::sd_get_vtbl_index};
+
+  for (Intrinsic::ID id : intrinsics) {
+    Function *intrF = M.getFunction(Intrinsic::getName(id));
+    if (!intrF)
+      continue;
+
+    for (const Use &U : intrF->uses()) {
+      CallInst* CI = cast<CallInst>(U.getUser());
+      // all of them carry the class tuple as their second argument
+      MetadataAsValue* mdVal = cast<MetadataAsValue>(CI->getArgOperand(1));
+      MDNode* mdNode = cast<MDNode>(mdVal->getMetadata());
+
+      vtbl_t vtbl(sd_getClassNameFromMD(mdNode, 0), 0);
+      if (!cha->knowsAbout(vtbl) || !cha->hasAncestor(vtbl))
+        continue;
+
+      cloudHotness[cha->getAncestor(vtbl)]++;
+    }
+  }
+}
+
+void SDLayoutBuilder::placeNewVTables(Module& M) {
+  if (!isPowerOf2_32(SDVTableHotAlign) && SDVTableHotAlign != 0)
+    report_fatal_error("-sd-vtbl-hot-align=" + Twine(SDVTableHotAlign) +
+                       " is not a power of 2");
+
+  std::vector<std::pair<uint64_t, vtbl_name_t>> order;
+  for (auto itr = cha->roots_begin(); itr != cha->roots_end(); itr++) {
+    order.push_back(std::make_pair(cloudHotness[*itr], *itr));
+  }
+
+  // hottest first, ties keep the (deterministic) root order
+  std::stable_sort(order.begin(), order.end(),
+    [](const std::pair<uint64_t, vtbl_name_t>& a,
+       const std::pair<uint64_t, vtbl_name_t>& b) {
+      return a.first > b.first;
+    });
+
+  uint64_t hotVTables = 0;
+  for (unsigned i = 0; i < order.size(); i++) {
+    GlobalVariable* gv = cloudStartMap[NEW_VTABLE_NAME(order[i].second)];
+    assert(gv);
+
+    gv->setSection(SDVTableSection);
+
+    // globals are emitted in module order, so re-append them in hotness order
+    gv->removeFromParent();
+    M.getGlobalList().push_back(gv);
+
+    if (order[i].first > 0) {
+      if (SDVTableHotAlign > gv->getAlignment())
+        gv->setAlignment(SDVTableHotAlign);
+      hotVTables++;
     }
   }
+
+  sd_print("Placed %lu interleaved vtables (%lu hot) in %s\n",
+           order.size(), hotVTables, SDVTableSection.c_str());
 }
 
 void SDLayoutBuilder::orderCloud(SDLayoutBuilder::vtbl_name_t& vtbl) {
@@ -335,13 +576,77 @@ void SDLayoutBuilder::interleaveCloud(SDLayoutBuilder::vtbl_name_t& vtbl) {
   // initialize the cloud's interleaving list
   interleavingMap[vtbl] = interleaving_list_t();
 
+  uint64_t block = getInterleaveBlock(vtbl, pre);
+
   // fill both parts
-  fillVtablePart(interleavingMap[vtbl], pre, false);
-  fillVtablePart(positivePart, pre, true);
+  fillVtablePart(interleavingMap[vtbl], pre, false, block);
+  fillVtablePart(positivePart, pre, true, block);
 
   // append positive part to the negative
   interleavingMap[vtbl].insert(interleavingMap[vtbl].end(), positivePart.begin(), positivePart.end());
-  alignmentMap[vtbl] = WORD_WIDTH;
+  alignmentMap[vtbl] = block * WORD_WIDTH;
+
+  if (block > 1)
+    sd_print("Interleaved %s with blocks of %lu\n", vtbl.c_str(), block);
+}
+
+uint64_t SDLayoutBuilder::getInterleaveBlock(const vtbl_name_t& root,
+                                             const order_t& order) {
+  unsigned requested = SDInterleaveBlock;
+  std::string option = "-sd-ivtbl-block=" + utostr(SDInterleaveBlock);
+
+  for (const std::string& entry : SDInterleaveBlockFor) {
+    StringRef name, value;
+    unsigned rootBlock;
+    std::tie(name, value) = StringRef(entry).rsplit('=');
+    if (name.empty() || value.getAsInteger(10, rootBlock))
+      report_fatal_error("-sd-ivtbl-block-for expects <root vtable>=<block>, "
+                         "got '" + entry + "'");
+
+    if (name == root) {
+      requested = rootBlock;
+      option = "-sd-ivtbl-block-for=" + entry;
+    }
+  }
+
+  if (!isPowerOf2_32(requested) && requested != 0)
+    report_fatal_error(option + " is not a power of 2");
+
+  if (requested != 0)
+    return requested;
+
+  // every class takes a whole block in each row it has elements in,
+  // and one in the first positive row in any case
+  uint64_t numVtbls = 0, numElems = 0;
+  std::vector<std::pair<uint64_t, uint64_t>> sizes;
+  for (const vtbl_t& n : order) {
+    if (cha->isUndefined(n.first))
+      continue;
+
+    const range_t &r = cha->getRange(n);
+    uint64_t addrPt = cha->addrPt(n);
+    sizes.push_back(std::make_pair(addrPt - r.first, r.second - addrPt + 1));
+    numElems += r.second - r.first + 1;
+    numVtbls++;
+  }
+
+  // nothing to interleave with
+  if (numVtbls < 2)
+    return 1;
+
+  for (uint64_t block = 8; block > 1; block /= 2) {
+    uint64_t size = 0;
+    for (auto& s : sizes) {
+      uint64_t rows = (s.first + block - 1) / block +
+                      std::max<uint64_t>(1, (s.second + block - 1) / block);
+      size += rows * block;
+    }
+
+    if (size * 100 <= numElems * (100 + SDInterleaveBlockMaxPad))
+      return block;
+  }
+
+  return 1;
 }
 
 void SDLayoutBuilder::calculateNewLayoutInds(SDLayoutBuilder::vtbl_name_t& vtbl){
@@ -383,8 +688,8 @@ void SDLayoutBuilder::createNewVTable(Module& M, SDLayoutBuilder::vtbl_name_t& v
       Constant* c = vtable->getOperand(ivtbl.second);
       Function* thunk = getVthunkFunction(c);
 
-      if (thunk) {
-        Function* newThunk = M.getFunction(
+      if (thunk && !thunk->isDeclaration()) {
+        Function* newThunk = getNewThunkFunction(M,
               NEW_VTHUNK_NAME(thunk, cha->getLayoutClassName(ivtbl.first)));
         assert(newThunk);
 
@@ -482,7 +787,8 @@ void SDLayoutBuilder::createNewVTable(Module& M, SDLayoutBuilder::vtbl_name_t& v
 static bool sd_isLE(int64_t lhs, int64_t rhs) { return lhs <= rhs; }
 static bool sd_isGE(int64_t lhs, int64_t rhs) { return lhs >= rhs; }
 
-void SDLayoutBuilder::fillVtablePart(SDLayoutBuilder::interleaving_list_t& vtblPart, const SDLayoutBuilder::order_t& order, bool positiveOff) {
+void SDLayoutBuilder::fillVtablePart(SDLayoutBuilder::interleaving_list_t& vtblPart, const SDLayoutBuilder::order_t& order, bool positiveOff,
+                                     uint64_t block) {
   std::map<vtbl_t, int64_t> posMap;     // current position
   std::map<vtbl_t, int64_t> lastPosMap; // last possible position
 
@@ -497,18 +803,42 @@ void SDLayoutBuilder::fillVtablePart(SDLayoutBuilder::interleaving_list_t& vtblP
   bool (*check)(int64_t,int64_t) = positiveOff ? sd_isLE : sd_isGE;
   int increment = positiveOff ? 1 : -1;
   int64_t pos;
+  bool firstRow = true;
 
   // while we have an element to insert to the vtable, continue looping
   while(true) {
     // do a preorder traversal and add the remaining elements
     for (const vtbl_t& n : order) {
       pos = posMap[n];
-      if (!cha->isUndefined(n.first) && check(pos, lastPosMap[n])) {
-        current.push_back(interleaving_t(n, pos));
-        posMap[n] += increment;
+      if (cha->isUndefined(n.first))
+        continue;
+
+      if (block == 1) {
+        if (check(pos, lastPosMap[n])) {
+          current.push_back(interleaving_t(n, pos));
+          posMap[n] += increment;
+        }
+        continue;
+      }
+
+      // with blocks, every class is in the first row so that the address
+      // points stay exactly one block apart
+      if (!check(pos, lastPosMap[n]) && !(positiveOff && firstRow))
+        continue;
+
+      // keep the elements of a block in ascending order
+      int64_t first = positiveOff ? pos : pos - (int64_t) block + 1;
+      for (int64_t p = first; p < first + (int64_t) block; p++) {
+        if (check(p, lastPosMap[n]) && check(pos, p))
+          current.push_back(interleaving_t(n, p));
+        else
+          current.push_back(interleaving_t(dummyVtable, 0));
       }
+      posMap[n] += increment * (int64_t) block;
     }
 
+    firstRow = false;
+
     if (current.size() == 0)
       break;
 
@@ -566,6 +896,27 @@ int64_t SDLayoutBuilder::translateVtblInd(SDLayoutBuilder::vtbl_t name, int64_t
   }
 }
 
+bool SDLayoutBuilder::getTranslatedInds(const SDLayoutBuilder::vtbl_t& vtbl,
+                                        int64_t& addrPt,
+                                        std::vector<int64_t>& inds) {
+  // same lookup as translateVtblInd
+  vtbl_t name = vtbl;
+  if (cha->isUndefined(name) && cha->hasFirstDefinedChild(name))
+    name = cha->getFirstDefinedChild(name);
+
+  if (!newLayoutInds.count(name))
+    return false;
+
+  const range_t& subVtableRange = cha->getRange(name);
+  addrPt = cha->addrPt(name) - subVtableRange.first;
+
+  inds.clear();
+  for (int64_t i = 0; i <= (int64_t) (subVtableRange.second - subVtableRange.first); i++)
+    inds.push_back(translateVtblInd(vtbl, i - addrPt, true));
+
+  return true;
+}
+
   /*
 int64_t SDLayoutBuilder::oldIndexToNew(SDLayoutBuilder::vtbl_name_t vtbl, int64_t offset,
                                 bool isRelative = true) {
@@ -606,6 +957,9 @@ void SDLayoutBuilder::clearAnalysisResults() {
   cha->clearAnalysisResults();
   newLayoutInds.clear();
   interleavingMap.clear();
+  thunkBodies.clear();
+  mergedThunks.clear();
+  numMergedThunks = 0;
 
   sd_print("Cleared SDLayoutBuilder analysis results\n");
 }
@@ -757,5 +1111,12 @@ void SDLayoutBuilder::buildNewLayouts(Module &M) {
     createThunkFunctions(M, vtbl); // replace the virtual thunks with the modified ones
     createNewVTable(M, vtbl);      // finally, emit the global variable
   }
+
+  sd_print("Merged %lu identical vthunk clones\n", numMergedThunks);
+
+  if (!SDVTableSection.empty()) {
+    calculateCloudHotness(M);
+    placeNewVTables(M);
+  }
 }
 
@@ -0,0 +1,41 @@
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include "llvm/Transforms/IPO/SafeDispatchProfile.h"
+
+using namespace llvm;
+
+bool SDDispatchProfile::read(const MemoryBuffer& buf, std::string& err) {
+  for (line_iterator line(buf, true, '#'); !line.is_at_eof(); ++line) {
+    SmallVector<StringRef, 8> fields;
+    line->split(fields, " ", -1, false);
+
+    if (fields.size() == 2) {
+      uint64_t count;
+      if (!fields[1].getAsInteger(10, count)) {
+        vtables[fields[0]] += count;
+        continue;
+      }
+    } else if (fields.size() == 8 && fields[0] == "site") {
+      site_t site;
+      if (!fields[2].getAsInteger(10, site.index) &&
+          !fields[6].getAsInteger(10, site.order) &&
+          !fields[7].getAsInteger(10, site.count)) {
+        site.function = fields[1];
+        site.className = fields[3];
+        site.root = fields[4];
+        site.vtable = fields[5];
+        sites.push_back(site);
+        continue;
+      }
+    }
+
+    err = "malformed line " + std::to_string(line.line_number()) + ": " +
+          line->str();
+    return false;
+  }
+
+  return true;
+}
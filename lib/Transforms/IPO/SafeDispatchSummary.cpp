@@ -0,0 +1,723 @@
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/GlobalAlias.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/SafeDispatchMD.h"
+#include "llvm/Pass.h"
+
+#include "llvm/Transforms/IPO/SafeDispatch.h"
+#include "llvm/Transforms/IPO/SafeDispatchLayoutBuilder.h"
+#include "llvm/Transforms/IPO/SafeDispatchLog.h"
+#include "llvm/Transforms/IPO/SafeDispatchSummary.h"
+#include "llvm/Transforms/IPO/SafeDispatchTools.h"
+
+#include <cinttypes>
+#include <vector>
+#include <set>
+#include <map>
+
+using namespace llvm;
+
+#define WORD_WIDTH 8
+#define NEW_VTABLE_NAME(vtbl) (SD_NEW_VTABLE_PREFIX + vtbl)
+
+static cl::opt<std::string>
+SDLayoutFile("sd-layout", cl::init(""), cl::Hidden,
+  cl::desc("Layout file written by -sdexport and read by -sdapply"));
+
+/// ----------------------------------------------------------------------------
+/// Class summaries
+/// ----------------------------------------------------------------------------
+
+/**
+ * Returns the vtables described by the sd.class_info records of the module
+ */
+static std::set<GlobalVariable*> sd_getClassInfoVTables(Module& M) {
+  std::set<GlobalVariable*> vtables;
+
+  // per TU modules might come from an older compiler
+  UpgradeSDClassInfo(M);
+
+  for (NamedMDNode& md : M.getNamedMDList()) {
+    if (!md.getName().startswith(SD_MD_CLASSINFO))
+      continue;
+
+    for (unsigned op = 0; op < md.getNumOperands(); ++op) {
+      if (GlobalVariable* gv = SDClassInfoMD(md.getOperand(op)).getVTable())
+        vtables.insert(gv);
+    }
+  }
+
+  return vtables;
+}
+
+static void sd_collectGlobals(Constant* C, std::set<GlobalValue*>& globals,
+                              std::set<Constant*>& visited) {
+  if (!visited.insert(C).second)
+    return;
+
+  if (GlobalValue* gv = dyn_cast<GlobalValue>(C)) {
+    globals.insert(gv);
+    return;
+  }
+
+  for (Use& op : C->operands())
+    sd_collectGlobals(cast<Constant>(op.get()), globals, visited);
+}
+
+/**
+ * Virtual thunks defined in the module and used by the given vtables. The
+ * layout step clones them with the vcall offsets of the new layout.
+ */
+static std::set<Function*> sd_getVTableThunks(const std::set<GlobalVariable*>& vtables) {
+  std::set<GlobalValue*> globals;
+  std::set<Constant*> visited;
+  for (GlobalVariable* gv : vtables) {
+    if (gv->hasInitializer())
+      sd_collectGlobals(gv->getInitializer(), globals, visited);
+  }
+
+  std::set<Function*> thunks;
+  for (GlobalValue* gv : globals) {
+    Function* F = dyn_cast<Function>(gv);
+    if (F && !F->isDeclaration() &&
+        (F->getName().startswith("_ZTv") || F->getName().startswith("_ZTcv")))
+      thunks.insert(F);
+  }
+  return thunks;
+}
+
+void llvm::sd_promoteVTableLocals(Module& M) {
+  std::set<GlobalVariable*> vtables = sd_getClassInfoVTables(M);
+  std::set<GlobalValue*> globals;
+  std::set<Constant*> visited;
+
+  for (GlobalVariable* gv : vtables) {
+    globals.insert(gv);
+    if (gv->hasInitializer())
+      sd_collectGlobals(gv->getInitializer(), globals, visited);
+  }
+
+  // the thunk clones live in the module of the new vtables
+  for (Function* F : sd_getVTableThunks(vtables)) {
+    for (BasicBlock& BB : *F)
+      for (Instruction& I : BB)
+        for (Use& op : I.operands())
+          if (Constant* C = dyn_cast<Constant>(op.get()))
+            sd_collectGlobals(C, globals, visited);
+  }
+
+  MD5 hash;
+  hash.update(M.getModuleIdentifier());
+  MD5::MD5Result result;
+  hash.final(result);
+  SmallString<32> suffix;
+  MD5::stringifyResult(result, suffix);
+
+  unsigned promoted = 0;
+  for (GlobalValue* gv : globals) {
+    if (!gv->hasLocalLinkage())
+      continue;
+
+    gv->setName(gv->getName() + ".sd." + suffix.str().substr(0, 8));
+    gv->setLinkage(GlobalValue::ExternalLinkage);
+    gv->setVisibility(GlobalValue::HiddenVisibility);
+    promoted++;
+  }
+
+  sd_print("Promoted %u local symbols used by vtables\n", promoted);
+}
+
+void llvm::sd_buildClassSummary(Module& M) {
+  sd_promoteVTableLocals(M);
+  StripDebugInfo(M);
+
+  std::set<GlobalVariable*> vtables = sd_getClassInfoVTables(M);
+  std::set<Function*> thunks = sd_getVTableThunks(vtables);
+
+  // aliases can't point to declarations, replace them with plain declarations
+  std::vector<GlobalAlias*> aliases;
+  for (GlobalAlias& GA : M.aliases())
+    aliases.push_back(&GA);
+
+  for (GlobalAlias* GA : aliases) {
+    Type* ty = GA->getType()->getElementType();
+    GlobalValue* decl;
+
+    if (FunctionType* FTy = dyn_cast<FunctionType>(ty))
+      decl = Function::Create(FTy, GlobalValue::ExternalLinkage, "", &M);
+    else
+      decl = new GlobalVariable(M, ty, false, GlobalValue::ExternalLinkage,
+                                nullptr, "");
+
+    decl->takeName(GA);
+    decl->setVisibility(GA->getVisibility());
+    GA->replaceAllUsesWith(ConstantExpr::getBitCast(decl, GA->getType()));
+    GA->eraseFromParent();
+  }
+
+  for (Function& F : M) {
+    if (!F.isDeclaration() && !thunks.count(&F))
+      F.deleteBody();
+    F.setComdat(nullptr);
+  }
+
+  for (GlobalVariable& gv : M.globals()) {
+    if (vtables.count(&gv) || !gv.hasInitializer())
+      continue;
+
+    gv.setInitializer(nullptr);
+    gv.setLinkage(GlobalValue::ExternalLinkage);
+    gv.setComdat(nullptr);
+  }
+
+  // drop the declarations nothing refers to anymore
+  for (auto itr = M.begin(); itr != M.end(); ) {
+    Function* F = itr++;
+    if (F->use_empty())
+      F->eraseFromParent();
+  }
+
+  for (auto itr = M.global_begin(); itr != M.global_end(); ) {
+    GlobalVariable* gv = itr++;
+    if (gv->isDeclaration() && gv->use_empty())
+      gv->eraseFromParent();
+  }
+
+  std::vector<NamedMDNode*> namedMDs;
+  for (NamedMDNode& md : M.getNamedMDList()) {
+    if (!md.getName().startswith(SD_MD_CLASSINFO) &&
+        &md != M.getModuleFlagsMetadata())
+      namedMDs.push_back(&md);
+  }
+
+  for (NamedMDNode* md : namedMDs)
+    md->eraseFromParent();
+
+  sd_print("Class summary has %" PRIu64 " vtables and %" PRIu64 " thunks\n",
+           (uint64_t) vtables.size(), (uint64_t) thunks.size());
+}
+
+/// ----------------------------------------------------------------------------
+/// Layout file
+/// ----------------------------------------------------------------------------
+
+int64_t SDLayoutSummary::getSubVTableIndex(const std::string& derived,
+                                           const std::string& base) const {
+  int64_t res = -1;
+  for (auto itr = vtbls.lower_bound(vtbl_t(derived, 0));
+       itr != vtbls.end() && itr->first.first == derived; itr++) {
+    if (itr->second.layoutClass == base) {
+      assert(res == -1 && "There should be a unique path for each upcast.");
+      res = itr->first.second;
+    }
+  }
+  return res;
+}
+
+int64_t SDLayoutSummary::translateVtblInd(const vtbl_t& vtbl, int64_t offset) const {
+  auto itr = vtbls.find(vtbl);
+  if (itr == vtbls.end() || itr->second.inds.empty())
+    return offset;
+
+  const vtbl_info_t& info = itr->second;
+  int64_t fullIndex = info.indsAddrPt + offset;
+  assert(fullIndex >= 0 && fullIndex < (int64_t) info.inds.size());
+  return info.inds[fullIndex];
+}
+
+static StringRef sd_nameOrDash(const std::string& name) {
+  return name.empty() ? "-" : name;
+}
+
+void SDLayoutSummary::write(raw_ostream& out) const {
+  out << "# SafeDispatch layout\n";
+
+  for (auto& itr : clouds) {
+    out << "cloud " << itr.first << " " << itr.second.alignment << " "
+        << itr.second.size << "\n";
+  }
+
+  for (auto& itr : vtbls) {
+    const vtbl_info_t& info = itr.second;
+    out << "vtbl " << itr.first.first << " " << itr.first.second << " "
+        << info.defined << " " << info.addrPt << " "
+        << sd_nameOrDash(info.root) << " " << info.start << " "
+        << info.width << " " << sd_nameOrDash(info.layoutClass) << "\n";
+  }
+
+  for (auto& itr : vtbls) {
+    const vtbl_info_t& info = itr.second;
+    if (info.inds.empty())
+      continue;
+
+    out << "inds " << itr.first.first << " " << itr.first.second << " "
+        << info.indsAddrPt;
+    for (int64_t ind : info.inds)
+      out << " " << ind;
+    out << "\n";
+  }
+}
+
+bool SDLayoutSummary::read(const MemoryBuffer& buf, std::string& err) {
+  for (line_iterator line(buf, true, '#'); !line.is_at_eof(); ++line) {
+    SmallVector<StringRef, 16> fields;
+    line->split(fields, " ", -1, false);
+
+    auto name = [](StringRef field) {
+      return field == "-" ? std::string() : field.str();
+    };
+
+    if (fields.size() == 4 && fields[0] == "cloud") {
+      cloud_t& cloud = clouds[fields[1]];
+      if (!fields[2].getAsInteger(10, cloud.alignment) &&
+          !fields[3].getAsInteger(10, cloud.size))
+        continue;
+    } else if (fields.size() == 9 && fields[0] == "vtbl") {
+      uint64_t order, defined;
+      vtbl_info_t info;
+      if (!fields[2].getAsInteger(10, order) &&
+          !fields[3].getAsInteger(10, defined) &&
+          !fields[4].getAsInteger(10, info.addrPt) &&
+          !fields[6].getAsInteger(10, info.start) &&
+          !fields[7].getAsInteger(10, info.width)) {
+        info.defined = defined;
+        info.root = name(fields[5]);
+        info.layoutClass = name(fields[8]);
+        info.indsAddrPt = 0;
+        vtbls[vtbl_t(fields[1], order)] = info;
+        continue;
+      }
+    } else if (fields.size() >= 5 && fields[0] == "inds") {
+      // follows the vtbl line of the same sub-vtable
+      uint64_t order;
+      int64_t addrPt;
+      if (!fields[2].getAsInteger(10, order) &&
+          !fields[3].getAsInteger(10, addrPt)) {
+        auto itr = vtbls.find(vtbl_t(fields[1], order));
+        std::vector<int64_t> inds(fields.size() - 4);
+        bool valid = itr != vtbls.end() && addrPt >= 0 &&
+                     addrPt < (int64_t) inds.size();
+        for (unsigned i = 0; valid && i < inds.size(); i++)
+          valid = !fields[4 + i].getAsInteger(10, inds[i]);
+
+        if (valid) {
+          itr->second.indsAddrPt = addrPt;
+          itr->second.inds.swap(inds);
+          continue;
+        }
+      }
+    }
+
+    err = "malformed line " + std::to_string(line.line_number()) + ": " +
+          line->str();
+    return false;
+  }
+
+  return true;
+}
+
+static SDLayoutSummary sd_readLayout() {
+  if (SDLayoutFile.empty())
+    report_fatal_error("SafeDispatch layout file is not given (-sd-layout)");
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> bufOrErr =
+      MemoryBuffer::getFile(SDLayoutFile);
+  if (std::error_code EC = bufOrErr.getError())
+    report_fatal_error("Could not read SD layout " + SDLayoutFile + ": " +
+                       EC.message());
+
+  SDLayoutSummary layout;
+  std::string err;
+  if (!layout.read(**bufOrErr, err))
+    report_fatal_error("Could not parse SD layout " + SDLayoutFile + ": " + err);
+
+  sd_print("Read layout of %" PRIu64 " clouds and %" PRIu64 " vtables from %s\n",
+           (uint64_t) layout.clouds.size(), (uint64_t) layout.vtbls.size(),
+           SDLayoutFile.c_str());
+  return layout;
+}
+
+const SDLayoutSummary& llvm::sd_getLayout() {
+  // read on first use, the modules of the process only look the layout up
+  static const SDLayoutSummary layout = sd_readLayout();
+  return layout;
+}
+
+/// ----------------------------------------------------------------------------
+/// Passes
+/// ----------------------------------------------------------------------------
+
+namespace {
+  /**
+   * Runs after SDLayoutBuilder on the linked class summaries. Writes the
+   * layout file and leaves only the new vtables in the module.
+   */
+  struct SDExportLayout : public ModulePass {
+    static char ID; // Pass identification, replacement for typeid
+
+    SDExportLayout() : ModulePass(ID) {
+      initializeSDExportLayoutPass(*PassRegistry::getPassRegistry());
+    }
+
+    bool runOnModule(Module &M) override;
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.addRequired<SDLayoutBuilder>();
+      AU.addRequired<SDBuildCHA>();
+    }
+  };
+
+  /**
+   * Rewrites a single module against the layout file: address points of
+   * the old vtables, the check and the index intrinsics. The range checks
+   * are left to SDSubstModule3 as in the LTO pipeline.
+   */
+  struct SDApplyLayout : public ModulePass {
+    static char ID; // Pass identification, replacement for typeid
+
+    SDApplyLayout() : ModulePass(ID) {
+      initializeSDApplyLayoutPass(*PassRegistry::getPassRegistry());
+    }
+
+    bool runOnModule(Module &M) override;
+
+  private:
+    typedef SDLayoutSummary::vtbl_t vtbl_t;
+
+    const SDLayoutSummary* layout = nullptr;
+
+    GlobalVariable* getNewVTable(Module& M, const std::string& root);
+    bool replaceAddressPoints(Module& M);
+    Constant* getCheckRange(Module& M, const std::string& className,
+                            const std::string& preciseClassName,
+                            int64_t& width, int64_t& alignment);
+    bool handleSDCheckVtbl(Module& M);
+    bool handleSDGetCheckedVptr(Module& M);
+    bool handleSDIndices(Module& M);
+  };
+}
+
+char SDExportLayout::ID = 0;
+char SDApplyLayout::ID = 0;
+
+INITIALIZE_PASS_BEGIN(SDExportLayout, "sdexport", "Export the SafeDispatch layout of the class summaries", false, false)
+INITIALIZE_PASS_DEPENDENCY(SDLayoutBuilder)
+INITIALIZE_PASS_DEPENDENCY(SDBuildCHA)
+INITIALIZE_PASS_END(SDExportLayout, "sdexport", "Export the SafeDispatch layout of the class summaries", false, false)
+
+INITIALIZE_PASS(SDApplyLayout, "sdapply", "Apply an exported SafeDispatch layout to a module", false, false)
+
+ModulePass* llvm::createSDExportLayoutPass() {
+  return new SDExportLayout();
+}
+
+ModulePass* llvm::createSDApplyLayoutPass() {
+  return new SDApplyLayout();
+}
+
+bool SDExportLayout::runOnModule(Module &M) {
+  SDLayoutBuilder* layoutBuilder = &getAnalysis<SDLayoutBuilder>();
+  SDBuildCHA* cha = &getAnalysis<SDBuildCHA>();
+  SDLayoutSummary layout;
+  typedef SDBuildCHA::vtbl_t vtbl_t;
+
+  for (auto itr = cha->roots_begin(); itr != cha->roots_end(); itr++) {
+    SDLayoutSummary::cloud_t& cloud = layout.clouds[*itr];
+    cloud.alignment = layoutBuilder->alignmentMap[*itr];
+    cloud.size = layoutBuilder->interleavingMap[*itr].size();
+  }
+
+  // index of the address point of a defined vtable inside its new vtable
+  auto newAddrPt = [&](const vtbl_t& v) -> int64_t {
+    uint64_t addrPt = cha->addrPt(v) - cha->getRange(v).first;
+    return layoutBuilder->newLayoutInds[v].at(addrPt);
+  };
+
+  for (auto itr = cha->cloudMap_begin(); itr != cha->cloudMap_end(); itr++) {
+    const vtbl_t& v = itr->first;
+    SDLayoutSummary::vtbl_info_t& info = layout.vtbls[v];
+
+    info.defined = cha->isDefined(v);
+    info.addrPt = cha->getNumAddrPts(v.first) > v.second ? cha->addrPt(v) : 0;
+    info.root = cha->hasAncestor(v) ? cha->getAncestor(v) : "";
+    info.width = cha->getCloudSize(v.first);
+    info.layoutClass = cha->hasLayoutClassName(v) ? cha->getLayoutClassName(v) : "";
+
+    // same choice as SDUpdateIndices::handleSDCheckVtbl
+    if (cha->isDefined(v))
+      info.start = newAddrPt(v);
+    else if (cha->hasFirstDefinedChild(v))
+      info.start = newAddrPt(cha->getFirstDefinedChild(v));
+    else
+      info.start = -1;
+
+    // the modules translate their indices with these instead of the layout
+    // builder, so both builds agree whatever the layout does
+    info.indsAddrPt = 0;
+    layoutBuilder->getTranslatedInds(v, info.indsAddrPt, info.inds);
+  }
+
+  std::error_code EC;
+  raw_fd_ostream out(SDLayoutFile, EC, sys::fs::F_Text);
+  if (EC)
+    report_fatal_error("Could not write SD layout " + SDLayoutFile + ": " +
+                       EC.message());
+  layout.write(out);
+
+  // the new vtables are referenced from the other modules now
+  for (auto& itr : layoutBuilder->cloudStartMap) {
+    itr.second->setLinkage(GlobalValue::ExternalLinkage);
+    itr.second->setVisibility(GlobalValue::HiddenVisibility);
+  }
+
+  layoutBuilder->removeOldLayouts(M);
+  layoutBuilder->clearAnalysisResults();
+
+  sd_print("Exported layout of %" PRIu64 " clouds and %" PRIu64 " vtables to %s\n",
+           (uint64_t) layout.clouds.size(), (uint64_t) layout.vtbls.size(),
+           SDLayoutFile.c_str());
+  return true;
+}
+
+GlobalVariable* SDApplyLayout::getNewVTable(Module& M, const std::string& root) {
+  std::string name = NEW_VTABLE_NAME(root);
+  if (GlobalVariable* gv = M.getGlobalVariable(name))
+    return gv;
+
+  assert(layout->clouds.count(root));
+  const SDLayoutSummary::cloud_t& cloud = layout->clouds.find(root)->second;
+
+  ArrayType* arrType = ArrayType::get(Type::getInt8PtrTy(M.getContext()), cloud.size);
+  GlobalVariable* gv = new GlobalVariable(M, arrType, true,
+                                          GlobalValue::ExternalLinkage,
+                                          nullptr, name);
+  gv->setVisibility(GlobalValue::HiddenVisibility);
+  gv->setAlignment(cloud.alignment);
+  return gv;
+}
+
+bool SDApplyLayout::replaceAddressPoints(Module& M) {
+  LLVMContext& C = M.getContext();
+  Constant* zero = ConstantInt::get(Type::getInt64Ty(C), 0);
+  std::vector<GlobalVariable*> oldVTables;
+
+  for (GlobalVariable& gv : M.globals()) {
+    if (layout->vtbls.count(vtbl_t(gv.getName(), 0)))
+      oldVTables.push_back(&gv);
+  }
+
+  for (GlobalVariable* gv : oldVTables) {
+    std::set<User*> users(gv->user_begin(), gv->user_end());
+
+    for (User* user : users) {
+      ConstantExpr* userCE = dyn_cast<ConstantExpr>(user);
+      assert(userCE && userCE->getOpcode() == Instruction::GetElementPtr);
+
+      ConstantInt* oldConst = dyn_cast<ConstantInt>(userCE->getOperand(2));
+      assert(oldConst);
+      uint64_t oldAddrPt = oldConst->getSExtValue();
+
+      // find the sub-vtable with this address point
+      const SDLayoutSummary::vtbl_info_t* info = nullptr;
+      for (auto itr = layout->vtbls.lower_bound(vtbl_t(gv->getName(), 0));
+           itr != layout->vtbls.end() && itr->first.first == gv->getName(); itr++) {
+        if (itr->second.defined && itr->second.addrPt == oldAddrPt)
+          info = &itr->second;
+      }
+      assert(info && info->start >= 0 && !info->root.empty());
+
+      GlobalVariable* newVtable = getNewVTable(M, info->root);
+      Constant* indices[] = {zero, ConstantInt::getSigned(Type::getInt64Ty(C), info->start)};
+      Constant* newConst = ConstantExpr::getGetElementPtr(
+        newVtable->getType()->getElementType(), newVtable, indices, true);
+
+      userCE->replaceAllUsesWith(ConstantExpr::getBitCast(newConst, userCE->getType()));
+      userCE->destroyConstant();
+    }
+
+    if (gv->use_empty())
+      gv->eraseFromParent();
+  }
+
+  return !oldVTables.empty();
+}
+
+Constant* SDApplyLayout::getCheckRange(Module& M, const std::string& className,
+                                       const std::string& preciseClassName,
+                                       int64_t& width, int64_t& alignment) {
+  vtbl_t vtbl(className, 0);
+
+  if (layout->vtbls.count(vtbl) && preciseClassName != className) {
+    int64_t ind = layout->getSubVTableIndex(preciseClassName, className);
+    if (ind != -1)
+      vtbl = vtbl_t(preciseClassName, ind);
+  }
+
+  auto itr = layout->vtbls.find(vtbl);
+  if (itr == layout->vtbls.end() || itr->second.start < 0) {
+    // no defined class can reach this check, see SDUpdateIndices
+    sd_print("No layout for check on %s,%" PRIu64 "\n", vtbl.first.c_str(), vtbl.second);
+    width = alignment = 0;
+    return NULL;
+  }
+
+  const SDLayoutSummary::vtbl_info_t& info = itr->second;
+  assert(!info.root.empty() && layout->clouds.count(info.root));
+
+  Type *IntPtrTy = M.getDataLayout().getIntPtrType(M.getContext(), 0);
+  GlobalVariable* newVtable = getNewVTable(M, info.root);
+
+  width = info.width;
+  alignment = layout->clouds.find(info.root)->second.alignment;
+  return ConstantExpr::getAdd(
+    ConstantExpr::getPtrToInt(newVtable, IntPtrTy),
+    ConstantInt::get(IntPtrTy, info.start * WORD_WIDTH));
+}
+
+bool SDApplyLayout::handleSDCheckVtbl(Module& M) {
+  Function *sd_check_vtblF =
+      M.getFunction(Intrinsic::getName(Intrinsic::sd_check_vtbl));
+
+  if (!sd_check_vtblF)
+    return false;
+
+  LLVMContext& C = M.getContext();
+  Type *IntPtrTy = M.getDataLayout().getIntPtrType(C, 0);
+
+  std::vector<CallInst*> calls;
+  for (User* U : sd_check_vtblF->users())
+    calls.push_back(cast<CallInst>(U));
+
+  for (CallInst* CI : calls) {
+    Value* vptr = CI->getArgOperand(0);
+    MDNode* mdNode = cast<MDNode>(
+      cast<MetadataAsValue>(CI->getArgOperand(1))->getMetadata());
+    MDNode* mdNode1 = cast<MDNode>(
+      cast<MetadataAsValue>(CI->getArgOperand(2))->getMetadata());
+
+    int64_t width, alignment;
+    Constant* start = getCheckRange(M, sd_getClassNameFromMD(mdNode,0),
+                                    sd_getClassNameFromMD(mdNode1,0),
+                                    width, alignment);
+    if (!start) {
+      CI->replaceAllUsesWith(ConstantInt::getFalse(C));
+      CI->eraseFromParent();
+      continue;
+    }
+
+    IRBuilder<> builder(CI);
+    Value* Args[] = {
+      builder.CreateBitCast(vptr, Type::getInt8PtrTy(C)),
+      start,
+      ConstantInt::get(IntPtrTy, width),
+      ConstantInt::get(IntPtrTy, alignment)
+    };
+    Value* newIntr = builder.CreateCall(
+      Intrinsic::getDeclaration(&M, Intrinsic::sd_subst_check_range), Args);
+
+    CI->replaceAllUsesWith(newIntr);
+    CI->eraseFromParent();
+  }
+
+  return !calls.empty();
+}
+
+bool SDApplyLayout::handleSDGetCheckedVptr(Module& M) {
+  Function *sd_checked_vptrF =
+      M.getFunction(Intrinsic::getName(Intrinsic::sd_get_checked_vptr));
+
+  if (!sd_checked_vptrF)
+    return false;
+
+  std::vector<CallInst*> calls;
+  for (User* U : sd_checked_vptrF->users())
+    calls.push_back(cast<CallInst>(U));
+
+  for (CallInst* CI : calls) {
+    // the tuple holds the static class followed by the precise class
+    MDNode* mdNode = cast<MDNode>(
+      cast<MetadataAsValue>(CI->getArgOperand(1))->getMetadata());
+
+    int64_t width, alignment;
+    Constant* start = getCheckRange(M, sd_getClassNameFromMD(mdNode,0),
+                                    sd_getClassNameFromMD(mdNode,2),
+                                    width, alignment);
+    sd_lowerCheckedVptr(M, CI, start, width, alignment);
+  }
+
+  return !calls.empty();
+}
+
+bool SDApplyLayout::handleSDIndices(Module& M) {
+  bool changed = false;
+
+  if (Function *sd_vtbl_indexF =
+        M.getFunction(Intrinsic::getName(Intrinsic::sd_get_vtbl_index))) {
+    Type* intType = Type::getInt64Ty(M.getContext());
+    std::vector<CallInst*> calls;
+    for (User* U : sd_vtbl_indexF->users())
+      calls.push_back(cast<CallInst>(U));
+
+    for (CallInst* CI : calls) {
+      ConstantInt* oldIndex = cast<ConstantInt>(CI->getArgOperand(0));
+      MDNode* mdNode = cast<MDNode>(
+        cast<MetadataAsValue>(CI->getArgOperand(1))->getMetadata());
+      vtbl_t vtbl(sd_getClassNameFromMD(mdNode, 0), 0);
+      int64_t newIndex = layout->translateVtblInd(vtbl, oldIndex->getSExtValue());
+
+      IRBuilder<> B(CI);
+      Value *Args[] = {ConstantInt::get(intType, newIndex)};
+      Value* newIntr = B.CreateCall(
+        Intrinsic::getDeclaration(&M, Intrinsic::sd_subst_vtbl_index), Args);
+      CI->replaceAllUsesWith(newIntr);
+      CI->eraseFromParent();
+      changed = true;
+    }
+  }
+
+  // the new vtables use the thunk clones of the layout module, the original
+  // thunks keep their vcall offsets like in SDUpdateIndices
+  if (Function *sd_vcall_indexF =
+        M.getFunction(Intrinsic::getName(Intrinsic::sd_get_vcall_index))) {
+    std::vector<CallInst*> calls;
+    for (User* U : sd_vcall_indexF->users())
+      calls.push_back(cast<CallInst>(U));
+
+    for (CallInst* CI : calls) {
+      CI->replaceAllUsesWith(CI->getArgOperand(0));
+      CI->eraseFromParent();
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+bool SDApplyLayout::runOnModule(Module &M) {
+  layout = &sd_getLayout();
+
+  sd_promoteVTableLocals(M);
+
+  // the intrinsics refer to the old vtables, handle them before those are gone.
+  // The indices go first like in SDUpdateIndices, the sentinel vtable of the
+  // checks is sized from the translated ones.
+  bool changed = handleSDIndices(M);
+  changed |= handleSDCheckVtbl(M);
+  changed |= handleSDGetCheckedVptr(M);
+  changed |= replaceAddressPoints(M);
+
+  return changed;
+}
@@ -1,7 +1,10 @@
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Transforms/IPO/SafeDispatch.h"
 #include "llvm/Transforms/IPO/SafeDispatchLayoutBuilder.h"
+#include "llvm/Transforms/IPO/SafeDispatchPasses.h"
 #include "llvm/Transforms/IPO.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Metadata.h"
@@ -15,10 +18,14 @@
 #include "llvm/Transforms/Utils/Local.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/CallSite.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Support/MathExtras.h"
 
 #include "llvm/Transforms/IPO/SafeDispatchLog.h"
 #include "llvm/Transforms/IPO/SafeDispatchTools.h"
 
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
 #include "llvm/Transforms/Utils/ValueMapper.h"
 #include "llvm/Transforms/Utils/Cloning.h"
 
@@ -30,6 +37,8 @@
 #include <algorithm>
 #include <iostream>
 
+#define WORD_WIDTH 8
+
 // you have to modify the following files for each additional LLVM pass
 // 1. IPO.h and IPO.cpp
 // 2. LinkAllPasses.h
@@ -37,6 +46,11 @@
 
 using namespace llvm;
 
+static cl::opt<bool>
+SDProfInstrument("sd-prof-instrument", cl::init(false), cl::Hidden,
+  cl::desc("Record the vtables observed at each check site (link with "
+           "libsdprof, the profile is read back with -sd-vtbl-profile)"));
+
 namespace {
   /**
    * Pass for updating the annotated instructions with the new indices
@@ -54,23 +68,39 @@ namespace {
     }
 
     bool runOnModule(Module &M) override {
-      layoutBuilder = &getAnalysis<SDLayoutBuilder>();
-      cha = &getAnalysis<SDBuildCHA>();
-      assert(layoutBuilder);
+      run(M, getAnalysis<SDLayoutBuilder>(), getAnalysis<SDBuildCHA>());
+      layoutBuilder->clearAnalysisResults();
+      return true;
+    }
+
+    /**
+     * Rewrite the intrinsics against the given layout and drop the old
+     * vtables. The CHA still describes the old vtables afterwards.
+     */
+    void run(Module &M, SDLayoutBuilder &layout, SDBuildCHA &CHA) {
+      layoutBuilder = &layout;
+      cha = &CHA;
 
       sd_print("inside the 2nd pass\n");
 
+      buildLookupTables(&M);
+
       handleSDGetVtblIndex(&M);
       handleSDCheckVtbl(&M);
+      handleSDGetCheckedVptr(&M);
       handleRemainingSDGetVcallIndex(&M);
 
+      if (SDProfInstrument)
+        emitProfileTables(&M);
+
       sd_print("Finished running the 2nd pass...\n");
 
+      indexTables.clear();
+      checkRanges.clear();
+
       layoutBuilder->removeOldLayouts(M);
-      layoutBuilder->clearAnalysisResults();
 
       sd_print("removed thunks...\n");
-      return true;
     }
 
     void getAnalysisUsage(AnalysisUsage &AU) const override {
@@ -82,10 +112,53 @@ namespace {
   private:
     SDLayoutBuilder* layoutBuilder;
     SDBuildCHA* cha;
+
+    /**
+     * Everything the intrinsics need from the layout, computed once per
+     * distinct metadata node before any of them is rewritten. Class names,
+     * sub-vtable lookups and the alignment of the cloud are then resolved
+     * with a single probe per call site.
+     */
+    struct check_range_t {
+      llvm::Constant* start;  // NULL when the class has no valid vptrs
+      int64_t width;
+      int64_t alignment;
+      std::string className;  // static class of the check
+    };
+    typedef std::pair<MDNode*, MDNode*> check_key_t; // (class, precise class)
+
+    /**
+     * New index of every entry of the primary sub-vtable of a class, relative
+     * to the address point (see SDLayoutBuilder::getTranslatedInds). inds is
+     * empty when the indices of the class don't change.
+     */
+    struct index_table_t {
+      int64_t addrPt;
+      std::vector<int64_t> inds;
+    };
+
+    DenseMap<MDNode*, index_table_t> indexTables; // class md -> new indices
+    DenseMap<check_key_t, check_range_t> checkRanges;
+
+    void buildLookupTables(Module* M);
+
     // metadata ids
     void handleSDGetVtblIndex(Module* M);
     void handleSDCheckVtbl(Module* M);
+    void handleSDGetCheckedVptr(Module* M);
+    llvm::Constant* getCheckRange(const std::string& className,
+                                  const std::string& preciseClassName,
+                                  int64_t& rangeWidth, int64_t& alignment);
     void handleRemainingSDGetVcallIndex(Module* M);
+
+    // check site profiling (-sd-prof-instrument)
+    std::map<Function*, uint64_t> profSiteCount;       // function -> # of instrumented sites
+    std::map<std::string, Constant*> profStrings;
+    GlobalVariable* profCountdown = NULL;
+
+    Constant* getProfString(Module* M, const std::string& str);
+    void instrumentCheckSite(Module* M, CallInst* CI, const std::string& className);
+    void emitProfileTables(Module* M);
   };
 }
 
@@ -146,7 +219,8 @@ namespace {
 
           int64_t widthInt = width->getSExtValue();
           int64_t alignmentInt = alignment->getSExtValue();
-          int alignmentBits = floor(log(alignmentInt + 0.5)/log(2.0));
+          assert(isPowerOf2_64(alignmentInt) && alignmentInt >= WORD_WIDTH);
+          unsigned alignmentBits = Log2_64(alignmentInt);
 
           llvm::Constant* rootVtblInt = dyn_cast<llvm::Constant>(start->getOperand(0));
           llvm::GlobalVariable* rootVtbl = dyn_cast<llvm::GlobalVariable>(
@@ -155,13 +229,17 @@ namespace {
 
           sumWidth += widthInt;
 
-          if (validConstVptr(rootVtbl, startOff->getSExtValue(), widthInt, DL, vptr, 0)) {
+          if (validConstVptr(rootVtbl, startOff->getSExtValue(), widthInt, alignmentInt, DL, vptr, 0)) {
             CI->replaceAllUsesWith(llvm::ConstantInt::getTrue(C));
             CI->eraseFromParent();
             constPtr++;
           } else
           if (widthInt > 1) {
-            // Rotate right by 3 to push the lowest order bits into the higher order bits
+            // Rotate right by log2(alignment) to push the lowest order bits
+            // into the higher order bits. DAGCombiner turns the shift pair into
+            // a single ror (rorx with BMI2) and the constant start into an
+            // immediate or a RIP-relative lea on X86, see
+            // test/CodeGen/X86/sd-range-check.ll. Keep the shape in sync.
             llvm::Value *vptrInt = builder.CreatePtrToInt(vptr, IntPtrTy);
             llvm::Value *diff = builder.CreateSub(vptrInt, start);
             llvm::Value *diffShr = builder.CreateLShr(diff, alignmentBits);
@@ -189,16 +267,24 @@ namespace {
       return indexSubst > 0 || rangeSubst > 0 || eqSubst > 0 || constPtr > 0;
     }
 
+    /**
+     * Valid vptrs are the address points start + i * alignment, i < width
+     */
     bool validConstVptr(GlobalVariable *rootVtbl, int64_t start, int64_t width,
-        const DataLayout &DL, Value *V, uint64_t off) {
+        int64_t alignment, const DataLayout &DL, Value *V, uint64_t off) {
       if (auto GV = dyn_cast<GlobalVariable>(V)) {
         if (GV != rootVtbl)
           return false;
 
-        if (off % 8 != 0)
+        // negative offsets wrapped around when they were accumulated
+        if ((int64_t) off < 0 || start < 0)
           return false;
 
-        return start <= off && off < (start + width * 8);
+        uint64_t ustart = (uint64_t) start;
+        if (off < ustart || (off - ustart) % (uint64_t) alignment != 0)
+          return false;
+
+        return off < ustart + (uint64_t) (width * alignment);
       }
 
       if (auto GEP = dyn_cast<GEPOperator>(V)) {
@@ -208,16 +294,16 @@ namespace {
           return false;
 
         off += APOffset.getZExtValue();
-        return validConstVptr(rootVtbl, start, width, DL, GEP->getPointerOperand(), off);
+        return validConstVptr(rootVtbl, start, width, alignment, DL, GEP->getPointerOperand(), off);
       }
 
       if (auto Op = dyn_cast<Operator>(V)) {
         if (Op->getOpcode() == Instruction::BitCast)
-          return validConstVptr(rootVtbl, start, width, DL, Op->getOperand(0), off);
+          return validConstVptr(rootVtbl, start, width, alignment, DL, Op->getOperand(0), off);
 
         if (Op->getOpcode() == Instruction::Select)
-          return validConstVptr(rootVtbl, start, width, DL, Op->getOperand(1), off) &&
-                 validConstVptr(rootVtbl, start, width, DL, Op->getOperand(2), off);
+          return validConstVptr(rootVtbl, start, width, alignment, DL, Op->getOperand(1), off) &&
+                 validConstVptr(rootVtbl, start, width, alignment, DL, Op->getOperand(2), off);
       }
 
       return false;
@@ -242,53 +328,215 @@ ModulePass* llvm::createSDSubstModule3Pass() {
   return new SDSubstModule3();
 }
 
+PreservedAnalyses SDLayoutPass::run(Module &M, ModuleAnalysisManager *AM) {
+  std::unique_ptr<SDBuildCHAAnalysis::Result> localCHA;
+  SDBuildCHA* cha;
+  if (AM) {
+    cha = &AM->getResult<SDBuildCHAAnalysis>(M).getCHA();
+  } else {
+    localCHA.reset(new SDBuildCHAAnalysis::Result(M));
+    cha = &localCHA->getCHA();
+  }
+
+  SDLayoutBuilder layoutBuilder(interleave);
+  layoutBuilder.run(M, *cha);
+  sd_foldVbaseOffsets(M, *cha);
+
+  SDUpdateIndices updateIndices;
+  updateIndices.run(M, layoutBuilder, *cha);
+
+  // the old vtables are gone, so is the CHA built from them
+  return PreservedAnalyses::none();
+}
+
+PreservedAnalyses SDSubstPass::run(Module &M) {
+  SDSubstModule3 subst;
+  if (!subst.runOnModule(M))
+    return PreservedAnalyses::all();
+
+  // only code is rewritten, the vtables stay as they are
+  PreservedAnalyses PA = PreservedAnalyses::none();
+  PA.preserve<SDBuildCHAAnalysis>();
+  return PA;
+}
+
 /// ----------------------------------------------------------------------------
-/// SDChangeIndices implementation
+/// Masked checks
 /// ----------------------------------------------------------------------------
 
-static std::string
-sd_getClassNameFromMD(llvm::MDNode* mdNode, unsigned operandNo = 0) {
-//  llvm::MDTuple* mdTuple = dyn_cast<llvm::MDTuple>(mdNode);
-//  assert(mdTuple);
-  llvm::MDTuple* mdTuple = cast<llvm::MDTuple>(mdNode);
-  assert(mdTuple->getNumOperands() > operandNo + 1);
+#define VIOLATION_HANDLER_NAME "__sd_vtbl_violation"
+
+/**
+ * Default violation handler. It is weak so that a runtime can replace it
+ * with one that reports the call site before aborting.
+ */
+static Function* sd_getViolationHandler(Module& M) {
+  if (Function* F = M.getFunction(VIOLATION_HANDLER_NAME))
+    return F;
+
+  LLVMContext& C = M.getContext();
+  FunctionType* FTy = FunctionType::get(Type::getVoidTy(C), false);
+  Function* F = Function::Create(FTy, GlobalValue::WeakAnyLinkage,
+                                 VIOLATION_HANDLER_NAME, &M);
+  F->setDoesNotReturn();
+  F->setDoesNotThrow();
+
+  IRBuilder<> builder(BasicBlock::Create(C, "entry", F));
+  builder.CreateCall(Intrinsic::getDeclaration(&M, Intrinsic::trap));
+  builder.CreateUnreachable();
+  return F;
+}
 
-//  llvm::MDNode* nameMdNode = dyn_cast<llvm::MDNode>(mdTuple->getOperand(operandNo).get());
-//  assert(nameMdNode);
-  llvm::MDNode* nameMdNode = cast<llvm::MDNode>(mdTuple->getOperand(operandNo).get());
+/**
+ * Number of entries after the address point that a call through any vtable
+ * of the module may load.
+ */
+static uint64_t sd_getMaxVcallSlots(Module& M) {
+  uint64_t slots = 1;
+
+  // every class has its own sd.class_info.<class> node
+  for (const NamedMDNode& nmd : M.named_metadata()) {
+    if (!nmd.getName().startswith(SD_MD_CLASSINFO))
+      continue;
+
+    for (unsigned i = 0; i < nmd.getNumOperands(); i++) {
+      SDClassInfoMD info(nmd.getOperand(i));
+      for (unsigned sub = 0; sub < info.getNumSubVTables(); sub++) {
+        uint64_t addrPt = info.getAddressPoint(sub) - info.getStart(sub);
+        uint64_t size = info.getEnd(sub) - info.getStart(sub) + 1;
+        if (size > addrPt)
+          slots = std::max(slots, size - addrPt);
+      }
+    }
+  }
 
-//  llvm::MDString* mdStr = dyn_cast<llvm::MDString>(nameMdNode->getOperand(0));
-//  assert(mdStr);
-  llvm::MDString* mdStr = cast<llvm::MDString>(nameMdNode->getOperand(0));
+  // vtables of other modules are reached through indices used here
+  Intrinsic::ID intrinsics[] = {Intrinsic::sd_get_vtbl_index,
+                                Intrinsic::sd_subst_vtbl_index};
+  for (Intrinsic::ID id : intrinsics) {
+    Function* intrF = M.getFunction(Intrinsic::getName(id));
+    if (!intrF)
+      continue;
+
+    for (User* U : intrF->users()) {
+      ConstantInt* ind = dyn_cast<ConstantInt>(cast<CallInst>(U)->getArgOperand(0));
+      if (ind && ind->getSExtValue() >= 0)
+        slots = std::max(slots, (uint64_t) ind->getSExtValue() + 1);
+    }
+  }
 
-  StringRef strRef = mdStr->getString();
-  assert(sd_isVtableName_ref(strRef));
+  return slots;
+}
 
-//  llvm::MDNode* gvMd = dyn_cast<llvm::MDNode>(mdTuple->getOperand(operandNo+1).get());
-  llvm::MDNode* gvMd = cast<llvm::MDNode>(mdTuple->getOperand(operandNo+1).get());
+Constant* llvm::sd_getSentinelVptr(Module& M) {
+  LLVMContext& C = M.getContext();
+  Type* Int8PtrTy = Type::getInt8PtrTy(C);
+  Type* Int64Ty = Type::getInt64Ty(C);
+
+  GlobalVariable* sentinel = M.getGlobalVariable(SD_SENTINEL_VTABLE_NAME, true);
+
+  if (!sentinel) {
+    // offset-to-top and RTTI are zero, every function entry traps
+    Constant* handler = ConstantExpr::getBitCast(sd_getViolationHandler(M), Int8PtrTy);
+    std::vector<Constant*> entries(2, Constant::getNullValue(Int8PtrTy));
+    entries.resize(2 + sd_getMaxVcallSlots(M), handler);
+
+    ArrayType* arrType = ArrayType::get(Int8PtrTy, entries.size());
+    sentinel = new GlobalVariable(M, arrType, true, GlobalValue::InternalLinkage,
+                                  ConstantArray::get(arrType, entries),
+                                  SD_SENTINEL_VTABLE_NAME);
+    sentinel->setUnnamedAddr(true);
+    sentinel->setAlignment(WORD_WIDTH);
+  }
 
-//  SmallString<256> OutName;
-//  llvm::raw_svector_ostream Out(OutName);
-//  gvMd->print(Out, CURR_MODULE);
-//  Out.flush();
+  Constant* indices[] = {ConstantInt::get(Int64Ty, 0), ConstantInt::get(Int64Ty, 2)};
+  return ConstantExpr::getInBoundsGetElementPtr(
+    sentinel->getType()->getElementType(), sentinel, indices);
+}
 
-  llvm::ConstantAsMetadata* vtblConsMd = dyn_cast_or_null<ConstantAsMetadata>(gvMd->getOperand(0).get());
-  if (vtblConsMd == NULL) {
-//    llvm::MDNode* tmpnode = dyn_cast<llvm::MDNode>(gvMd);
-//    llvm::MDString* tmpstr = dyn_cast<llvm::MDString>(tmpnode->getOperand(0));
-//    assert(tmpstr->getString() == "NO_VTABLE");
+void llvm::sd_lowerCheckedVptr(Module& M, CallInst* CI, Constant* start,
+                               int64_t width, int64_t alignment) {
+  IRBuilder<> builder(CI);
+  Value* vptr = CI->getArgOperand(0);
+  Constant* sentinel = ConstantExpr::getBitCast(sd_getSentinelVptr(M),
+                                                vptr->getType());
+  Value* checkedVptr = sentinel;
+
+  if (start) {
+    Type *IntPtrTy = M.getDataLayout().getIntPtrType(M.getContext(), 0);
+    Value *Args[] = {vptr, start,
+                     ConstantInt::get(IntPtrTy, width),
+                     ConstantInt::get(IntPtrTy, alignment)};
+    Value* inRange = builder.CreateCall(
+      Intrinsic::getDeclaration(&M, Intrinsic::sd_subst_check_range), Args);
+
+    // lowered to a compare and a cmov, there is no branch to mispredict
+    checkedVptr = builder.CreateSelect(inRange, vptr, sentinel);
+  }
+
+  CI->replaceAllUsesWith(checkedVptr);
+  CI->eraseFromParent();
+}
 
-    return strRef.str();
+/// ----------------------------------------------------------------------------
+/// SDChangeIndices implementation
+/// ----------------------------------------------------------------------------
+
+static MDNode* sd_getMDArg(CallInst* CI, unsigned argNo) {
+  MDNode* mdNode = dyn_cast<MDNode>(
+    cast<MetadataAsValue>(CI->getArgOperand(argNo))->getMetadata());
+  assert(mdNode);
+  return mdNode;
+}
+
+void SDUpdateIndices::buildLookupTables(Module* M) {
+  if (Function* F = M->getFunction(Intrinsic::getName(Intrinsic::sd_get_vtbl_index))) {
+    for (User* U : F->users()) {
+      MDNode* mdNode = sd_getMDArg(cast<CallInst>(U), 1);
+      if (indexTables.count(mdNode))
+        continue;
+
+      index_table_t& table = indexTables[mdNode];
+      SDLayoutBuilder::vtbl_t vtbl(sd_getClassNameFromMD(mdNode,0), 0);
+      table.addrPt = 0;
+      layoutBuilder->getTranslatedInds(vtbl, table.addrPt, table.inds);
+    }
   }
 
-//  llvm::GlobalVariable* vtbl = dyn_cast<llvm::GlobalVariable>(vtblConsMd->getValue());
-//  assert(vtbl);
-  llvm::GlobalVariable* vtbl = cast<llvm::GlobalVariable>(vtblConsMd->getValue());
+  if (Function* F = M->getFunction(Intrinsic::getName(Intrinsic::sd_check_vtbl))) {
+    for (User* U : F->users()) {
+      CallInst* CI = cast<CallInst>(U);
+      check_key_t key(sd_getMDArg(CI, 1), sd_getMDArg(CI, 2));
+      if (checkRanges.count(key))
+        continue;
+
+      check_range_t range;
+      range.className = sd_getClassNameFromMD(key.first,0);
+      range.start = getCheckRange(range.className,
+                                  sd_getClassNameFromMD(key.second,0),
+                                  range.width, range.alignment);
+      checkRanges[key] = range;
+    }
+  }
 
-  StringRef vtblNameRef = vtbl->getName();
-  assert(vtblNameRef.startswith(strRef));
+  // the tuple holds the static class followed by the precise class
+  if (Function* F = M->getFunction(Intrinsic::getName(Intrinsic::sd_get_checked_vptr))) {
+    for (User* U : F->users()) {
+      check_key_t key(sd_getMDArg(cast<CallInst>(U), 1), nullptr);
+      if (checkRanges.count(key))
+        continue;
+
+      check_range_t range;
+      range.className = sd_getClassNameFromMD(key.first,0);
+      range.start = getCheckRange(range.className,
+                                  sd_getClassNameFromMD(key.first,2),
+                                  range.width, range.alignment);
+      checkRanges[key] = range;
+    }
+  }
 
-  return vtblNameRef.str();
+  sd_print("SDUpdateIndices: %u index classes, %u check ranges\n",
+           indexTables.size(), checkRanges.size());
 }
 
 void SDUpdateIndices::handleSDGetVtblIndex(Module* M) {
@@ -310,21 +558,23 @@ void SDUpdateIndices::handleSDGetVtblIndex(Module* M) {
     // get the arguments
     llvm::ConstantInt* arg1 = dyn_cast<ConstantInt>(CI->getArgOperand(0));
     assert(arg1);
-    llvm::MetadataAsValue* arg2 = dyn_cast<MetadataAsValue>(CI->getArgOperand(1));
-    assert(arg2);
-    MDNode* mdNode = dyn_cast<MDNode>(arg2->getMetadata());
-    assert(mdNode);
 
     // first argument is the old vtable index
     int64_t oldIndex = arg1->getSExtValue();
 
     // second one is the tuple that contains the class name and the corresponding global var.
     // note that the global variable isn't always emitted
-    std::string className = sd_getClassNameFromMD(mdNode,0);
-    SDLayoutBuilder::vtbl_t classVtbl(className, 0);
+    auto tableItr = indexTables.find(sd_getMDArg(CI, 1));
+    assert(tableItr != indexTables.end());
+    const index_table_t& table = tableItr->second;
 
     // calculate the new index
-    int64_t newIndex = layoutBuilder->translateVtblInd(classVtbl, oldIndex, true);
+    int64_t newIndex = oldIndex;
+    if (!table.inds.empty()) {
+      int64_t fullIndex = table.addrPt + oldIndex;
+      assert(fullIndex >= 0 && fullIndex < (int64_t) table.inds.size());
+      newIndex = table.inds[fullIndex];
+    }
 
     // convert the integer to llvm value
     llvm::Value* newConsIntInd = llvm::ConstantInt::get(intType, newIndex);
@@ -341,6 +591,57 @@ void SDUpdateIndices::handleSDGetVtblIndex(Module* M) {
   }
 }
 
+llvm::Constant* SDUpdateIndices::getCheckRange(const std::string& className,
+                                              const std::string& preciseClassName,
+                                              int64_t& rangeWidth, int64_t& alignment) {
+  SDLayoutBuilder::vtbl_t vtbl(className, 0);
+  llvm::Constant *start;
+
+  sd_print("Callsite for %s cha->knowsAbout(%s,%d)=%d) ", className.c_str(),
+    vtbl.first.c_str(), vtbl.second, cha->knowsAbout(vtbl));
+
+  if (cha->knowsAbout(vtbl)) {
+    if (preciseClassName != className) {
+      sd_print("More precise class name = %s\n", preciseClassName.c_str());
+      int64_t ind = cha->getSubVTableIndex(preciseClassName, className);
+      sd_print("Index = %d \n", ind);
+      if (ind != -1) {
+        vtbl = SDLayoutBuilder::vtbl_t(preciseClassName, ind);
+      }
+    } 
+  }
+
+  if (cha->knowsAbout(vtbl) &&
+     (!cha->isUndefined(vtbl) || cha->hasFirstDefinedChild(vtbl))) {
+    // calculate the new index
+    start = cha->isUndefined(vtbl) ?
+      layoutBuilder->getVTableRangeStart(cha->getFirstDefinedChild(vtbl)) :
+      layoutBuilder->getVTableRangeStart(vtbl);
+    rangeWidth = cha->getCloudSize(vtbl.first);
+    sd_print(" [rangeWidth=%d start = %p]  \n", rangeWidth, start);
+  } else {
+    // This is a class we have no metadata about (i.e. doesn't have any
+    // non-virtuall subclasses). In a fully statically linked binary we
+    // should never be able to create an instance of this.
+    std::cerr << "llvm.sd.callsite.false:" << vtbl.first << "," << vtbl.second 
+      << std::endl;
+    sd_print(" [ no metadata ] \n");
+    rangeWidth = 0;
+    alignment = 0;
+    return NULL;
+  }
+
+  if(!cha->hasAncestor(vtbl)) {
+    sd_print("%s\n", vtbl.first.data());
+    assert(false);
+  }
+  SDLayoutBuilder::vtbl_name_t root = cha->getAncestor(vtbl);
+  assert(layoutBuilder->alignmentMap.count(root));
+  alignment = layoutBuilder->alignmentMap[root];
+
+  return start;
+}
+
 void SDUpdateIndices::handleSDCheckVtbl(Module* M) {
   Function *sd_vtbl_indexF =
       M->getFunction(Intrinsic::getName(Intrinsic::sd_check_vtbl));
@@ -360,55 +661,19 @@ void SDUpdateIndices::handleSDCheckVtbl(Module* M) {
     // get the arguments
     llvm::Value* vptr = CI->getArgOperand(0);
     assert(vptr);
-    llvm::MetadataAsValue* arg2 = dyn_cast<MetadataAsValue>(CI->getArgOperand(1));
-    assert(arg2);
-    MDNode* mdNode = dyn_cast<MDNode>(arg2->getMetadata());
-    assert(mdNode);
-    llvm::MetadataAsValue* arg3 = dyn_cast<MetadataAsValue>(CI->getArgOperand(2));
-    assert(arg3);
-    MDNode* mdNode1 = dyn_cast<MDNode>(arg3->getMetadata());
-    assert(mdNode1);
 
-    // second one is the tuple that contains the class name and the corresponding global var.
-    // note that the global variable isn't always emitted
-    std::string className = sd_getClassNameFromMD(mdNode,0);
-    std::string preciseClassName = sd_getClassNameFromMD(mdNode1,0);
-    SDLayoutBuilder::vtbl_t vtbl(className, 0);
-    llvm::Constant *start;
-    int64_t rangeWidth;
-
-    sd_print("Callsite for %s cha->knowsAbout(%s,%d)=%d) ", className.c_str(),
-      vtbl.first.c_str(), vtbl.second, cha->knowsAbout(vtbl));
-
-    if (cha->knowsAbout(vtbl)) {
-      if (preciseClassName != className) {
-        sd_print("More precise class name = %s\n", preciseClassName.c_str());
-        int64_t ind = cha->getSubVTableIndex(preciseClassName, className);
-        sd_print("Index = %d \n", ind);
-        if (ind != -1) {
-          vtbl = SDLayoutBuilder::vtbl_t(preciseClassName, ind);
-        }
-      } 
-    }
+    // second and third ones are the tuples that contain the class names and the
+    // corresponding global vars. note that the global variable isn't always emitted
+    MDNode* mdNode = sd_getMDArg(CI, 1);
+    auto rangeItr = checkRanges.find(check_key_t(mdNode, sd_getMDArg(CI, 2)));
+    assert(rangeItr != checkRanges.end());
 
-    if (cha->knowsAbout(vtbl) &&
-       (!cha->isUndefined(vtbl) || cha->hasFirstDefinedChild(vtbl))) {
-      // calculate the new index
-      start = cha->isUndefined(vtbl) ?
-        layoutBuilder->getVTableRangeStart(cha->getFirstDefinedChild(vtbl)) :
-        layoutBuilder->getVTableRangeStart(vtbl);
-      rangeWidth = cha->getCloudSize(vtbl.first);
-      sd_print(" [rangeWidth=%d start = %p]  \n", rangeWidth, start);
-    } else {
-      // This is a class we have no metadata about (i.e. doesn't have any
-      // non-virtuall subclasses). In a fully statically linked binary we
-      // should never be able to create an instance of this.
-      start = NULL;
-      rangeWidth = 0;
-      //std::cerr << "Emitting empty range for " << vtbl.first << "," << vtbl.second << "\n";
-      sd_print(" [ no metadata ] \n");
-    }
-    LLVMContext& C = CI->getContext();
+    if (SDProfInstrument)
+      instrumentCheckSite(M, CI, rangeItr->second.className);
+
+    llvm::Constant *start = rangeItr->second.start;
+    int64_t rangeWidth = rangeItr->second.width;
+    int64_t alignmentInt = rangeItr->second.alignment;
 
     if (start) {
       IRBuilder<> builder(CI);
@@ -421,14 +686,7 @@ void SDUpdateIndices::handleSDCheckVtbl(Module* M) {
       llvm::Type *Int8PtrTy = IntegerType::getInt8PtrTy(C);
       llvm::Value *castVptr = builder.CreateBitCast(vptr, Int8PtrTy);
 
-      if(!cha->hasAncestor(vtbl)) {
-        sd_print("%s\n", vtbl.first.data());
-        assert(false);
-      }
-      SDLayoutBuilder::vtbl_name_t root = cha->getAncestor(vtbl);
-      assert(layoutBuilder->alignmentMap.count(root));
-
-      llvm::Constant* alignment = llvm::ConstantInt::get(IntPtrTy, layoutBuilder->alignmentMap[root]);
+      llvm::Constant* alignment = llvm::ConstantInt::get(IntPtrTy, alignmentInt);
       llvm::Value *Args[] = {castVptr, start, width, alignment};
       llvm::Value* newIntr = builder.CreateCall(Intrinsic::getDeclaration(M,
             Intrinsic::sd_subst_check_range),
@@ -462,14 +720,37 @@ void SDUpdateIndices::handleSDCheckVtbl(Module* M) {
       }        
       */
     } else {
-      std::cerr << "llvm.sd.callsite.false:" << vtbl.first << "," << vtbl.second 
-        << std::endl;
       CI->replaceAllUsesWith(llvm::ConstantInt::getFalse(C));
       CI->eraseFromParent();
     }
   }
 }
 
+void SDUpdateIndices::handleSDGetCheckedVptr(Module* M) {
+  Function *sd_checked_vptrF =
+      M->getFunction(Intrinsic::getName(Intrinsic::sd_get_checked_vptr));
+
+  // if the function doesn't exist, do nothing
+  if (!sd_checked_vptrF)
+    return;
+
+  std::vector<CallInst*> calls;
+  for (User* U : sd_checked_vptrF->users())
+    calls.push_back(cast<CallInst>(U));
+
+  for (CallInst* CI : calls) {
+    MDNode* mdNode = sd_getMDArg(CI, 1);
+    auto rangeItr = checkRanges.find(check_key_t(mdNode, nullptr));
+    assert(rangeItr != checkRanges.end());
+
+    if (SDProfInstrument)
+      instrumentCheckSite(M, CI, rangeItr->second.className);
+
+    const check_range_t& range = rangeItr->second;
+    sd_lowerCheckedVptr(*M, CI, range.start, range.width, range.alignment);
+  }
+}
+
 void SDUpdateIndices::handleRemainingSDGetVcallIndex(Module* M) {
   Function *sd_vcall_indexF =
       M->getFunction(Intrinsic::getName(Intrinsic::sd_get_vcall_index));
@@ -491,3 +772,128 @@ void SDUpdateIndices::handleRemainingSDGetVcallIndex(Module* M) {
     CI->replaceAllUsesWith(arg1);
   }
 }
+
+/// ----------------------------------------------------------------------------
+/// Check site profiling
+/// ----------------------------------------------------------------------------
+
+Constant* SDUpdateIndices::getProfString(Module* M, const std::string& str) {
+  Constant*& strPtr = profStrings[str];
+  if (strPtr)
+    return strPtr;
+
+  LLVMContext& C = M->getContext();
+  Constant* strConst = ConstantDataArray::getString(C, str);
+  GlobalVariable* strGV = new GlobalVariable(*M, strConst->getType(), true,
+                                             GlobalValue::PrivateLinkage,
+                                             strConst, "__sd_prof_str");
+  strGV->setUnnamedAddr(true);
+
+  Constant* zero = ConstantInt::get(Type::getInt64Ty(C), 0);
+  Constant* indices[] = {zero, zero};
+  strPtr = ConstantExpr::getInBoundsGetElementPtr(strConst->getType(), strGV, indices);
+  return strPtr;
+}
+
+/**
+ * Every dispatch decrements a thread local countdown, once it runs out the
+ * site and the vptr are handed to __sd_prof_sample, which returns the next
+ * countdown (the sampling period of the runtime).
+ */
+void SDUpdateIndices::instrumentCheckSite(Module* M, CallInst* CI,
+                                          const std::string& className) {
+  LLVMContext& C = M->getContext();
+  Type* Int8PtrTy = Type::getInt8PtrTy(C);
+  Type* Int32Ty = Type::getInt32Ty(C);
+  Type* Int64Ty = Type::getInt64Ty(C);
+
+  if (!profCountdown) {
+    profCountdown = new GlobalVariable(*M, Int32Ty, false,
+                                       GlobalValue::InternalLinkage,
+                                       ConstantInt::get(Int32Ty, 0),
+                                       "__sd_prof_countdown", nullptr,
+                                       GlobalVariable::GeneralDynamicTLSModel);
+  }
+
+  // {function, index, class}, read by the runtime when dumping the profile
+  Function* F = CI->getParent()->getParent();
+  Constant* fields[] = {
+    getProfString(M, F->getName()),
+    ConstantInt::get(Int64Ty, profSiteCount[F]++),
+    getProfString(M, className)
+  };
+  Constant* siteConst = ConstantStruct::getAnon(C, fields);
+  GlobalVariable* site = new GlobalVariable(*M, siteConst->getType(), true,
+                                            GlobalValue::PrivateLinkage,
+                                            siteConst, "__sd_prof_site");
+
+  IRBuilder<> builder(CI);
+  Value* countdown = builder.CreateSub(builder.CreateLoad(profCountdown),
+                                       ConstantInt::get(Int32Ty, 1));
+  builder.CreateStore(countdown, profCountdown);
+  Value* expired = builder.CreateICmpSLE(countdown, ConstantInt::get(Int32Ty, 0));
+
+  TerminatorInst* sampleTerm = SplitBlockAndInsertIfThen(expired, CI, false,
+    MDBuilder(C).createBranchWeights(1, 1000));
+  builder.SetInsertPoint(sampleTerm);
+
+  Type* argTs[] = {Int8PtrTy, Int8PtrTy};
+  Constant* sampleF = M->getOrInsertFunction("__sd_prof_sample",
+    FunctionType::get(Int32Ty, argTs, false));
+  Value* next = builder.CreateCall2(sampleF,
+    ConstantExpr::getBitCast(site, Int8PtrTy),
+    builder.CreateBitCast(CI->getArgOperand(0), Int8PtrTy));
+  builder.CreateStore(next, profCountdown);
+}
+
+/**
+ * Registers the address points of the new vtables with the runtime, so that
+ * it can map the sampled vptrs back to (vtable, order, root).
+ */
+void SDUpdateIndices::emitProfileTables(Module* M) {
+  LLVMContext& C = M->getContext();
+  Type* Int8PtrTy = Type::getInt8PtrTy(C);
+  Type* Int64Ty = Type::getInt64Ty(C);
+
+  // {address point, vtable, order, root}
+  std::vector<Constant*> entries;
+  for (auto& itr : layoutBuilder->newVTableStartAddrMap) {
+    const SDLayoutBuilder::vtbl_t& v = itr.first;
+    if (!itr.second || !cha->hasAncestor(v))
+      continue;
+
+    Constant* fields[] = {
+      ConstantExpr::getIntToPtr(itr.second, Int8PtrTy),
+      getProfString(M, v.first),
+      ConstantInt::get(Int64Ty, v.second),
+      getProfString(M, cha->getAncestor(v))
+    };
+    entries.push_back(ConstantStruct::getAnon(C, fields));
+  }
+
+  Type* entryTs[] = {Int8PtrTy, Int8PtrTy, Int64Ty, Int8PtrTy};
+  StructType* entryTy = StructType::get(C, makeArrayRef(entryTs));
+  ArrayType* arrType = ArrayType::get(entryTy, entries.size());
+  GlobalVariable* table = new GlobalVariable(*M, arrType, true,
+                                             GlobalValue::PrivateLinkage,
+                                             ConstantArray::get(arrType, entries),
+                                             "__sd_prof_vtables");
+
+  Type* argTs[] = {Int8PtrTy, Int64Ty};
+  Constant* registerF = M->getOrInsertFunction("__sd_prof_register",
+    FunctionType::get(Type::getVoidTy(C), argTs, false));
+
+  Function* initF = Function::Create(FunctionType::get(Type::getVoidTy(C), false),
+                                     GlobalValue::InternalLinkage,
+                                     "__sd_prof_init", M);
+  IRBuilder<> builder(BasicBlock::Create(C, "entry", initF));
+  builder.CreateCall2(registerF,
+                      ConstantExpr::getBitCast(table, Int8PtrTy),
+                      ConstantInt::get(Int64Ty, entries.size()));
+  builder.CreateRetVoid();
+
+  appendToGlobalCtors(*M, initF, 0);
+
+  sd_print("SDProf: %lu instrumented functions, %lu vtables\n",
+           profSiteCount.size(), entries.size());
+}
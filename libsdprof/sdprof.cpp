@@ -0,0 +1,214 @@
+// Check site profiling runtime for -sd-prof-instrument.
+//
+// Instrumented programs call __sd_prof_sample(site, vptr) every
+// SD_PROF_PERIOD (default 997) dispatches of a thread. Each thread counts its
+// samples in a table of its own that it updates without locking; the dump at
+// exit reads the tables of the running threads concurrently. The counts are
+// merged when the thread exits or the program ends. At exit the profile is
+// written to SD_PROF_FILE (default sdprof.out) in the format read by
+// -sd-vtbl-profile.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <pthread.h>
+
+typedef struct _SiteElement {
+  const char *function;
+  uint64_t index;
+  const char *className;
+} SiteElement_t;
+
+typedef struct _VTableElement {
+  const void *addrPt;
+  const char *vtable;
+  uint64_t order;
+  const char *root;
+} VTableElement_t;
+
+typedef std::pair<const SiteElement_t*, const void*> SiteKey_t;
+
+struct SiteKeyHash {
+  size_t operator()(const SiteKey_t &key) const {
+    return std::hash<const void*>()(key.first) * 31 +
+           std::hash<const void*>()(key.second);
+  }
+};
+
+typedef std::unordered_map<SiteKey_t, uint64_t, SiteKeyHash> Counts_t;
+
+// Only the owning thread writes a slot: it fills in the vptr before it
+// publishes the site, and it bumps the count with plain atomic stores. The
+// dump at exit may read the slots of a thread that is still sampling.
+struct Slot_t {
+  std::atomic<const SiteElement_t*> site;
+  const void *vptr;
+  std::atomic<uint64_t> count;
+};
+
+// A power of 2. Keys that find no free slot go to the overflow map, which is
+// behind a lock like the maps of the exited threads.
+static const size_t numSlots = 4096;
+
+struct ThreadCounts_t {
+  Slot_t slots[numSlots];
+  std::mutex lock;
+  Counts_t overflow;
+
+  ThreadCounts_t() {
+    for (Slot_t &slot : slots) {
+      slot.site.store(NULL, std::memory_order_relaxed);
+      slot.vptr = NULL;
+      slot.count.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void sample(const SiteKey_t &key) {
+    size_t hash = SiteKeyHash()(key);
+    for (size_t i = 0; i < numSlots; i++) {
+      Slot_t &slot = slots[(hash + i) & (numSlots - 1)];
+      const SiteElement_t *site = slot.site.load(std::memory_order_relaxed);
+
+      if (!site) {
+        slot.vptr = key.second;
+        slot.count.store(1, std::memory_order_relaxed);
+        slot.site.store(key.first, std::memory_order_release);
+        return;
+      }
+
+      if (site == key.first && slot.vptr == key.second) {
+        slot.count.store(slot.count.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_relaxed);
+        return;
+      }
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    overflow[key]++;
+  }
+
+  // Called by other threads while the owner may still be sampling.
+  void mergeInto(Counts_t &to) {
+    for (Slot_t &slot : slots) {
+      const SiteElement_t *site = slot.site.load(std::memory_order_acquire);
+      if (site)
+        to[SiteKey_t(site, slot.vptr)] +=
+          slot.count.load(std::memory_order_relaxed);
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    for (const auto &itr : overflow)
+      to[itr.first] += itr.second;
+  }
+};
+
+static std::mutex profLock;
+static std::vector<VTableElement_t> vtables;
+static std::set<ThreadCounts_t*> liveCounts; // counts of the running threads
+static Counts_t retiredCounts;             // counts of the exited threads
+static uint32_t period = 997; // prime, not in step with loops over objects
+
+static pthread_once_t countsKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t countsKey;
+static __thread ThreadCounts_t *threadCounts;
+
+static void retireCounts(void *p) {
+  ThreadCounts_t *counts = (ThreadCounts_t*) p;
+  {
+    std::lock_guard<std::mutex> guard(profLock);
+    counts->mergeInto(retiredCounts);
+    liveCounts.erase(counts);
+  }
+  threadCounts = NULL;
+  delete counts;
+}
+
+static void createCountsKey() {
+  pthread_key_create(&countsKey, retireCounts);
+}
+
+static ThreadCounts_t *getThreadCounts() {
+  if (!threadCounts) {
+    pthread_once(&countsKeyOnce, createCountsKey);
+    threadCounts = new ThreadCounts_t();
+    pthread_setspecific(countsKey, threadCounts);
+
+    std::lock_guard<std::mutex> guard(profLock);
+    liveCounts.insert(threadCounts);
+  }
+  return threadCounts;
+}
+
+static const VTableElement_t *findVTable(const void *vptr) {
+  auto itr = std::lower_bound(vtables.begin(), vtables.end(), vptr,
+    [](const VTableElement_t &e, const void *p) { return e.addrPt < p; });
+
+  if (itr == vtables.end() || itr->addrPt != vptr)
+    return NULL;
+  return &*itr;
+}
+
+static void dumpProfile() {
+  std::lock_guard<std::mutex> guard(profLock);
+
+  Counts_t counts(retiredCounts);
+  for (ThreadCounts_t *c : liveCounts)
+    c->mergeInto(counts);
+
+  std::sort(vtables.begin(), vtables.end(),
+    [](const VTableElement_t &a, const VTableElement_t &b) {
+      return a.addrPt < b.addrPt;
+    });
+
+  const char *fileName = getenv("SD_PROF_FILE");
+  if (!fileName)
+    fileName = "sdprof.out";
+
+  FILE *out = fopen(fileName, "w");
+  if (!out) {
+    fprintf(stderr, "sdprof: could not write %s\n", fileName);
+    return;
+  }
+
+  fprintf(out, "# SafeDispatch dispatch profile, sampling period %u\n", period);
+  fprintf(out, "# site <function> <index> <class> <root> <vtable> <order> <count>\n");
+
+  for (const auto &itr : counts) {
+    const SiteElement_t *site = itr.first.first;
+    const VTableElement_t *vtbl = findVTable(itr.first.second);
+
+    fprintf(out, "site %s %llu %s %s %s %llu %llu\n",
+            site->function, (unsigned long long) site->index, site->className,
+            vtbl ? vtbl->root : "-", vtbl ? vtbl->vtable : "-",
+            (unsigned long long) (vtbl ? vtbl->order : 0),
+            (unsigned long long) itr.second * period);
+  }
+
+  fclose(out);
+}
+
+extern "C" uint32_t __sd_prof_sample(const SiteElement_t *site, const void *vptr) {
+  getThreadCounts()->sample(SiteKey_t(site, vptr));
+  return period;
+}
+
+extern "C" void __sd_prof_register(const VTableElement_t *table, uint64_t n) {
+  std::lock_guard<std::mutex> guard(profLock);
+
+  static bool registered = false;
+  if (!registered) {
+    registered = true;
+    if (const char *p = getenv("SD_PROF_PERIOD"))
+      period = std::max(atoi(p), 1);
+    atexit(dumpProfile);
+  }
+
+  vtables.insert(vtables.end(), table, table + n);
+}
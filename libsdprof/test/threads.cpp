@@ -0,0 +1,52 @@
+// Samples one site from several threads while another thread keeps sampling
+// through the dump at exit. The joined threads' counts have to add up, and the
+// dump must not race with the thread that is still running.
+
+#include <cstdint>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+typedef struct _SiteElement {
+  const char *function;
+  uint64_t index;
+  const char *className;
+} SiteElement_t;
+
+typedef struct _VTableElement {
+  const void *addrPt;
+  const char *vtable;
+  uint64_t order;
+  const char *root;
+} VTableElement_t;
+
+extern "C" uint32_t __sd_prof_sample(const SiteElement_t *site, const void *vptr);
+extern "C" void __sd_prof_register(const VTableElement_t *table, uint64_t n);
+
+static const void *vtable[4];
+static const SiteElement_t joined = { "joined", 0, "_ZTV1A" };
+static const SiteElement_t running = { "running", 1, "_ZTV1A" };
+
+int main() {
+  VTableElement_t table[] = { { &vtable[2], "_ZTV1A", 0, "_ZTV1A" } };
+  __sd_prof_register(table, 1);
+
+  std::thread([] {
+    for (;;)
+      __sd_prof_sample(&running, &vtable[2]);
+  }).detach();
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++)
+    threads.push_back(std::thread([] {
+      for (int j = 0; j < 1000; j++)
+        __sd_prof_sample(&joined, &vtable[2]);
+    }));
+  for (std::thread &t : threads)
+    t.join();
+
+  for (int j = 0; j < 1000; j++)
+    __sd_prof_sample(&joined, &vtable[2]);
+
+  exit(0);
+}
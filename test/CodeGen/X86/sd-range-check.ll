@@ -0,0 +1,108 @@
+; RUN: llc < %s -mtriple=x86_64-unknown-linux-gnu -mcpu=generic -relocation-model=pic | FileCheck %s
+; RUN: llc < %s -mtriple=x86_64-unknown-linux-gnu -mcpu=generic -mattr=+bmi2 -relocation-model=pic | FileCheck %s --check-prefix=BMI2
+
+; SafeDispatch range checks as lowered by SDSubstModule3: the distance of the
+; vptr from the start of the valid range is rotated right by log2 of the cloud
+; alignment and compared against the range width. The shift pair has to become
+; a single rotate and the range start a RIP-relative lea. MatchRotate forms a
+; rotl, which BMI2 selects as rorx by the complementary amount.
+
+@_SD_ZTV1A = internal constant [64 x i8*] zeroinitializer, align 512
+@_SD_ZTV1B = internal constant [1536 x i8*] zeroinitializer, align 4096
+
+define i1 @check_align8(i8* %vptr) {
+; CHECK-LABEL: check_align8:
+; CHECK: leaq _SD_ZTV1A+16(%rip)
+; CHECK: {{rolq[[:space:]]+\$61|rorq[[:space:]]+\$3}},
+; CHECK-NOT: shr
+; CHECK: cmpq ${{[0-9]+}},
+; BMI2-LABEL: check_align8:
+; BMI2: rorxq $3,
+  %vptrInt = ptrtoint i8* %vptr to i64
+  %diff = sub i64 %vptrInt, add (i64 ptrtoint ([64 x i8*]* @_SD_ZTV1A to i64), i64 16)
+  %shr = lshr i64 %diff, 3
+  %shl = shl i64 %diff, 61
+  %ror = or i64 %shr, %shl
+  %inRange = icmp ule i64 %ror, 5
+  ret i1 %inRange
+}
+
+define i1 @check_align16(i8* %vptr) {
+; CHECK-LABEL: check_align16:
+; CHECK: leaq _SD_ZTV1A+32(%rip)
+; CHECK: {{rolq[[:space:]]+\$60|rorq[[:space:]]+\$4}},
+; CHECK-NOT: shr
+; CHECK: cmpq ${{[0-9]+}},
+; BMI2-LABEL: check_align16:
+; BMI2: rorxq $4,
+  %vptrInt = ptrtoint i8* %vptr to i64
+  %diff = sub i64 %vptrInt, add (i64 ptrtoint ([64 x i8*]* @_SD_ZTV1A to i64), i64 32)
+  %shr = lshr i64 %diff, 4
+  %shl = shl i64 %diff, 60
+  %ror = or i64 %shr, %shl
+  %inRange = icmp ule i64 %ror, 7
+  ret i1 %inRange
+}
+
+define i1 @check_align32(i8* %vptr) {
+; CHECK-LABEL: check_align32:
+; CHECK: leaq _SD_ZTV1A+64(%rip)
+; CHECK: {{rolq[[:space:]]+\$59|rorq[[:space:]]+\$5}},
+; CHECK-NOT: shr
+; CHECK: cmpq ${{[0-9]+}},
+; BMI2-LABEL: check_align32:
+; BMI2: rorxq $5,
+  %vptrInt = ptrtoint i8* %vptr to i64
+  %diff = sub i64 %vptrInt, add (i64 ptrtoint ([64 x i8*]* @_SD_ZTV1A to i64), i64 64)
+  %shr = lshr i64 %diff, 5
+  %shl = shl i64 %diff, 59
+  %ror = or i64 %shr, %shl
+  %inRange = icmp ule i64 %ror, 3
+  ret i1 %inRange
+}
+
+define i1 @check_align64(i8* %vptr) {
+; CHECK-LABEL: check_align64:
+; CHECK: leaq _SD_ZTV1A+128(%rip)
+; CHECK: {{rolq[[:space:]]+\$58|rorq[[:space:]]+\$6}},
+; CHECK-NOT: shr
+; CHECK: cmpq ${{[0-9]+}},
+; BMI2-LABEL: check_align64:
+; BMI2: rorxq $6,
+  %vptrInt = ptrtoint i8* %vptr to i64
+  %diff = sub i64 %vptrInt, add (i64 ptrtoint ([64 x i8*]* @_SD_ZTV1A to i64), i64 128)
+  %shr = lshr i64 %diff, 6
+  %shl = shl i64 %diff, 58
+  %ror = or i64 %shr, %shl
+  %inRange = icmp ule i64 %ror, 2
+  ret i1 %inRange
+}
+
+; Page aligned clouds rotate by more than a byte.
+define i1 @check_align4096(i8* %vptr) {
+; CHECK-LABEL: check_align4096:
+; CHECK: leaq _SD_ZTV1B+4096(%rip)
+; CHECK: {{rolq[[:space:]]+\$52|rorq[[:space:]]+\$12}},
+; CHECK-NOT: shr
+; CHECK: cmpq ${{[0-9]+}},
+; BMI2-LABEL: check_align4096:
+; BMI2: rorxq $12,
+  %vptrInt = ptrtoint i8* %vptr to i64
+  %diff = sub i64 %vptrInt, add (i64 ptrtoint ([1536 x i8*]* @_SD_ZTV1B to i64), i64 4096)
+  %shr = lshr i64 %diff, 12
+  %shl = shl i64 %diff, 52
+  %ror = or i64 %shr, %shl
+  %inRange = icmp ule i64 %ror, 1
+  ret i1 %inRange
+}
+
+; Single member clouds are an equality check against the address point.
+define i1 @check_single(i8* %vptr) {
+; CHECK-LABEL: check_single:
+; CHECK: leaq _SD_ZTV1A+256(%rip)
+; CHECK-NOT: ror
+; CHECK: cmpq
+  %vptrInt = ptrtoint i8* %vptr to i64
+  %inRange = icmp eq i64 %vptrInt, add (i64 ptrtoint ([64 x i8*]* @_SD_ZTV1A to i64), i64 256)
+  ret i1 %inRange
+}
@@ -0,0 +1,8 @@
+@g = internal global i32 1
+
+!named = !{!0, !1, !2, !3}
+
+!0 = !{!"shared", i32 1}
+!1 = !{i32* @g}
+!2 = distinct !{!"d"}
+!3 = !{!2}
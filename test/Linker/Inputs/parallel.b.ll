@@ -0,0 +1,12 @@
+@w = weak global i32 2
+@counter = internal global i32 2
+@llvm.global_ctors = appending global [1 x { i32, void ()*, i8* }] [{ i32, void ()*, i8* } { i32 65535, void ()* @ctor_b, i8* null }]
+
+define void @ctor_b() {
+  ret void
+}
+
+define linkonce_odr i32 @f() {
+  %r = load i32, i32* @counter, align 4
+  ret i32 %r
+}
@@ -0,0 +1,20 @@
+@w = weak global i32 3
+@counter = internal global i32 3
+@llvm.global_ctors = appending global [1 x { i32, void ()*, i8* }] [{ i32, void ()*, i8* } { i32 65535, void ()* @ctor_c, i8* null }]
+
+define void @ctor_c() {
+  ret void
+}
+
+define linkonce_odr i32 @f() {
+  ret i32 4
+}
+
+define i32 @use_counter_c() {
+  %r = load i32, i32* @counter, align 4
+  ret i32 %r
+}
+
+define linkonce_odr i32 @g() {
+  ret i32 5
+}
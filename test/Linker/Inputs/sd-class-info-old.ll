@@ -0,0 +1,24 @@
+@_ZTV1A = linkonce_odr unnamed_addr constant [3 x i8*] [i8* null, i8* null, i8* bitcast (void ()* @_ZN1A1fEv to i8*)]
+@_ZTV1B = unnamed_addr constant [3 x i8*] [i8* null, i8* null, i8* bitcast (void ()* @_ZN1B1fEv to i8*)]
+
+define linkonce_odr void @_ZN1A1fEv() {
+  ret void
+}
+
+define void @_ZN1B1fEv() {
+  ret void
+}
+
+!sd.class_info._ZTV1A = !{!0, !1, !2, !3}
+!sd.class_info._ZTV1B = !{!6, !7, !2, !8}
+
+!0 = !{!"_ZTV1A"}
+!1 = !{[3 x i8*]* @_ZTV1A}
+!2 = !{i64 1}
+!3 = !{i64 0, i64 0, i64 2, i64 2, !4}
+!4 = !{i64 1, !"", i64 0, !5}
+!5 = !{!"NO_VTABLE"}
+!6 = !{!"_ZTV1B"}
+!7 = !{[3 x i8*]* @_ZTV1B}
+!8 = !{i64 0, i64 0, i64 2, i64 2, !9}
+!9 = !{i64 1, !"_ZTV1A", i64 0, !1}
@@ -0,0 +1,6 @@
+; A's vtable is not referenced here, and B is defined differently.
+!sd.class_info._ZTV1A = !{!0}
+!sd.class_info._ZTV1B = !{!1}
+
+!0 = !{!"_ZTV1A", null, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 2, i64 2, i64 1, i64 0, i64 0], !"", null}
+!1 = !{!"_ZTV1B", null, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 3, i64 2, i64 1, i64 0, i64 0], !"_ZTV1A", null}
@@ -0,0 +1,22 @@
+; RUN: llvm-link %s %p/Inputs/metadata-unchanged.ll -S -o - | FileCheck %s
+
+; Nodes built only of strings and integers are taken over from the second
+; module as they are. Nodes that refer to a global or to a distinct node are
+; still remapped: the internal @g of the second module is renamed, and its
+; distinct node is cloned.
+
+; CHECK: !named = !{![[SHARED:[0-9]+]], ![[G:[0-9]+]], ![[D:[0-9]+]], ![[SHARED]], ![[G1:[0-9]+]], ![[D1:[0-9]+]], ![[USE:[0-9]+]]}
+; CHECK-DAG: ![[SHARED]] = !{!"shared", i32 1}
+; CHECK-DAG: ![[G]] = !{i32* @g}
+; CHECK-DAG: ![[G1]] = !{i32* @g{{\.?}}1}
+; CHECK-DAG: ![[D]] = distinct !{!"d"}
+; CHECK-DAG: ![[D1]] = distinct !{!"d"}
+; CHECK-DAG: ![[USE]] = !{![[D1]]}
+
+@g = internal global i32 0
+
+!named = !{!0, !1, !2}
+
+!0 = !{!"shared", i32 1}
+!1 = !{i32* @g}
+!2 = distinct !{!"d"}
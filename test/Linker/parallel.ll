@@ -0,0 +1,37 @@
+; RUN: llvm-link %s %p/Inputs/parallel.b.ll %p/Inputs/parallel.c.ll -S -o - | \
+; RUN:   FileCheck %s
+; RUN: llvm-link -j 2 %s %p/Inputs/parallel.b.ll %p/Inputs/parallel.c.ll \
+; RUN:   -S -o - | FileCheck %s
+; RUN: llvm-link -j 3 %s %p/Inputs/parallel.b.ll %p/Inputs/parallel.c.ll \
+; RUN:   -S -o - | FileCheck %s
+
+; Linking the files in parallel must resolve symbols as a serial link does:
+; the first definition of a weak or linkonce symbol wins, internal symbols
+; are renamed in link order, the constructors keep their order and the
+; linkonce definitions nothing uses are dropped.
+
+; CHECK-DAG: @w = weak global i32 1
+; CHECK-DAG: [[B:@counter[0-9]*]] = internal global i32 2
+; CHECK-DAG: [[C:@counter[0-9]*]] = internal global i32 3
+; CHECK-DAG: @llvm.global_ctors = appending global [3 x {{.*}} @ctor_a{{.*}} @ctor_b{{.*}} @ctor_c
+
+; CHECK-LABEL: define linkonce_odr i32 @f()
+; CHECK-NEXT: load i32, i32* [[B]],
+
+; CHECK-LABEL: define i32 @use_counter_c()
+; CHECK-NEXT: load i32, i32* [[C]],
+; CHECK-NOT: @g()
+
+@w = weak global i32 1
+@llvm.global_ctors = appending global [1 x { i32, void ()*, i8* }] [{ i32, void ()*, i8* } { i32 65535, void ()* @ctor_a, i8* null }]
+
+define void @ctor_a() {
+  ret void
+}
+
+declare i32 @f()
+
+define i32 @use_f() {
+  %r = call i32 @f()
+  ret i32 %r
+}
@@ -0,0 +1,34 @@
+; RUN: llvm-link -S %s %p/Inputs/sd-class-info-old.ll | FileCheck %s
+; RUN: llvm-link -S %p/Inputs/sd-class-info-old.ll %s | FileCheck %s
+; RUN: llvm-link -S %p/Inputs/sd-class-info-old.ll | FileCheck %s
+; RUN: llvm-link -S %p/Inputs/sd-class-info-ref.ll %s %p/Inputs/sd-class-info-old.ll \
+; RUN:   2>&1 | FileCheck -check-prefix=REF %s
+
+; A is emitted by both modules, in the current form here and in the boxed form
+; of older compilers in the input. The old records are upgraded, so only one
+; class info tuple is left per class.
+
+; CHECK: !sd.class_info._ZTV1A = !{![[A:[0-9]+]]}
+; CHECK: !sd.class_info._ZTV1B = !{![[B:[0-9]+]]}
+; CHECK-DAG: ![[A]] = !{!"_ZTV1A", [3 x i8*]* @_ZTV1A, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 2, i64 2, i64 1, i64 0, i64 0], !"", null}
+; CHECK-DAG: ![[B]] = !{!"_ZTV1B", [3 x i8*]* @_ZTV1B, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 2, i64 2, i64 1, i64 0, i64 0], !"_ZTV1A", [3 x i8*]* @_ZTV1A}
+
+; The records of a class are merged by name. One that does not reference the
+; vtable gives way to one that does, a class defined differently is diagnosed
+; and keeps its first record.
+
+; REF: WARNING: SafeDispatch class info of '_ZTV1B' differs between modules, keeping the first one
+; REF: !sd.class_info._ZTV1A = !{![[A:[0-9]+]]}
+; REF: !sd.class_info._ZTV1B = !{![[B:[0-9]+]]}
+; REF-DAG: ![[A]] = !{!"_ZTV1A", [3 x i8*]* @_ZTV1A, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 2, i64 2, i64 1, i64 0, i64 0], !"", null}
+; REF-DAG: ![[B]] = !{!"_ZTV1B", null, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 3, i64 2, i64 1, i64 0, i64 0], !"_ZTV1A", null}
+
+@_ZTV1A = linkonce_odr unnamed_addr constant [3 x i8*] [i8* null, i8* null, i8* bitcast (void ()* @_ZN1A1fEv to i8*)]
+
+define linkonce_odr void @_ZN1A1fEv() {
+  ret void
+}
+
+!sd.class_info._ZTV1A = !{!0}
+
+!0 = !{!"_ZTV1A", [3 x i8*]* @_ZTV1A, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 2, i64 2, i64 1, i64 0, i64 0], !"", null}
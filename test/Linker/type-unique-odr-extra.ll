@@ -0,0 +1,12 @@
+; RUN: llvm-link %p/type-unique-odr-a.ll %p/Inputs/type-unique-odr-extra.ll -S -o - | \
+; RUN:   FileCheck %s
+
+; The second copy of A also declares getBar, which the first one lacks.
+; Mapping it to the first copy would leave the declaration of getBar outside
+; of A's elements, so both copies are linked in.
+
+; CHECK-DAG: !MDCompositeType(tag: DW_TAG_class_type, name: "A", file: !{{[0-9]+}}, line: 1,
+; CHECK-DAG: !MDCompositeType(tag: DW_TAG_class_type, name: "A", file: !{{[0-9]+}}, line: 2, {{.*}}elements: ![[ELEMS:[0-9]+]]
+; CHECK-DAG: ![[ELEMS]] = !{!{{[0-9]+}}, !{{[0-9]+}}, ![[DECL:[0-9]+]]}
+; CHECK-DAG: ![[DECL]] = !MDSubprogram(name: "getBar", {{.*}}isDefinition: false,
+; CHECK-DAG: !MDSubprogram(name: "getBar", {{.*}}isDefinition: true, {{.*}}declaration: ![[DECL]]
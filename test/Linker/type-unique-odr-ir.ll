@@ -0,0 +1,15 @@
+; RUN: llvm-link %p/type-unique-odr-a.ll %p/type-unique-odr-b.ll -S -o - | \
+; RUN:   FileCheck %s
+; RUN: llvm-link -j 1 %p/Inputs/type-unique-odr-none.ll %p/type-unique-odr-a.ll \
+; RUN:   %p/type-unique-odr-b.ll -S -o - | FileCheck %s
+
+; Class A is defined in both files with the ODR identifier _ZTS1A. Only the
+; copy from the first file is linked in, and the definition of A::getFoo from
+; the second file points to the declaration of the first one. The types of
+; a compile unit are found by the next links too.
+
+; CHECK-NOT: !MDCompositeType(tag: DW_TAG_class_type, name: "A",
+; CHECK-NOT: !MDSubprogram(name: "getFoo", linkageName: "_ZN1A6getFooEv", scope: !"_ZTS1A", file: !{{[0-9]+}}, line: 5,
+; CHECK: !MDCompositeType(tag: DW_TAG_class_type, name: "A", file: !{{[0-9]+}}, line: 1,
+; CHECK-NOT: !MDCompositeType(tag: DW_TAG_class_type, name: "A",
+; CHECK-NOT: !MDSubprogram(name: "getFoo", linkageName: "_ZN1A6getFooEv", scope: !"_ZTS1A", file: !{{[0-9]+}}, line: 5,
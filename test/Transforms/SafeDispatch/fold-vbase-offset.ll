@@ -0,0 +1,69 @@
+; RUN: opt -sdfoldvbase -S < %s | FileCheck %s
+
+; A has no derived classes, so only its own vtable passes the checks and the
+; vbase offset read through it is a constant. B is the base of C, whose vtable
+; holds a different offset, so that read has to stay.
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+%struct.A = type { i32 (...)** }
+%struct.B = type { i32 (...)** }
+%struct.C = type { %struct.B }
+
+@_ZTV1A = linkonce_odr unnamed_addr constant [4 x i8*] [i8* inttoptr (i64 8 to i8*), i8* null, i8* null, i8* bitcast (void (%struct.A*)* @_ZN1A1fEv to i8*)], align 8
+@_ZTV1B = linkonce_odr unnamed_addr constant [4 x i8*] [i8* inttoptr (i64 8 to i8*), i8* null, i8* null, i8* bitcast (void (%struct.B*)* @_ZN1B1fEv to i8*)], align 8
+@_ZTV1C = linkonce_odr unnamed_addr constant [4 x i8*] [i8* inttoptr (i64 16 to i8*), i8* null, i8* null, i8* bitcast (void (%struct.C*)* @_ZN1C1fEv to i8*)], align 8
+
+; CHECK-LABEL: define i64 @vbase_a(
+; CHECK-NOT: load
+; CHECK: ret i64 8
+define i64 @vbase_a(i8* %vtable) {
+  %idx = call i64 @llvm.sd.get.vtbl.index(i64 -3, metadata !3)
+  %off = mul i64 %idx, 8
+  %p = getelementptr i8, i8* %vtable, i64 %off
+  %q = bitcast i8* %p to i64*
+  %v = load i64, i64* %q, align 8
+  ret i64 %v
+}
+
+; CHECK-LABEL: define i64 @vbase_b(
+; CHECK: %v = load i64, i64* %q
+; CHECK: ret i64 %v
+define i64 @vbase_b(i8* %vtable) {
+  %idx = call i64 @llvm.sd.get.vtbl.index(i64 -3, metadata !6)
+  %off = mul i64 %idx, 8
+  %p = getelementptr i8, i8* %vtable, i64 %off
+  %q = bitcast i8* %p to i64*
+  %v = load i64, i64* %q, align 8
+  ret i64 %v
+}
+
+define linkonce_odr void @_ZN1A1fEv(%struct.A* %this) {
+  ret void
+}
+
+define linkonce_odr void @_ZN1B1fEv(%struct.B* %this) {
+  ret void
+}
+
+define linkonce_odr void @_ZN1C1fEv(%struct.C* %this) {
+  ret void
+}
+
+declare i64 @llvm.sd.get.vtbl.index(i64, metadata)
+
+!sd.class_info._ZTV1A = !{!0}
+!sd.class_info._ZTV1B = !{!1}
+!sd.class_info._ZTV1C = !{!2}
+
+; one sub-vtable each: order 0, range [0, 3], address point 3
+!0 = !{!"_ZTV1A", [4 x i8*]* @_ZTV1A, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 3, i64 3, i64 1, i64 0, i64 0], !"", null}
+!1 = !{!"_ZTV1B", [4 x i8*]* @_ZTV1B, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 3, i64 3, i64 1, i64 0, i64 0], !"", null}
+!2 = !{!"_ZTV1C", [4 x i8*]* @_ZTV1C, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 3, i64 3, i64 1, i64 0, i64 0], !"_ZTV1B", [4 x i8*]* @_ZTV1B}
+!3 = !{!4, !5}
+!4 = !{!"_ZTV1A"}
+!5 = !{[4 x i8*]* @_ZTV1A}
+!6 = !{!7, !8}
+!7 = !{!"_ZTV1B"}
+!8 = !{[4 x i8*]* @_ZTV1B}
@@ -0,0 +1,57 @@
+; RUN: opt -sdovt -sd-vtbl-section=.sdvtbl -sd-vtbl-hot-align=4096 -S < %s | FileCheck %s
+; RUN: not opt -sdovt -sd-vtbl-section=.sdvtbl -sd-vtbl-hot-align=24 -S < %s 2>&1 \
+; RUN:     | FileCheck %s --check-prefix=ERR
+
+; Without a profile every index site counts as one dispatch: A is the hottest
+; cloud, B comes next and D is cold. Both hot vtables get the hot alignment,
+; not only the first one.
+
+; CHECK: @_SD_ZTV1A = {{.*}} section ".sdvtbl", align 4096
+; CHECK: @_SD_ZTV1B = {{.*}} section ".sdvtbl", align 4096
+; CHECK: @_SD_ZTV1D = {{.*}} section ".sdvtbl", align {{(8|16|32|64)$}}
+
+; ERR: LLVM ERROR: -sd-vtbl-hot-align=24 is not a power of 2
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+%struct.A = type { i32 (...)** }
+
+@_ZTV1A = linkonce_odr unnamed_addr constant [3 x i8*] [i8* null, i8* null, i8* bitcast (void (%struct.A*)* @_ZN1A1fEv to i8*)], align 8
+@_ZTV1B = linkonce_odr unnamed_addr constant [3 x i8*] [i8* null, i8* null, i8* bitcast (void (%struct.A*)* @_ZN1B1fEv to i8*)], align 8
+@_ZTV1D = linkonce_odr unnamed_addr constant [3 x i8*] [i8* null, i8* null, i8* bitcast (void (%struct.A*)* @_ZN1D1fEv to i8*)], align 8
+
+define void @sites() {
+  %a1 = call i64 @llvm.sd.get.vtbl.index(i64 0, metadata !3)
+  %a2 = call i64 @llvm.sd.get.vtbl.index(i64 0, metadata !3)
+  %b = call i64 @llvm.sd.get.vtbl.index(i64 0, metadata !6)
+  ret void
+}
+
+define linkonce_odr void @_ZN1A1fEv(%struct.A* %this) {
+  ret void
+}
+
+define linkonce_odr void @_ZN1B1fEv(%struct.A* %this) {
+  ret void
+}
+
+define linkonce_odr void @_ZN1D1fEv(%struct.A* %this) {
+  ret void
+}
+
+declare i64 @llvm.sd.get.vtbl.index(i64, metadata)
+
+!sd.class_info._ZTV1A = !{!0}
+!sd.class_info._ZTV1B = !{!1}
+!sd.class_info._ZTV1D = !{!2}
+
+!0 = !{!"_ZTV1A", [3 x i8*]* @_ZTV1A, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 2, i64 2, i64 1, i64 0, i64 0], !"", null}
+!1 = !{!"_ZTV1B", [3 x i8*]* @_ZTV1B, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 2, i64 2, i64 1, i64 0, i64 0], !"", null}
+!2 = !{!"_ZTV1D", [3 x i8*]* @_ZTV1D, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 2, i64 2, i64 1, i64 0, i64 0], !"", null}
+!3 = !{!4, !5}
+!4 = !{!"_ZTV1A"}
+!5 = !{[3 x i8*]* @_ZTV1A}
+!6 = !{!7, !8}
+!7 = !{!"_ZTV1B"}
+!8 = !{[3 x i8*]* @_ZTV1B}
@@ -0,0 +1,68 @@
+; RUN: opt -S -passes=sd-ivtbl < %s | FileCheck %s --check-prefix=PLAIN
+; RUN: opt -S -passes=sd-ivtbl -sd-ivtbl-block-for=_ZTV1A=2 < %s \
+; RUN:     | FileCheck %s --check-prefix=BLOCK
+; RUN: not opt -S -passes=sd-ivtbl -sd-ivtbl-block-for=_ZTV1A=2,_ZTV1D=3 < %s 2>&1 \
+; RUN:     | FileCheck %s --check-prefix=ERR
+
+; Both clouds are a root with one child that adds a method. Plain
+; interleaving alternates the classes element by element, a block of 2
+; keeps pairs of elements of one class together and puts the address
+; points two entries apart. -sd-ivtbl-block-for only changes the cloud of
+; the given root.
+
+; PLAIN: @_SD_ZTV1A = internal unnamed_addr constant [7 x i8*] [i8* null, i8* null, i8* bitcast (i8** @_ZTI1A to i8*), i8* bitcast (i8** @_ZTI1B to i8*), i8* bitcast (void (%struct.A*)* @_ZN1A1fEv to i8*), i8* bitcast (void (%struct.A*)* @_ZN1B1fEv to i8*), i8* bitcast (void (%struct.A*)* @_ZN1B1gEv to i8*)], align 8
+; PLAIN: @_SD_ZTV1D = internal unnamed_addr constant [7 x i8*] {{.*}}, align 8
+
+; BLOCK: @_SD_ZTV1A = internal unnamed_addr constant [8 x i8*] [i8* null, i8* bitcast (i8** @_ZTI1A to i8*), i8* null, i8* bitcast (i8** @_ZTI1B to i8*), i8* bitcast (void (%struct.A*)* @_ZN1A1fEv to i8*), i8* null, i8* bitcast (void (%struct.A*)* @_ZN1B1fEv to i8*), i8* bitcast (void (%struct.A*)* @_ZN1B1gEv to i8*)], align 16
+; BLOCK: @_SD_ZTV1D = internal unnamed_addr constant [7 x i8*] {{.*}}, align 8
+
+; ERR: LLVM ERROR: -sd-ivtbl-block-for=_ZTV1D=3 is not a power of 2
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+%struct.A = type { i32 (...)** }
+
+@_ZTI1A = external constant i8*
+@_ZTI1B = external constant i8*
+@_ZTI1D = external constant i8*
+@_ZTI1E = external constant i8*
+
+@_ZTV1A = linkonce_odr unnamed_addr constant [3 x i8*] [i8* null, i8* bitcast (i8** @_ZTI1A to i8*), i8* bitcast (void (%struct.A*)* @_ZN1A1fEv to i8*)], align 8
+@_ZTV1B = linkonce_odr unnamed_addr constant [4 x i8*] [i8* null, i8* bitcast (i8** @_ZTI1B to i8*), i8* bitcast (void (%struct.A*)* @_ZN1B1fEv to i8*), i8* bitcast (void (%struct.A*)* @_ZN1B1gEv to i8*)], align 8
+@_ZTV1D = linkonce_odr unnamed_addr constant [3 x i8*] [i8* null, i8* bitcast (i8** @_ZTI1D to i8*), i8* bitcast (void (%struct.A*)* @_ZN1D1fEv to i8*)], align 8
+@_ZTV1E = linkonce_odr unnamed_addr constant [4 x i8*] [i8* null, i8* bitcast (i8** @_ZTI1E to i8*), i8* bitcast (void (%struct.A*)* @_ZN1E1fEv to i8*), i8* bitcast (void (%struct.A*)* @_ZN1E1gEv to i8*)], align 8
+
+define linkonce_odr void @_ZN1A1fEv(%struct.A* %this) {
+  ret void
+}
+
+define linkonce_odr void @_ZN1B1fEv(%struct.A* %this) {
+  ret void
+}
+
+define linkonce_odr void @_ZN1B1gEv(%struct.A* %this) {
+  ret void
+}
+
+define linkonce_odr void @_ZN1D1fEv(%struct.A* %this) {
+  ret void
+}
+
+define linkonce_odr void @_ZN1E1fEv(%struct.A* %this) {
+  ret void
+}
+
+define linkonce_odr void @_ZN1E1gEv(%struct.A* %this) {
+  ret void
+}
+
+!sd.class_info._ZTV1A = !{!0}
+!sd.class_info._ZTV1B = !{!1}
+!sd.class_info._ZTV1D = !{!2}
+!sd.class_info._ZTV1E = !{!3}
+
+!0 = !{!"_ZTV1A", [3 x i8*]* @_ZTV1A, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 2, i64 2, i64 1, i64 0, i64 0], !"", null}
+!1 = !{!"_ZTV1B", [4 x i8*]* @_ZTV1B, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 3, i64 2, i64 1, i64 0, i64 0], !"_ZTV1A", [3 x i8*]* @_ZTV1A}
+!2 = !{!"_ZTV1D", [3 x i8*]* @_ZTV1D, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 2, i64 2, i64 1, i64 0, i64 0], !"", null}
+!3 = !{!"_ZTV1E", [4 x i8*]* @_ZTV1E, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 3, i64 2, i64 1, i64 0, i64 0], !"_ZTV1D", [3 x i8*]* @_ZTV1D}
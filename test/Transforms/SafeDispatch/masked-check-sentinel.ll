@@ -0,0 +1,53 @@
+; RUN: opt -cc -S < %s | FileCheck %s
+
+; The sentinel vtable has to cover every slot a virtual call may load through
+; a checked vptr. The largest vtable is taken from the sd.class_info.<class>
+; records, the call below only loads the first slot of A, which has four.
+
+; CHECK: @_SD_sentinel = internal unnamed_addr constant [6 x i8*] [i8* null, i8* null, i8* bitcast (void ()* @__sd_vtbl_violation to i8*), i8* bitcast (void ()* @__sd_vtbl_violation to i8*), i8* bitcast (void ()* @__sd_vtbl_violation to i8*), i8* bitcast (void ()* @__sd_vtbl_violation to i8*)], align 8
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+%struct.A = type { i32 (...)** }
+
+@_ZTV1A = linkonce_odr unnamed_addr constant [6 x i8*] [i8* null, i8* null, i8* bitcast (void (%struct.A*)* @_ZN1A1aEv to i8*), i8* bitcast (void (%struct.A*)* @_ZN1A1bEv to i8*), i8* bitcast (void (%struct.A*)* @_ZN1A1cEv to i8*), i8* bitcast (void (%struct.A*)* @_ZN1A1dEv to i8*)], align 8
+
+; CHECK-LABEL: define void @call_a(
+; CHECK: select i1 %{{.*}}, i8* %{{.*}}, i8* bitcast (i8** getelementptr inbounds ([6 x i8*], [6 x i8*]* @_SD_sentinel, i64 0, i64 2) to i8*)
+define void @call_a(%struct.A* %a) {
+entry:
+  %0 = bitcast %struct.A* %a to i8**
+  %vtable = load i8*, i8** %0, align 8
+  %checked = call i8* @llvm.sd.get.checked.vptr(i8* %vtable, metadata !1)
+  %1 = bitcast i8* %checked to void (%struct.A*)**
+  %2 = load void (%struct.A*)*, void (%struct.A*)** %1, align 8
+  call void %2(%struct.A* %a)
+  ret void
+}
+
+define linkonce_odr void @_ZN1A1aEv(%struct.A* %this) {
+  ret void
+}
+
+define linkonce_odr void @_ZN1A1bEv(%struct.A* %this) {
+  ret void
+}
+
+define linkonce_odr void @_ZN1A1cEv(%struct.A* %this) {
+  ret void
+}
+
+define linkonce_odr void @_ZN1A1dEv(%struct.A* %this) {
+  ret void
+}
+
+declare i8* @llvm.sd.get.checked.vptr(i8*, metadata)
+
+!sd.class_info._ZTV1A = !{!0}
+
+; one sub-vtable: order 0, range [0, 5], address point 2, a single root parent
+!0 = !{!"_ZTV1A", [6 x i8*]* @_ZTV1A, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 5, i64 2, i64 1, i64 0, i64 0], !"", null}
+!1 = !{!2, !3, !2, !3}
+!2 = !{!"_ZTV1A"}
+!3 = !{[6 x i8*]* @_ZTV1A}
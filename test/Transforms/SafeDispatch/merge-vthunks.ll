@@ -0,0 +1,44 @@
+; RUN: opt -S -passes=sd-ivtbl < %s 2>&1 | FileCheck %s
+; RUN: opt -S -cc < %s 2>&1 | FileCheck %s
+
+; X and Y are separate clouds that share the virtual thunk of B::g. Both
+; clones get the same vcall offset, so the clone of Y is merged into the one
+; of X and both new vtables point to it.
+
+; CHECK: SD] Merged 1 identical vthunk clones
+; CHECK-DAG: @_SD_ZTV1X = internal unnamed_addr constant {{.*}} @_SVT_ZTV1X_ZTv0_n24_N1B1gEv
+; CHECK-DAG: @_SD_ZTV1Y = internal unnamed_addr constant {{.*}} @_SVT_ZTV1X_ZTv0_n24_N1B1gEv
+; CHECK-NOT: @_SVT_ZTV1Y_ZTv0_n24_N1B1gEv
+; CHECK: define linkonce_odr void @_SVT_ZTV1X_ZTv0_n24_N1B1gEv(
+; CHECK-NOT: @_SVT_ZTV1Y_ZTv0_n24_N1B1gEv
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+%struct.B = type { i32 (...)** }
+
+@_ZTV1X = linkonce_odr unnamed_addr constant [4 x i8*] [i8* null, i8* null, i8* null, i8* bitcast (void (%struct.B*)* @_ZTv0_n24_N1B1gEv to i8*)], align 8
+@_ZTV1Y = linkonce_odr unnamed_addr constant [4 x i8*] [i8* null, i8* null, i8* null, i8* bitcast (void (%struct.B*)* @_ZTv0_n24_N1B1gEv to i8*)], align 8
+
+define linkonce_odr void @_ZTv0_n24_N1B1gEv(%struct.B* %this) {
+  %1 = bitcast %struct.B* %this to i8**
+  %vtable = load i8*, i8** %1, align 8
+  %index = call i64 @llvm.sd.get.vcall.index(i64 -24)
+  %2 = getelementptr inbounds i8, i8* %vtable, i64 %index
+  %3 = bitcast i8* %2 to i64*
+  %offset = load i64, i64* %3, align 8
+  %4 = bitcast %struct.B* %this to i8*
+  %5 = getelementptr inbounds i8, i8* %4, i64 %offset
+  %6 = bitcast i8* %5 to %struct.B*
+  tail call void @_ZN1B1gEv(%struct.B* %6)
+  ret void
+}
+
+declare void @_ZN1B1gEv(%struct.B*)
+declare i64 @llvm.sd.get.vcall.index(i64)
+
+!sd.class_info._ZTV1X = !{!0}
+!sd.class_info._ZTV1Y = !{!1}
+
+!0 = !{!"_ZTV1X", [4 x i8*]* @_ZTV1X, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 3, i64 3, i64 1, i64 0, i64 0], !"", null}
+!1 = !{!"_ZTV1Y", [4 x i8*]* @_ZTV1Y, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 3, i64 3, i64 1, i64 0, i64 0], !"", null}
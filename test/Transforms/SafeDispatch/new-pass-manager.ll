@@ -0,0 +1,88 @@
+; RUN: opt -disable-output -debug-pass-manager \
+; RUN:     -passes='require<sd-cha>,sd-subst,require<sd-cha>' %s 2>&1 \
+; RUN:     | FileCheck %s --check-prefix=PRESERVED
+; RUN: opt -disable-output -debug-pass-manager \
+; RUN:     -passes='require<sd-cha>,sd-fix,sd-ovtbl,require<sd-cha>' %s 2>&1 \
+; RUN:     | FileCheck %s --check-prefix=INVALIDATED
+; RUN: opt -disable-output -debug-pass-manager \
+; RUN:     -passes='require<sd-cha>,sd-fix,function(verify),require<sd-cha>' %s 2>&1 \
+; RUN:     | FileCheck %s --check-prefix=UNCHANGED
+; RUN: opt -disable-output -debug-pass-manager \
+; RUN:     -passes='require<sd-cha>,function(instcombine),require<sd-cha>' %s 2>&1 \
+; RUN:     | FileCheck %s --check-prefix=FUNCTION
+; RUN: opt -S -passes='sd-fix,sd-ivtbl,sd-subst' %s | FileCheck %s --check-prefix=LAYOUT
+; RUN: opt -S -passes='sd-fix,sd-ovtbl,sd-subst' %s | FileCheck %s --check-prefix=LAYOUT
+
+; sd-subst leaves the vtables alone and keeps the CHA, the layout passes
+; replace the vtables and drop it.
+
+; PRESERVED: Running analysis: SafeDispatch CHA
+; PRESERVED: Running pass: SDSubstPass
+; PRESERVED-NOT: Running analysis: SafeDispatch CHA
+
+; INVALIDATED: Running analysis: SafeDispatch CHA
+; INVALIDATED: Running pass: SDLayoutPass
+; INVALIDATED: Invalidating analysis: SafeDispatch CHA
+; INVALIDATED: Running analysis: SafeDispatch CHA
+
+; Nothing is fixed and the verifier changes nothing, the CHA is kept.
+; UNCHANGED: Running analysis: SafeDispatch CHA
+; UNCHANGED: Running pass: SDFixPass
+; UNCHANGED: Running pass: ModuleToFunctionPassAdaptor
+; UNCHANGED-NOT: SafeDispatch CHA
+
+; instcombine turns the mul of vbase_b into a shl. The vtables are untouched,
+; but the adaptor doesn't preserve module analyses once a function changed.
+; FUNCTION: Running analysis: SafeDispatch CHA
+; FUNCTION: Running pass: InstCombinePass
+; FUNCTION: Invalidating analysis: SafeDispatch CHA
+; FUNCTION: Running analysis: SafeDispatch CHA
+
+; LAYOUT-DAG: @_SD_ZTV1A = internal unnamed_addr constant
+; LAYOUT-DAG: @_SD_ZTV1B = internal unnamed_addr constant
+; LAYOUT-NOT: call i64 @llvm.sd.get.vtbl.index
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+%struct.A = type { i32 (...)** }
+%struct.B = type { i32 (...)** }
+%struct.C = type { %struct.B }
+
+@_ZTV1A = linkonce_odr unnamed_addr constant [4 x i8*] [i8* inttoptr (i64 8 to i8*), i8* null, i8* null, i8* bitcast (void (%struct.A*)* @_ZN1A1fEv to i8*)], align 8
+@_ZTV1B = linkonce_odr unnamed_addr constant [4 x i8*] [i8* inttoptr (i64 8 to i8*), i8* null, i8* null, i8* bitcast (void (%struct.B*)* @_ZN1B1fEv to i8*)], align 8
+@_ZTV1C = linkonce_odr unnamed_addr constant [4 x i8*] [i8* inttoptr (i64 16 to i8*), i8* null, i8* null, i8* bitcast (void (%struct.C*)* @_ZN1C1fEv to i8*)], align 8
+
+define i64 @vbase_b(i8* %vtable) {
+  %idx = call i64 @llvm.sd.get.vtbl.index(i64 -3, metadata !3)
+  %off = mul i64 %idx, 8
+  %p = getelementptr i8, i8* %vtable, i64 %off
+  %q = bitcast i8* %p to i64*
+  %v = load i64, i64* %q, align 8
+  ret i64 %v
+}
+
+define linkonce_odr void @_ZN1A1fEv(%struct.A* %this) {
+  ret void
+}
+
+define linkonce_odr void @_ZN1B1fEv(%struct.B* %this) {
+  ret void
+}
+
+define linkonce_odr void @_ZN1C1fEv(%struct.C* %this) {
+  ret void
+}
+
+declare i64 @llvm.sd.get.vtbl.index(i64, metadata)
+
+!sd.class_info._ZTV1A = !{!0}
+!sd.class_info._ZTV1B = !{!1}
+!sd.class_info._ZTV1C = !{!2}
+
+!0 = !{!"_ZTV1A", [4 x i8*]* @_ZTV1A, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 3, i64 3, i64 1, i64 0, i64 0], !"", null}
+!1 = !{!"_ZTV1B", [4 x i8*]* @_ZTV1B, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 3, i64 3, i64 1, i64 0, i64 0], !"", null}
+!2 = !{!"_ZTV1C", [4 x i8*]* @_ZTV1C, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 3, i64 3, i64 1, i64 0, i64 0], !"_ZTV1B", [4 x i8*]* @_ZTV1B}
+!3 = !{!4, !5}
+!4 = !{!"_ZTV1B"}
+!5 = !{[4 x i8*]* @_ZTV1B}
@@ -0,0 +1,65 @@
+; RUN: opt -cc -sd-prof-instrument -S < %s | FileCheck %s
+
+; Every check site gets a {function, index, class} record and counts down a
+; thread local counter, the runtime is only called when it runs out. The
+; address points of the new vtables are registered from a constructor.
+
+; CHECK-DAG: @__sd_prof_countdown = internal thread_local global i32 0
+; CHECK-DAG: @[[FN:__sd_prof_str[0-9]*]] = private unnamed_addr constant [7 x i8] c"call_a\00"
+; CHECK-DAG: @[[CLS:__sd_prof_str[0-9]*]] = private unnamed_addr constant [7 x i8] c"_ZTV1A\00"
+; CHECK-DAG: @__sd_prof_site = private constant { i8*, i64, i8* } { i8* getelementptr inbounds ([7 x i8], [7 x i8]* @[[FN]], i64 0, i64 0), i64 0, i8* getelementptr inbounds ([7 x i8], [7 x i8]* @[[CLS]], i64 0, i64 0) }
+; CHECK-DAG: @__sd_prof_vtables = private constant [1 x { i8*, i8*, i64, i8* }] [{ i8*, i8*, i64, i8* } { i8* inttoptr (i64 add (i64 ptrtoint ([{{[0-9]+}} x i8*]* @_SD_ZTV1A to i64), i64 {{[0-9]+}}) to i8*), i8* getelementptr inbounds ([7 x i8], [7 x i8]* @[[CLS]], i64 0, i64 0), i64 0, i8* getelementptr inbounds ([7 x i8], [7 x i8]* @[[CLS]], i64 0, i64 0) }]
+; CHECK-DAG: @llvm.global_ctors = appending global [1 x { i32, void ()* }] [{ i32, void ()* } { i32 0, void ()* @__sd_prof_init }]
+
+; CHECK-LABEL: define void @call_a(
+; CHECK: %vtable = load i8*, i8** %0
+; CHECK-NEXT: [[OLD:%[0-9]+]] = load i32, i32* @__sd_prof_countdown
+; CHECK-NEXT: [[NEW:%[0-9]+]] = sub i32 [[OLD]], 1
+; CHECK-NEXT: store i32 [[NEW]], i32* @__sd_prof_countdown
+; CHECK-NEXT: [[EXPIRED:%[0-9]+]] = icmp sle i32 [[NEW]], 0
+; CHECK-NEXT: br i1 [[EXPIRED]], label %[[SAMPLE:[0-9]+]], label %[[CHECK:[0-9]+]], !prof
+; CHECK: ; <label>:[[SAMPLE]]
+; CHECK-NEXT: [[NEXT:%[0-9]+]] = call i32 @__sd_prof_sample(i8* bitcast ({ i8*, i64, i8* }* @__sd_prof_site to i8*), i8* %vtable)
+; CHECK-NEXT: store i32 [[NEXT]], i32* @__sd_prof_countdown
+; CHECK-NEXT: br label %[[CHECK]]
+; CHECK: ; <label>:[[CHECK]]
+; CHECK-NEXT: call i1 @llvm.sd.subst.check.range(i8* %vtable,
+
+; CHECK-LABEL: define internal void @__sd_prof_init()
+; CHECK-NEXT: entry:
+; CHECK-NEXT: call void @__sd_prof_register(i8* bitcast ([1 x { i8*, i8*, i64, i8* }]* @__sd_prof_vtables to i8*), i64 1)
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+%struct.A = type { i32 (...)** }
+
+@_ZTV1A = linkonce_odr unnamed_addr constant [4 x i8*] [i8* null, i8* null, i8* bitcast (void (%struct.A*)* @_ZN1A1fEv to i8*), i8* bitcast (void (%struct.A*)* @_ZN1A1gEv to i8*)], align 8
+
+define void @call_a(%struct.A* %a) {
+entry:
+  %0 = bitcast %struct.A* %a to i8**
+  %vtable = load i8*, i8** %0, align 8
+  %checked = call i8* @llvm.sd.get.checked.vptr(i8* %vtable, metadata !1)
+  %1 = bitcast i8* %checked to void (%struct.A*)**
+  %2 = load void (%struct.A*)*, void (%struct.A*)** %1, align 8
+  call void %2(%struct.A* %a)
+  ret void
+}
+
+define linkonce_odr void @_ZN1A1fEv(%struct.A* %this) {
+  ret void
+}
+
+define linkonce_odr void @_ZN1A1gEv(%struct.A* %this) {
+  ret void
+}
+
+declare i8* @llvm.sd.get.checked.vptr(i8*, metadata)
+
+!sd.class_info._ZTV1A = !{!0}
+
+!0 = !{!"_ZTV1A", [4 x i8*]* @_ZTV1A, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 3, i64 2, i64 1, i64 0, i64 0], !"", null}
+!1 = !{!2, !3, !2, !3}
+!2 = !{!"_ZTV1A"}
+!3 = !{[4 x i8*]* @_ZTV1A}
@@ -0,0 +1,71 @@
+; RUN: opt -S -passes=sd-ivtbl < %s | FileCheck %s --check-prefix=ALL
+; RUN: opt -S -passes=sd-ivtbl -sd-cha-referenced-only < %s > %t
+; RUN: FileCheck %s --check-prefix=PRUNED < %t
+; RUN: FileCheck %s --check-prefix=DEAD < %t
+
+; The cloud of A is kept because a check site names its child B, the cloud of
+; E because the constructor of E stores its vtable. Nothing refers to D, so
+; its cloud is only laid out without -sd-cha-referenced-only.
+
+; ALL-DAG: @_SD_ZTV1A = internal
+; ALL-DAG: @_SD_ZTV1D = internal
+; ALL-DAG: @_SD_ZTV1E = internal
+
+; PRUNED-DAG: @_SD_ZTV1A = internal
+; PRUNED-DAG: @_SD_ZTV1E = internal
+; PRUNED-DAG: @_ZTV1D = linkonce_odr
+; PRUNED-NOT: call i64 @llvm.sd.get.vtbl.index
+
+; DEAD-NOT: @_SD_ZTV1D
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+%struct.A = type { i32 (...)** }
+
+@_ZTV1A = linkonce_odr unnamed_addr constant [3 x i8*] [i8* null, i8* null, i8* bitcast (void (%struct.A*)* @_ZN1A1fEv to i8*)], align 8
+@_ZTV1B = linkonce_odr unnamed_addr constant [3 x i8*] [i8* null, i8* null, i8* bitcast (void (%struct.A*)* @_ZN1B1fEv to i8*)], align 8
+@_ZTV1D = linkonce_odr unnamed_addr constant [3 x i8*] [i8* null, i8* null, i8* bitcast (void (%struct.A*)* @_ZN1D1fEv to i8*)], align 8
+@_ZTV1E = linkonce_odr unnamed_addr constant [3 x i8*] [i8* null, i8* null, i8* bitcast (void (%struct.A*)* @_ZN1E1fEv to i8*)], align 8
+
+define i64 @site() {
+  %idx = call i64 @llvm.sd.get.vtbl.index(i64 0, metadata !4)
+  ret i64 %idx
+}
+
+define void @_ZN1EC2Ev(%struct.A* %this) {
+  %vptr = getelementptr inbounds %struct.A, %struct.A* %this, i64 0, i32 0
+  store i32 (...)** bitcast (i8** getelementptr inbounds ([3 x i8*], [3 x i8*]* @_ZTV1E, i64 0, i64 2) to i32 (...)**), i32 (...)*** %vptr, align 8
+  ret void
+}
+
+define linkonce_odr void @_ZN1A1fEv(%struct.A* %this) {
+  ret void
+}
+
+define linkonce_odr void @_ZN1B1fEv(%struct.A* %this) {
+  ret void
+}
+
+define linkonce_odr void @_ZN1D1fEv(%struct.A* %this) {
+  ret void
+}
+
+define linkonce_odr void @_ZN1E1fEv(%struct.A* %this) {
+  ret void
+}
+
+declare i64 @llvm.sd.get.vtbl.index(i64, metadata)
+
+!sd.class_info._ZTV1A = !{!0}
+!sd.class_info._ZTV1B = !{!1}
+!sd.class_info._ZTV1D = !{!2}
+!sd.class_info._ZTV1E = !{!3}
+
+!0 = !{!"_ZTV1A", [3 x i8*]* @_ZTV1A, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 2, i64 2, i64 1, i64 0, i64 0], !"", null}
+!1 = !{!"_ZTV1B", [3 x i8*]* @_ZTV1B, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 2, i64 2, i64 1, i64 0, i64 0], !"_ZTV1A", [3 x i8*]* @_ZTV1A}
+!2 = !{!"_ZTV1D", [3 x i8*]* @_ZTV1D, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 2, i64 2, i64 1, i64 0, i64 0], !"", null}
+!3 = !{!"_ZTV1E", [3 x i8*]* @_ZTV1E, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 2, i64 2, i64 1, i64 0, i64 0], !"", null}
+!4 = !{!5, !6}
+!5 = !{!"_ZTV1B"}
+!6 = !{[3 x i8*]* @_ZTV1B}
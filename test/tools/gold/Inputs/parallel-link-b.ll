@@ -0,0 +1,10 @@
+target triple = "x86_64-unknown-linux-gnu"
+
+define linkonce_odr void @f3() {
+  ret void
+}
+
+define void @b() {
+  call void @f3()
+  ret void
+}
@@ -0,0 +1,9 @@
+target triple = "x86_64-unknown-linux-gnu"
+
+define hidden void @g() {
+  ret void
+}
+
+define weak_odr void @w() {
+  ret void
+}
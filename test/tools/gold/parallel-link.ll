@@ -0,0 +1,49 @@
+; RUN: llvm-as %s -o %t.o
+; RUN: llvm-as %p/Inputs/parallel-link-b.ll -o %t2.o
+; RUN: llvm-as %p/Inputs/parallel-link-c.ll -o %t3.o
+
+; The result doesn't depend on how the files are split into batches.
+; RUN: %gold -plugin %llvmshlibdir/LLVMgold.so \
+; RUN:    --plugin-opt=emit-llvm --plugin-opt=jobs=1 \
+; RUN:    -shared %t.o %t2.o %t3.o -o %t4.o
+; RUN: llvm-dis %t4.o -o - | FileCheck %s
+; RUN: %gold -plugin %llvmshlibdir/LLVMgold.so \
+; RUN:    --plugin-opt=emit-llvm --plugin-opt=jobs=2 \
+; RUN:    -shared %t.o %t2.o %t3.o -o %t4.o
+; RUN: llvm-dis %t4.o -o - | FileCheck %s
+; RUN: %gold -plugin %llvmshlibdir/LLVMgold.so \
+; RUN:    --plugin-opt=emit-llvm --plugin-opt=jobs=3 \
+; RUN:    -shared %t.o %t2.o %t3.o -o %t4.o
+; RUN: llvm-dis %t4.o -o - | FileCheck %s
+
+target triple = "x86_64-unknown-linux-gnu"
+
+; Only used inside the link, internalized.
+; CHECK-DAG: define internal void @f1()
+define hidden void @f1() {
+  ret void
+}
+
+; CHECK-DAG: define void @f2()
+define void @f2() {
+  call void @f1()
+  call void @f3()
+  call void @g()
+  ret void
+}
+
+; The copy in b is preempted by this one and dropped, the prevailing one is
+; only referenced from the link and is internalized.
+; CHECK-DAG: define internal void @f3()
+define linkonce_odr void @f3() {
+  ret void
+}
+
+; A linkonce_odr definition prevailing over a weak_odr one of a later batch.
+; CHECK-DAG: define weak_odr void @w()
+define linkonce_odr void @w() {
+  ret void
+}
+
+; CHECK-DAG: define internal void @g()
+declare void @g()
@@ -0,0 +1,28 @@
+; RUN: llvm-as -o %t.bc %s
+; RUN: %gold -plugin %llvmshlibdir/LLVMgold.so \
+; RUN:    -m elf_x86_64 --plugin-opt=jobs=2 \
+; RUN:    --plugin-opt=obj-path=%t.o \
+; RUN:    -shared %t.bc -o %t2.o
+; RUN: llvm-nm %t.o | FileCheck --check-prefix=CHECK0 %s
+; RUN: llvm-nm %t.o.1 | FileCheck --check-prefix=CHECK1 %s
+
+target triple = "x86_64-unknown-linux-gnu"
+
+; The interleaved vtables stay in the first partition.
+; CHECK0: R _SD_ZTV1A
+; CHECK1-NOT: R _SD_ZTV1A
+@_SD_ZTV1A = constant [2 x i8*] zeroinitializer
+
+; CHECK0-NOT: bar
+; CHECK0: T foo
+; CHECK0-NOT: bar
+define void @foo() {
+  ret void
+}
+
+; CHECK1-NOT: foo
+; CHECK1: T bar
+; CHECK1-NOT: foo
+define void @bar() {
+  ret void
+}
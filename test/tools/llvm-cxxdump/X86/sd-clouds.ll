@@ -0,0 +1,98 @@
+; RUN: llvm-as %s -o %t.bc
+; RUN: llvm-cxxdump -sd-ivtbl %t.bc | FileCheck %s --check-prefix=BC
+; RUN: llvm-cxxdump -sd-ivtbl -sd-ivtbl-block-for=_ZTV1A=2 %t.bc \
+; RUN:     | FileCheck %s --check-prefix=BLOCK
+; RUN: sed -e 's/-i64:64-f80:128-n8:16:32:64/-p:32:32-f64:32:64-f80:32-n8:16:32/' \
+; RUN:     -e 's/x86_64-/i386-/' %s | llvm-as -o %t32.bc
+; RUN: llvm-cxxdump -sd-ivtbl %t32.bc | FileCheck %s --check-prefix=BC32
+; RUN: opt -passes=sd-ivtbl %s | llc -filetype=obj -o %t.o
+; RUN: llvm-cxxdump %t.o | FileCheck %s --check-prefix=OBJ
+
+; One cloud with a root A and a child B that adds a method. The sentinel
+; of the masked checks shares the prefix of the clouds but is not one.
+
+; BC:      _SD_ZTV1A[Alignment]: 8
+; BC-NEXT: _SD_ZTV1A[Size]: 56
+; BC-NEXT: _SD_ZTV1A[Slots]: 7
+; BC-NEXT: _SD_ZTV1A[Members]: 2
+; BC-NEXT: _SD_ZTV1A[0]: 0
+; BC-NEXT: _SD_ZTV1A[8]: 0
+; BC-NEXT: _SD_ZTV1A[16]: _ZTI1A
+; BC-NEXT: _SD_ZTV1A[24]: _ZTI1B
+; BC-NEXT: _SD_ZTV1A[32]: _ZN1A1fEv
+; BC-NEXT: _SD_ZTV1A[40]: _ZN1B1fEv
+; BC-NEXT: _SD_ZTV1A[48]: _ZN1B1gEv
+; BC-NEXT: _SD_ZTV1A[_ZTV1A,0][AddressPoint]: 32
+; BC-NEXT: _SD_ZTV1A[_ZTV1A,0][Range]: 32-40
+; BC-NEXT: _SD_ZTV1A[_ZTV1A,0][Padding]: 0
+; BC:      _SD_ZTV1A[_ZTV1B,0][AddressPoint]: 40
+; BC:      _SD_ZTV1A[Padding]: 0
+; BC-NEXT: _SD_ZTV1A[Relocations]: 5
+; BC-NEXT: SafeDispatch[Clouds]: 1
+; BC-NEXT: SafeDispatch[Size]: 56
+
+; The padding slot after A::f belongs to the block of A.
+; BLOCK:      _SD_ZTV1A[Alignment]: 16
+; BLOCK-NEXT: _SD_ZTV1A[Size]: 64
+; BLOCK-NEXT: _SD_ZTV1A[Slots]: 8
+; BLOCK-NEXT: _SD_ZTV1A[Members]: 2
+; BLOCK:      _SD_ZTV1A[_ZTV1A,0][AddressPoint]: 32
+; BLOCK-NEXT: _SD_ZTV1A[_ZTV1A,0][Range]: 32-48
+; BLOCK-NEXT: _SD_ZTV1A[_ZTV1A,0][Padding]: 1
+; BLOCK:      _SD_ZTV1A[_ZTV1B,0][AddressPoint]: 48
+; BLOCK-NEXT: _SD_ZTV1A[_ZTV1B,0][Range]: 48-48
+; BLOCK-NEXT: _SD_ZTV1A[_ZTV1B,0][Padding]: 0
+; BLOCK:      _SD_ZTV1A[Padding]: 1
+
+; Slots are pointer sized.
+; BC32:      _SD_ZTV1A[Size]: 28
+; BC32-NEXT: _SD_ZTV1A[Slots]: 7
+; BC32:      _SD_ZTV1A[24]: _ZN1B1gEv
+; BC32:      _SD_ZTV1A[_ZTV1A,0][AddressPoint]: 16
+; BC32-NEXT: _SD_ZTV1A[_ZTV1A,0][Range]: 16-20
+
+; OBJ-NOT:  _SD_sentinel
+; OBJ:      _SD_ZTV1A[0]: 0
+; OBJ-NEXT: _SD_ZTV1A[8]: 0
+; OBJ-NEXT: _SD_ZTV1A[16]: _ZTI1A
+; OBJ-NEXT: _SD_ZTV1A[24]: _ZTI1B
+; OBJ-NEXT: _SD_ZTV1A[32]: _ZN1A1fEv
+; OBJ-NEXT: _SD_ZTV1A[40]: _ZN1B1fEv
+; OBJ-NEXT: _SD_ZTV1A[48]: _ZN1B1gEv
+; OBJ-NOT:  _SD_sentinel
+; OBJ:      _SD_ZTV1A[Size]: 56
+; OBJ-NEXT: _SD_ZTV1A[Slots]: 7
+; OBJ-NEXT: _SD_ZTV1A[TypeInfos]: 2
+; OBJ-NEXT: _SD_ZTV1A[NullSlots]: 2
+; OBJ-NEXT: _SD_ZTV1A[Relocations]: 5
+; OBJ-NEXT: SafeDispatch[Clouds]: 1
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+%struct.A = type { i32 (...)** }
+
+@_ZTI1A = external constant i8*
+@_ZTI1B = external constant i8*
+
+@_ZTV1A = linkonce_odr unnamed_addr constant [3 x i8*] [i8* null, i8* bitcast (i8** @_ZTI1A to i8*), i8* bitcast (void (%struct.A*)* @_ZN1A1fEv to i8*)], align 8
+@_ZTV1B = linkonce_odr unnamed_addr constant [4 x i8*] [i8* null, i8* bitcast (i8** @_ZTI1B to i8*), i8* bitcast (void (%struct.A*)* @_ZN1B1fEv to i8*), i8* bitcast (void (%struct.A*)* @_ZN1B1gEv to i8*)], align 8
+@_SD_sentinel = constant [2 x i8*] zeroinitializer, align 8
+
+define linkonce_odr void @_ZN1A1fEv(%struct.A* %this) {
+  ret void
+}
+
+define linkonce_odr void @_ZN1B1fEv(%struct.A* %this) {
+  ret void
+}
+
+define linkonce_odr void @_ZN1B1gEv(%struct.A* %this) {
+  ret void
+}
+
+!sd.class_info._ZTV1A = !{!0}
+!sd.class_info._ZTV1B = !{!1}
+
+!0 = !{!"_ZTV1A", [3 x i8*]* @_ZTV1A, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 2, i64 2, i64 1, i64 0, i64 0], !"", null}
+!1 = !{!"_ZTV1B", [4 x i8*]* @_ZTV1B, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 3, i64 2, i64 1, i64 0, i64 0], !"_ZTV1A", [3 x i8*]* @_ZTV1A}
@@ -0,0 +1,29 @@
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+%struct.B = type { i32 (...)** }
+
+@_ZTV1B = linkonce_odr unnamed_addr constant [5 x i8*] [i8* null, i8* null, i8* null, i8* bitcast (void (%struct.B*)* @_ZN1A1fEv to i8*), i8* bitcast (void (%struct.B*)* @_ZTv0_n24_N1B1gEv to i8*)], align 8
+
+define linkonce_odr void @_ZTv0_n24_N1B1gEv(%struct.B* %this) {
+  %1 = bitcast %struct.B* %this to i8**
+  %vtable = load i8*, i8** %1, align 8
+  %index = call i64 @llvm.sd.get.vcall.index(i64 -24)
+  %2 = getelementptr inbounds i8, i8* %vtable, i64 %index
+  %3 = bitcast i8* %2 to i64*
+  %offset = load i64, i64* %3, align 8
+  %4 = bitcast %struct.B* %this to i8*
+  %5 = getelementptr inbounds i8, i8* %4, i64 %offset
+  %6 = bitcast i8* %5 to %struct.B*
+  tail call void @_ZN1B1gEv(%struct.B* %6)
+  ret void
+}
+
+declare void @_ZN1A1fEv(%struct.B*)
+declare void @_ZN1B1gEv(%struct.B*)
+declare i64 @llvm.sd.get.vcall.index(i64)
+
+!sd.class_info._ZTV1B = !{!0}
+
+; a single sub-vtable with a vcall offset in front of the offset to top
+!0 = !{!"_ZTV1B", [5 x i8*]* @_ZTV1B, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 4, i64 3, i64 1, i64 0, i64 0], !"_ZTV1A", null}
@@ -0,0 +1,35 @@
+; RUN: rm -rf %t && mkdir -p %t
+; RUN: llvm-as %s -o %t/c.bc
+; RUN: llvm-sdlayout -apply -sd-layout=%p/Inputs/apply-inds.sdlayout %t/c.bc
+; RUN: llvm-dis %t/c.bc.sd -o - | FileCheck %s
+; RUN: not llvm-sdlayout -apply -sd-layout=%p/Inputs/bad-inds.sdlayout %t/c.bc 2>&1 \
+; RUN:   | FileCheck -check-prefix=BAD %s
+
+; The vtable indices come from the inds lines of the layout file.
+
+; CHECK-LABEL: define i64 @f_index(
+; CHECK-NEXT: ret i64 0
+; CHECK-LABEL: define i64 @g_index(
+; CHECK-NEXT: ret i64 3
+
+; An index map has to follow the sub-vtable it belongs to.
+; BAD: Could not parse SD layout {{.*}}bad-inds.sdlayout: malformed line 3: inds _ZTV1C 0 2 -6 -3 0 3
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define i64 @f_index() {
+  %1 = call i64 @llvm.sd.get.vtbl.index(i64 0, metadata !0)
+  ret i64 %1
+}
+
+define i64 @g_index() {
+  %1 = call i64 @llvm.sd.get.vtbl.index(i64 1, metadata !0)
+  ret i64 %1
+}
+
+declare i64 @llvm.sd.get.vtbl.index(i64, metadata)
+
+!0 = !{!1, !2}
+!1 = !{!"_ZTV1C"}
+!2 = !{null}
@@ -0,0 +1,39 @@
+; RUN: rm -rf %t && mkdir -p %t
+; RUN: llvm-as %s -o %t/c.bc
+; RUN: llvm-sdlayout -apply -sd-layout=%p/Inputs/apply-inds.sdlayout %t/c.bc
+; RUN: llvm-dis %t/c.bc.sd -o - | FileCheck %s
+
+; The layout moves index 1 of C to 3, the sentinel vtable of the checked vptr
+; has to cover the translated index and not the one the module was built with.
+
+; CHECK: @_SD_sentinel = internal unnamed_addr constant [6 x i8*]
+
+; CHECK-LABEL: define void @call_g(
+; CHECK: select i1 %{{.*}}, i8* %{{.*}}, i8* bitcast (i8** getelementptr inbounds ([6 x i8*], [6 x i8*]* @_SD_sentinel, i64 0, i64 2) to i8*)
+; CHECK: mul i64 3, 8
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+%struct.C = type { i32 (...)** }
+
+define void @call_g(%struct.C* %c) {
+  %1 = bitcast %struct.C* %c to i8**
+  %vtable = load i8*, i8** %1, align 8
+  %checked = call i8* @llvm.sd.get.checked.vptr(i8* %vtable, metadata !0)
+  %index = call i64 @llvm.sd.get.vtbl.index(i64 1, metadata !3)
+  %offset = mul i64 %index, 8
+  %2 = getelementptr inbounds i8, i8* %checked, i64 %offset
+  %3 = bitcast i8* %2 to void (%struct.C*)**
+  %4 = load void (%struct.C*)*, void (%struct.C*)** %3, align 8
+  call void %4(%struct.C* %c)
+  ret void
+}
+
+declare i8* @llvm.sd.get.checked.vptr(i8*, metadata)
+declare i64 @llvm.sd.get.vtbl.index(i64, metadata)
+
+!0 = !{!1, !2, !1, !2}
+!1 = !{!"_ZTV1C"}
+!2 = !{null}
+!3 = !{!1, !2}
@@ -0,0 +1,86 @@
+; RUN: rm -rf %t && mkdir -p %t
+; RUN: llvm-as %s -o %t/a.bc
+; RUN: llvm-as %p/Inputs/round-trip-b.ll -o %t/b.bc
+; RUN: llvm-sdlayout -summarize %t/a.bc %t/b.bc
+; RUN: llvm-sdlayout -link -sd-ivtbl -sd-layout=%t/app.sdlayout %t/a.bc.sdsum %t/b.bc.sdsum -o %t/vtables.bc
+; RUN: FileCheck -check-prefix=LAYOUT %s < %t/app.sdlayout
+; RUN: llvm-dis %t/vtables.bc -o %t/vtables.ll
+; RUN: cat %t/app.sdlayout %t/vtables.ll | FileCheck -check-prefix=VTABLES %s
+; RUN: llvm-sdlayout -apply -sd-layout=%t/app.sdlayout %t/a.bc %t/b.bc
+; RUN: llvm-dis %t/a.bc.sd -o %t/a.ll
+; RUN: cat %t/app.sdlayout %t/a.ll | FileCheck -check-prefix=APPLY %s
+; RUN: llvm-sdlayout -apply -sd-layout=%t/app.sdlayout -j 2 %t/a.bc %t/b.bc 2>&1 \
+; RUN:   | FileCheck -check-prefix=JOBS %s
+; RUN: llvm-dis %t/a.bc.sd -o - | cat %t/app.sdlayout - | FileCheck -check-prefix=APPLY %s
+
+; The layout file has the old to new index map of every sub-vtable, the
+; modules are rewritten with it instead of recomputing the layout. The layout
+; file is checked along with the modules to match the sizes and offsets.
+
+; LAYOUT: cloud _ZTV1A {{[0-9]+}} {{[0-9]+}}
+; LAYOUT: vtbl _ZTV1A 0 1 2 _ZTV1A {{[0-9]+}} 2 _ZTV1A
+; LAYOUT: vtbl _ZTV1B 0 1 3 _ZTV1A {{[0-9]+}} 1 _ZTV1A
+; LAYOUT: inds _ZTV1A 0 2 -2 -1 0 1
+; LAYOUT: inds _ZTV1B 0 3 -3 -2 -1 0 1
+
+; The virtual thunk of B is cloned, named after the cloud, with the vcall
+; offset of the new layout. The original one is only defined in its own
+; module.
+; VTABLES: cloud _ZTV1A {{[0-9]+}} [[SIZE:[0-9]+]]
+; VTABLES: @_SD_ZTV1A = hidden unnamed_addr constant {{\[}}[[SIZE]] x i8*]
+; VTABLES-SAME: @_SVT_ZTV1A_ZTv0_n24_N1B1gEv
+; VTABLES-NOT: define {{.*}} @_ZTv0_n24_N1B1gEv(
+; VTABLES: define linkonce_odr void @_SVT_ZTV1A_ZTv0_n24_N1B1gEv(
+; VTABLES-NOT: @llvm.sd.get.vcall.index
+; VTABLES: getelementptr inbounds i8, i8* %{{.*}}, i64 -24
+; VTABLES: tail call void @_ZN1B1gEv(
+
+; The workers of -j share the layout, it is only parsed once.
+; JOBS: Read layout of 1 clouds and 2 vtables from
+; JOBS-NOT: Read layout
+
+; APPLY: cloud _ZTV1A [[ALIGN:[0-9]+]] [[SIZE:[0-9]+]]
+; APPLY: vtbl _ZTV1A 0 1 2 _ZTV1A [[START:[0-9]+]] 2 _ZTV1A
+; APPLY-NOT: @_ZTV1A =
+; APPLY: @_SD_ZTV1A = external hidden constant {{\[}}[[SIZE]] x i8*], align [[ALIGN]]
+
+; APPLY-LABEL: define void @_ZN1AC2Ev(
+; APPLY: store i32 (...)** bitcast (i8** getelementptr inbounds ({{\[}}[[SIZE]] x i8*], {{\[}}[[SIZE]] x i8*]* @_SD_ZTV1A, i64 0, i64 [[START]]) to i32 (...)**)
+
+; APPLY-LABEL: define i64 @g_index(
+; APPLY-NEXT: ret i64 1
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+%struct.A = type { i32 (...)** }
+
+@_ZTV1A = linkonce_odr unnamed_addr constant [4 x i8*] [i8* null, i8* null, i8* bitcast (void (%struct.A*)* @_ZN1A1fEv to i8*), i8* bitcast (void (%struct.A*)* @_ZN1A1gEv to i8*)], align 8
+
+define void @_ZN1AC2Ev(%struct.A* %this) {
+  %1 = getelementptr inbounds %struct.A, %struct.A* %this, i64 0, i32 0
+  store i32 (...)** bitcast (i8** getelementptr inbounds ([4 x i8*], [4 x i8*]* @_ZTV1A, i64 0, i64 2) to i32 (...)**), i32 (...)*** %1, align 8
+  ret void
+}
+
+define i64 @g_index() {
+  %1 = call i64 @llvm.sd.get.vtbl.index(i64 1, metadata !1)
+  ret i64 %1
+}
+
+define linkonce_odr void @_ZN1A1fEv(%struct.A* %this) {
+  ret void
+}
+
+define linkonce_odr void @_ZN1A1gEv(%struct.A* %this) {
+  ret void
+}
+
+declare i64 @llvm.sd.get.vtbl.index(i64, metadata)
+
+!sd.class_info._ZTV1A = !{!0}
+
+!0 = !{!"_ZTV1A", [4 x i8*]* @_ZTV1A, [9 x i64] [i64 1, i64 2, i64 0, i64 0, i64 3, i64 2, i64 1, i64 0, i64 0], !"", null}
+!1 = !{!2, !3}
+!2 = !{!"_ZTV1A"}
+!3 = !{[4 x i8*]* @_ZTV1A}
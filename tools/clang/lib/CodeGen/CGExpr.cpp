@@ -65,6 +65,7 @@ void CodeGenFunction::InitTempAlloca(llvm::AllocaInst *Var,
   auto *Store = new llvm::StoreInst(Init, Var);
   llvm::BasicBlock *Block = AllocaInsertPt->getParent();
   Block->getInstList().insertAfter(&*AllocaInsertPt, Store);
+  CGM.recordSDMemPtrUser(Store);
 }
 
 llvm::AllocaInst *CodeGenFunction::CreateIRTemp(QualType Ty,
@@ -29,7 +29,7 @@
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/ADT/APInt.h"
-#include "llvm/Transforms/IPO/SafeDispatchMD.h"
+#include "llvm/IR/SafeDispatchMD.h"
 #include "llvm/Transforms/IPO/SafeDispatchTools.h"
 #include "llvm/Transforms/IPO/SafeDispatchVtblMD.h"
 
@@ -185,6 +185,11 @@ void CodeGenFunction::GenerateVarArgsThunk(
   Fn->eraseFromParent();
   Fn = NewFn;
 
+  // the clone does not go through the IRBuilder
+  for (llvm::BasicBlock &BB : *Fn)
+    for (llvm::Instruction &I : BB)
+      CGM.recordSDMemPtrUser(&I);
+
   // "Initialize" CGF (minimally).
   CurFn = Fn;
 
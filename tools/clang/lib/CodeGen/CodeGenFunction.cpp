@@ -1753,6 +1753,7 @@ void CodeGenFunction::InsertHelper(llvm::Instruction *I,
   LoopStack.InsertHelper(I);
   if (IsSanitizerScope)
     CGM.getSanitizerMetadata()->disableSanitizerForInstruction(I);
+  CGM.recordSDMemPtrUser(I);
 }
 
 template <bool PreserveNames>
@@ -682,7 +682,7 @@ public:
   void setBeforeOutermostConditional(llvm::Value *value, llvm::Value *addr) {
     assert(isInConditionalBranch());
     llvm::BasicBlock *block = OutermostConditional->getStartingBlock();
-    new llvm::StoreInst(value, addr, &block->back());    
+    CGM.recordSDMemPtrUser(new llvm::StoreInst(value, addr, &block->back()));
   }
 
   /// An RAII object to record that we're evaluating a statement
@@ -348,33 +348,11 @@ void InstrProfStats::reportDiagnostics(DiagnosticsEngine &Diags,
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Instructions.h"
 
-#include "llvm/Transforms/IPO/SafeDispatchMD.h"
+#include "llvm/IR/SafeDispatchMD.h"
 #include "llvm/Transforms/IPO/SafeDispatchGVMd.h"
 
 #include <vector>
 
-template <class T>
-T sd_fold(llvm::User* u, T (*callback)(T, unsigned, llvm::Value*), T def, std::set<llvm::User*>& seenUsers) {
-  if(seenUsers.count(u))
-    return def;
-  seenUsers.insert(u);
-
-  T next = def;
-  assert(u);
-  for(unsigned i=0; i < u->getNumOperands(); i++) {
-    llvm::Value* op = u->getOperand(i);
-    assert(op);
-
-    next = callback(next, i, op);
-
-    llvm::User* uOp = llvm::dyn_cast<llvm::User>(op);
-    if (uOp && ! llvm::dyn_cast<llvm::Instruction>(op)) {
-      next = sd_fold(uOp, callback, next, seenUsers);
-    }
-  }
-  return next;
-}
-
 template <class ArgT>
 using sd_map_callback_t = llvm::User* (*)(llvm::User* root, std::vector<llvm::Value*> children, ArgT);
 
@@ -385,7 +363,8 @@ llvm::User* sd_map(llvm::User* u, sd_map_callback_t<ArgT> callback, ArgT arg) {
     llvm::Value* op = u->getOperand(i);
     llvm::User* child = dyn_cast_or_null<llvm::User>(op);
 
-    if (!child) {
+    // global initializers are never unfolded into instructions
+    if (!child || isa<llvm::GlobalValue>(child)) {
       children.push_back(op);
     } else {
       children.push_back(sd_map<ArgT>(child, callback, arg));
@@ -395,14 +374,45 @@ llvm::User* sd_map(llvm::User* u, sd_map_callback_t<ArgT> callback, ArgT arg) {
   return callback(u, children, arg);
 }
 
-bool sd_ismemptr(bool isMemptr, unsigned ind, llvm::Value* val) {
-  return isMemptr || (llvm::dyn_cast_or_null<llvm::ConstantMemberPointer>(val) != NULL);
+bool sd_contains_memptr(llvm::Constant* c, CodeGenModule::SDMemPtrCacheTy& cache) {
+  if (isa<llvm::ConstantMemberPointer>(c))
+    return true;
+
+  // global initializers are never unfolded into instructions
+  if (isa<llvm::GlobalValue>(c))
+    return false;
+
+  auto itr = cache.find(c);
+  if (itr != cache.end())
+    return itr->second;
+
+  bool containsMemptr = false;
+  for (unsigned i = 0; i < c->getNumOperands() && !containsMemptr; i++) {
+    containsMemptr = sd_contains_memptr(cast<llvm::Constant>(c->getOperand(i)), cache);
+  }
+
+  cache[c] = containsMemptr;
+  return containsMemptr;
 }
 
-bool sd_contains_memptr(llvm::User* c) {
-  std::set<llvm::User*> seenUsers;
-  return  ((llvm::dyn_cast_or_null<llvm::ConstantMemberPointer>(c) != NULL) ||
-          sd_fold<bool>(c, sd_ismemptr, false, seenUsers));
+void CodeGenModule::recordSDMemPtrUser(llvm::Instruction *I) {
+  if (!getCodeGenOpts().EmitIVTBL)
+    return;
+
+  // phi operands are only added after the phi is inserted, so check them
+  // when rewriting
+  if (isa<llvm::PHINode>(I)) {
+    SDMemPtrUsers.push_back(I);
+    return;
+  }
+
+  for (unsigned i = 0; i < I->getNumOperands(); i++) {
+    llvm::Constant* op = dyn_cast_or_null<llvm::Constant>(I->getOperand(i));
+    if (op && sd_contains_memptr(op, SDMemPtrCache)) {
+      SDMemPtrUsers.push_back(I);
+      return;
+    }
+  }
 }
 
 struct sd_unfold_map_cb_arg_t {
@@ -492,14 +502,9 @@ llvm::User* sd_unfold_map_cb(llvm::User* root,
         }
         }
     } else if (gv = dyn_cast<llvm::GlobalValue>(rootConst)) {
-      if (sd_contains_memptr(rootConst)) {
-        rootConst->dump();
-        return rootConst;
-      }
-      //assert(!sd_contains_memptr(rootConst) && "NYI Global Values");
       return rootConst;
     } else if (cv = dyn_cast<llvm::ConstantVector>(rootConst)) {
-      assert(!sd_contains_memptr(rootConst) && "NYI Constant Vector");
+      assert(!sd_contains_memptr(rootConst, arg.CGM.getSDMemPtrCache()) && "NYI Constant Vector");
       return rootConst;
     } else if (dyn_cast<llvm::ConstantStruct>(rootConst) ||
                dyn_cast<llvm::ConstantArray>(rootConst)) {
@@ -514,10 +519,10 @@ llvm::User* sd_unfold_map_cb(llvm::User* root,
       }
       return newStruct;
     } else if (cds = dyn_cast<llvm::ConstantDataSequential>(rootConst)) {
-      assert(!sd_contains_memptr(rootConst) && "ConstantDataSequentual NYI");
+      assert(!sd_contains_memptr(rootConst, arg.CGM.getSDMemPtrCache()) && "ConstantDataSequentual NYI");
       return rootConst;
     } else {
-      assert(!sd_contains_memptr(rootConst) && "Unkown Constant Type");
+      assert(!sd_contains_memptr(rootConst, arg.CGM.getSDMemPtrCache()) && "Unkown Constant Type");
       return rootConst;
     }
   } else {
@@ -532,24 +537,31 @@ llvm::User* sd_unfold_map_cb(llvm::User* root,
 
 static void
 sd_rewriteMPtrToIntrinsics(llvm::Module& M, CodeGenModule &CGM) {
-  for(llvm::Module::iterator f_itr = M.begin(); f_itr != M.end(); f_itr++) {
-    llvm::Function* f = f_itr;
-    for(llvm::Function::iterator bb_itr = f->begin(); bb_itr != f->end(); bb_itr++) {
-      llvm::BasicBlock* bb = bb_itr;
-      for(llvm::BasicBlock::iterator i_itr = bb->begin(); i_itr != bb->end(); i_itr++) {
-        llvm::Instruction* inst = i_itr;
-        assert(inst);
-
-        for(unsigned i=0; i < inst->getNumOperands(); i++) {
-          llvm::User* arg = dyn_cast<llvm::User>(inst->getOperand(i));
-          if (arg && sd_contains_memptr(arg)) {
-            sd_unfold_map_cb_arg_t unfold_arg = {M, CGM, inst};
-            inst->setOperand(i, sd_map<sd_unfold_map_cb_arg_t&>(arg, sd_unfold_map_cb, unfold_arg));
-          }
-        }
+  std::vector<llvm::WeakVH>& users = CGM.getSDMemPtrUsers();
+  CodeGenModule::SDMemPtrCacheTy& cache = CGM.getSDMemPtrCache();
+
+  for (unsigned u = 0; u < users.size(); u++) {
+    // the instruction might have been erased since it was emitted
+    llvm::Instruction* inst = dyn_cast_or_null<llvm::Instruction>(users[u]);
+    if (!inst || !inst->getParent())
+      continue;
+
+    llvm::PHINode* phi = dyn_cast<llvm::PHINode>(inst);
+
+    for(unsigned i=0; i < inst->getNumOperands(); i++) {
+      llvm::Constant* arg = dyn_cast<llvm::Constant>(inst->getOperand(i));
+      if (arg && sd_contains_memptr(arg, cache)) {
+        // unfolded phi operands have to live in the incoming block
+        llvm::Instruction* insertPos =
+          phi ? phi->getIncomingBlock(i)->getTerminator() : inst;
+        sd_unfold_map_cb_arg_t unfold_arg = {M, CGM, insertPos};
+        inst->setOperand(i, sd_map<sd_unfold_map_cb_arg_t&>(arg, sd_unfold_map_cb, unfold_arg));
       }
     }
   }
+
+  users.clear();
+  cache.clear();
 }
 
 void CodeGenModule::Release() {
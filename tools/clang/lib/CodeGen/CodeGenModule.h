@@ -33,6 +33,7 @@
 #include "llvm/IR/CallingConv.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/ValueHandle.h"
+#include "llvm/IR/ValueMap.h"
 
 namespace llvm {
 class Module;
@@ -487,6 +488,17 @@ private:
   llvm::DenseMap<const Decl *, bool> DeferredEmptyCoverageMappingDecls;
 
   std::unique_ptr<CoverageMappingModuleGen> CoverageMapping;
+
+public:
+  /// SafeDispatch: memoized result of sd_contains_memptr for each constant.
+  typedef llvm::ValueMap<llvm::Constant *, bool> SDMemPtrCacheTy;
+
+private:
+  /// SafeDispatch: instructions that received a member pointer constant when
+  /// they were emitted. Release() rewrites only these to intrinsics.
+  std::vector<llvm::WeakVH> SDMemPtrUsers;
+  SDMemPtrCacheTy SDMemPtrCache;
+
 public:
   CodeGenModule(ASTContext &C, const CodeGenOptions &CodeGenOpts,
                 llvm::Module &M, const llvm::DataLayout &TD,
@@ -500,6 +512,15 @@ public:
   /// Finalize LLVM code generation.
   void Release();
 
+  /// SafeDispatch: remember \p I if one of its operands is a member pointer
+  /// constant that has to be rewritten in Release(). Called for everything
+  /// the IRBuilder inserts, and by the code that creates or clones
+  /// instructions without it.
+  void recordSDMemPtrUser(llvm::Instruction *I);
+
+  std::vector<llvm::WeakVH> &getSDMemPtrUsers() { return SDMemPtrUsers; }
+  SDMemPtrCacheTy &getSDMemPtrCache() { return SDMemPtrCache; }
+
   /// Return a reference to the configured Objective-C runtime.
   CGObjCRuntime &getObjCRuntime() {
     if (!ObjCRuntime) createObjCRuntime();
@@ -37,7 +37,7 @@
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Instructions.h"
 
-#include "llvm/Transforms/IPO/SafeDispatchMD.h"
+#include "llvm/IR/SafeDispatchMD.h"
 #include "llvm/Transforms/IPO/SafeDispatchTools.h"
 #include "llvm/Transforms/IPO/SafeDispatchVtblMD.h"
 #include <vector>
@@ -1719,6 +1719,38 @@ sd_getCheckedVTable(CodeGenModule &CGM, CodeGenFunction &CGF, const CXXMethodDec
   return VTableAP;
 }
 
+/**
+ * Branchless variant of sd_getCheckedVTable: the returned vptr is replaced
+ * with a sentinel vtable at link time when it fails the range check.
+ */
+static llvm::Value*
+sd_getMaskedVTable(CodeGenModule &CGM, CodeGenFunction &CGF, const CXXMethodDecl *MD, llvm::Value *VTableAP, const CXXRecordDecl *perciseType) {
+  const CXXRecordDecl* RD = MD->getParent();
+  llvm::GlobalVariable* VTable = sd_needGlobalVar(&CGM.getCXXABI(), RD) ?
+              CGM.getCXXABI().getAddrOfVTable(RD, CharUnits()) :
+              NULL;
+
+  llvm::Module& M = CGM.getModule();
+  llvm::LLVMContext& C = M.getContext();
+
+  std::string Name = CGM.getCXXABI().GetClassMangledName(RD);
+  std::string perciseName = perciseType ?
+    CGM.getCXXABI().GetClassMangledName(perciseType) : Name;
+
+  // (class name, vtable) followed by the (class name, vtable) of the precise type
+  sd_class_md_t md = sd_getClassNameMetadataPair(Name, M, VTable);
+  sd_class_md_t perciseMD = perciseName == Name ? md :
+    sd_getClassNameMetadataPair(perciseName, M, NULL);
+  llvm::Metadata* tuple[] = {md.first, md.second, perciseMD.first, perciseMD.second};
+
+  llvm::Value* checkedVptr = CGF.Builder.CreateCall2(
+              CGM.getIntrinsic(llvm::Intrinsic::sd_get_checked_vptr),
+              CGF.Builder.CreatePointerCast(VTableAP, CGM.Int8PtrTy),
+              llvm::MetadataAsValue::get(C, llvm::MDTuple::get(C, tuple)));
+
+  return CGF.Builder.CreateBitCast(checkedVptr, VTableAP->getType());
+}
+
 llvm::Value *ItaniumCXXABI::getVirtualFunctionPointer(CodeGenFunction &CGF,
                                                       GlobalDecl GD,
                                                       llvm::Value *This,
@@ -1736,7 +1768,10 @@ llvm::Value *ItaniumCXXABI::getVirtualFunctionPointer(CodeGenFunction &CGF,
   std::string Name = this->GetClassMangledName(RD);
 
   if (CGM.getCodeGenOpts().EmitVTBLChecks && sd_isVtableName(Name)) {
-    VTable = sd_getCheckedVTable(CGM, CGF, MD, VTable, perciseType);
+    if (CGM.getCodeGenOpts().EmitVTBLMaskedChecks)
+      VTable = sd_getMaskedVTable(CGM, CGF, MD, VTable, perciseType);
+    else
+      VTable = sd_getCheckedVTable(CGM, CGF, MD, VTable, perciseType);
   }
 
   if (CGF.SanOpts.has(SanitizerKind::CFIVCall))
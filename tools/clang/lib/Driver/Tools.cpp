@@ -3762,6 +3762,15 @@ void Clang::ConstructJob(Compilation &C, const JobAction &JA,
   if (Args.hasArg(options::OPT_femit_vtbl_checks))
     CmdArgs.push_back("-femit-vtbl-checks");
 
+  // the masked checks replace the regular ones, there is nothing to mask
+  // without them
+  if (Arg *A = Args.getLastArg(options::OPT_femit_vtbl_masked_checks)) {
+    if (!Args.hasArg(options::OPT_femit_vtbl_checks))
+      D.Diag(diag::err_drv_argument_only_allowed_with)
+        << A->getAsString(Args) << "-femit-vtbl-checks";
+    CmdArgs.push_back("-femit-vtbl-masked-checks");
+  }
+
   if (Args.hasArg(options::OPT_femit_ivtbl))
     CmdArgs.push_back("-femit-ivtbl");
 
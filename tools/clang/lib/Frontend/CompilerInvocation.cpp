@@ -644,6 +644,7 @@ static bool ParseCodeGenArgs(CodeGenOptions &Opts, ArgList &Args, InputKind IK,
                       Opts.SanitizeRecover);
 
   Opts.EmitVTBLChecks = Args.hasArg(OPT_femit_vtbl_checks);
+  Opts.EmitVTBLMaskedChecks = Args.hasArg(OPT_femit_vtbl_masked_checks);
   Opts.EmitIVTBL = Args.hasArg(OPT_femit_ivtbl);
 
   return Success;
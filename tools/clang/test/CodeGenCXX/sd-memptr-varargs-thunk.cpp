@@ -0,0 +1,28 @@
+// RUN: %clang_cc1 %s -triple=x86_64-pc-linux-gnu -femit-ivtbl -emit-llvm -o - | FileCheck %s
+
+// Varargs thunks are clones of the function they adjust, the member pointer
+// in the cloned body has to be rewritten too.
+
+struct A {
+  virtual void a();
+};
+struct B {
+  virtual void f(int x, ...);
+};
+struct C : A, B {
+  virtual void c();
+  virtual void f(int x, ...);
+};
+
+void C::f(int x, ...) {
+  void (C::*p)() = &C::c;
+  (this->*p)();
+}
+
+// CHECK-LABEL: define void @_ZN1C1fEiz(
+// CHECK: call i64 @llvm.sd.get.vtbl.index(i64 {{[0-9]+}}, metadata ![[C:[0-9]+]])
+// CHECK: ret void
+
+// CHECK-LABEL: define void @_ZThn8_N1C1fEiz(
+// CHECK: call i64 @llvm.sd.get.vtbl.index(i64 {{[0-9]+}}, metadata ![[C]])
+// CHECK: ret void
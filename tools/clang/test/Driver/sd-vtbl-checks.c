@@ -0,0 +1,10 @@
+// RUN: %clang -### -c -femit-vtbl-checks -femit-vtbl-masked-checks %s 2>&1 \
+// RUN:   | FileCheck -check-prefix=CHECK-MASKED %s
+// CHECK-MASKED: "-cc1"
+// CHECK-MASKED: "-femit-vtbl-checks"
+// CHECK-MASKED: "-femit-vtbl-masked-checks"
+
+// Masked checks only change how the vtable checks are emitted.
+// RUN: %clang -### -c -femit-vtbl-masked-checks %s 2>&1 \
+// RUN:   | FileCheck -check-prefix=CHECK-NO-CHECKS %s
+// CHECK-NO-CHECKS: error: invalid argument '-femit-vtbl-masked-checks' only allowed with '-femit-vtbl-checks'
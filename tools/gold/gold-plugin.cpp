@@ -20,6 +20,7 @@
 #include "llvm/Bitcode/ReaderWriter.h"
 #include "llvm/CodeGen/Analysis.h"
 #include "llvm/CodeGen/CommandFlags.h"
+#include "llvm/CodeGen/ParallelCG.h"
 #include "llvm/IR/AutoUpgrade.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DiagnosticInfo.h"
@@ -37,8 +38,10 @@
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Transforms/IPO.h"
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/IPO/SafeDispatchTools.h"
 #include "llvm/Transforms/Utils/GlobalStatus.h"
 #include "llvm/Transforms/Utils/ModuleUtils.h"
 #include "llvm/Transforms/Utils/ValueMapper.h"
@@ -60,6 +63,26 @@ struct claimed_file {
   void *handle;
   std::vector<ld_plugin_symbol> syms;
 };
+
+/// Names whose linkage is fixed up once all the claimed files are linked.
+struct linkage_fixups {
+  StringSet<> Internalize;
+  StringSet<> Maybe;
+  // Names a preempted copy removed from Maybe, replayed when merging.
+  StringSet<> NotMaybe;
+};
+
+/// A contiguous slice of the claimed files that is loaded and linked on its
+/// own thread and in its own context (see loadBatch).
+struct load_batch {
+  std::vector<claimed_file *> Files;
+  std::vector<MemoryBufferRef> Buffers;
+  linkage_fixups Fixups;
+  SmallVector<char, 0> Bitcode;
+  std::vector<std::pair<ld_plugin_level, std::string>> Diagnostics;
+  // Fatal error of the batch, reported once it is back on the main thread.
+  std::string Error;
+};
 }
 
 static ld_plugin_status discard_message(int level, const char *format, ...) {
@@ -105,6 +128,9 @@ namespace options {
 
   static bool RunSDIVTBLPass = false;
   static bool RunSDOVTBLPass = false;
+  // Number of threads loading the claimed files and of partitions code
+  // generated in parallel.
+  static unsigned Parallelism = 1;
 
   static void process_plugin_option(const char* opt_)
   {
@@ -128,6 +154,9 @@ namespace options {
       RunSDIVTBLPass = true;
     } else if (opt == "sd-ovtbl") {
       RunSDOVTBLPass = true;
+    } else if (opt.startswith("jobs=")) {
+      if (StringRef(opt_ + 5).getAsInteger(10, Parallelism) || !Parallelism)
+        message(LDPL_FATAL, "Invalid parallelism level: %s", opt_ + 5);
     } else if (opt == "save-temps") {
       TheOutputType = OT_SAVE_TEMPS;
     } else if (opt == "disable-output") {
@@ -285,25 +314,24 @@ static bool shouldSkip(uint32_t Symflags) {
   return false;
 }
 
-static void diagnosticHandler(const DiagnosticInfo &DI, void *Context) {
+/// Text and level gold should report DI with, false if DI is ignored.
+static bool formatDiagnostic(const DiagnosticInfo &DI, ld_plugin_level &Level,
+                             std::string &ErrStorage) {
   if (const auto *BDI = dyn_cast<BitcodeDiagnosticInfo>(&DI)) {
     std::error_code EC = BDI->getError();
     if (EC == BitcodeError::InvalidBitcodeSignature)
-      return;
+      return false;
   }
 
-  std::string ErrStorage;
   {
     raw_string_ostream OS(ErrStorage);
     DiagnosticPrinterRawOStream DP(OS);
     DI.print(DP);
   }
-  ld_plugin_level Level;
   switch (DI.getSeverity()) {
   case DS_Error:
-    message(LDPL_FATAL, "LLVM gold plugin has failed to create LTO module: %s",
-            ErrStorage.c_str());
-    llvm_unreachable("Fatal doesn't return.");
+    Level = LDPL_FATAL;
+    break;
   case DS_Warning:
     Level = LDPL_WARNING;
     break;
@@ -312,7 +340,33 @@ static void diagnosticHandler(const DiagnosticInfo &DI, void *Context) {
     Level = LDPL_INFO;
     break;
   }
-  message(Level, "LLVM gold plugin: %s",  ErrStorage.c_str());
+  return true;
+}
+
+static void reportDiagnostic(ld_plugin_level Level, const std::string &Msg) {
+  if (Level == LDPL_FATAL) {
+    message(LDPL_FATAL, "LLVM gold plugin has failed to create LTO module: %s",
+            Msg.c_str());
+    llvm_unreachable("Fatal doesn't return.");
+  }
+  message(Level, "LLVM gold plugin: %s", Msg.c_str());
+}
+
+static void diagnosticHandler(const DiagnosticInfo &DI, void *Context) {
+  ld_plugin_level Level;
+  std::string ErrStorage;
+  if (formatDiagnostic(DI, Level, ErrStorage))
+    reportDiagnostic(Level, ErrStorage);
+}
+
+/// Diagnostic handler of the batch contexts. gold's callbacks are not thread
+/// safe, so the diagnostics are reported once the batch is done.
+static void batchDiagnosticHandler(const DiagnosticInfo &DI, void *Context) {
+  load_batch &B = *static_cast<load_batch *>(Context);
+  ld_plugin_level Level;
+  std::string ErrStorage;
+  if (formatDiagnostic(DI, Level, ErrStorage))
+    B.Diagnostics.push_back(std::make_pair(Level, ErrStorage));
 }
 
 /// Called by gold to see whether this file is one that our plugin can handle.
@@ -585,11 +639,10 @@ static void freeSymName(ld_plugin_symbol &Sym) {
   Sym.comdat_key = nullptr;
 }
 
-static std::unique_ptr<Module>
-getModuleForFile(LLVMContext &Context, claimed_file &F,
-                 ld_plugin_input_file &Info, raw_fd_ostream *ApiFile,
-                 StringSet<> &Internalize, StringSet<> &Maybe) {
-
+/// Fetch the resolutions of F from gold and return the contents of the file.
+/// This is the only part of loading a file that talks to gold.
+static MemoryBufferRef getFileBuffer(claimed_file &F,
+                                     ld_plugin_input_file &Info) {
   if (get_symbols(F.handle, F.syms.size(), &F.syms[0]) != LDPS_OK)
     message(LDPL_FATAL, "Failed to get symbol information");
 
@@ -597,14 +650,26 @@ getModuleForFile(LLVMContext &Context, claimed_file &F,
   if (get_view(F.handle, &View) != LDPS_OK)
     message(LDPL_FATAL, "Failed to get a view of file");
 
-  MemoryBufferRef BufferRef(StringRef((const char *)View, Info.filesize),
-                            Info.name);
+  return MemoryBufferRef(StringRef((const char *)View, Info.filesize),
+                         Info.name);
+}
+
+/// Load the module of F lazily and drop everything gold resolved elsewhere.
+/// The bodies of the dropped functions are never materialized; the linker
+/// only materializes what it copies. This doesn't call into gold, so it can
+/// run on any thread.
+static ErrorOr<std::unique_ptr<Module>>
+getModuleForFile(LLVMContext &Context, claimed_file &F,
+                 MemoryBufferRef BufferRef, raw_fd_ostream *ApiFile,
+                 linkage_fixups &Fixups) {
+  StringSet<> &Internalize = Fixups.Internalize;
+  StringSet<> &Maybe = Fixups.Maybe;
+
   ErrorOr<std::unique_ptr<object::IRObjectFile>> ObjOrErr =
       object::IRObjectFile::create(BufferRef, Context);
 
   if (std::error_code EC = ObjOrErr.getError())
-    message(LDPL_FATAL, "Could not read bitcode from file : %s",
-            EC.message().c_str());
+    return EC;
 
   object::IRObjectFile &Obj = **ObjOrErr;
 
@@ -683,8 +748,10 @@ getModuleForFile(LLVMContext &Context, claimed_file &F,
     case LDPR_PREEMPTED_IR:
       // Gold might have selected a linkonce_odr and preempted a weak_odr.
       // In that case we have to make sure we don't end up internalizing it.
-      if (!GV->isDiscardableIfUnused())
+      if (!GV->isDiscardableIfUnused()) {
         Maybe.erase(GV->getName());
+        Fixups.NotMaybe.insert(GV->getName());
+      }
 
       // fall-through
     case LDPR_PREEMPTED_REG:
@@ -748,8 +815,30 @@ static void saveBCFile(StringRef Path, Module &M) {
   WriteBitcodeToFile(&M, OS, /* ShouldPreserveUseListOrder */ true);
 }
 
-static void codegen(Module &M) {
-  const std::string &TripleStr = M.getTargetTriple();
+/// Create the temporary object file that receives partition I, or the file
+/// given by obj-path (suffixed with the partition number after the first).
+static int openOutputFile(SmallString<128> &Filename, unsigned I) {
+  int FD;
+  if (options::obj_path.empty()) {
+    std::error_code EC =
+        sys::fs::createTemporaryFile("lto-llvm", "o", FD, Filename);
+    if (EC)
+      message(LDPL_FATAL, "Could not create temporary file: %s",
+              EC.message().c_str());
+  } else {
+    Filename = options::obj_path;
+    if (I != 0)
+      Filename += "." + std::to_string(I);
+    std::error_code EC =
+        sys::fs::openFileForWrite(Filename.c_str(), FD, sys::fs::F_None);
+    if (EC)
+      message(LDPL_FATAL, "Could not open file: %s", EC.message().c_str());
+  }
+  return FD;
+}
+
+static void codegen(std::unique_ptr<Module> M) {
+  const std::string &TripleStr = M->getTargetTriple();
   Triple TheTriple(TripleStr);
 
   std::string ErrMsg;
@@ -786,45 +875,199 @@ static void codegen(Module &M) {
       CodeModel::Default, CGOptLevel));
 
   //runSDPasses(M, *TM);
-  runLTOPasses(M, *TM);
+  runLTOPasses(*M, *TM);
 
   if (options::TheOutputType == options::OT_SAVE_TEMPS)
-    saveBCFile(output_name + ".opt.bc", M);
+    saveBCFile(output_name + ".opt.bc", *M);
 
-  legacy::PassManager CodeGenPasses;
+  std::vector<SmallString<128>> Filenames(options::Parallelism);
+  {
+    std::list<raw_fd_ostream> OSs;
+    std::vector<raw_pwrite_stream *> OSPtrs;
+    for (unsigned I = 0; I != options::Parallelism; ++I) {
+      OSs.emplace_back(openOutputFile(Filenames[I], I), true);
+      OSPtrs.push_back(&OSs.back());
+    }
 
-  SmallString<128> Filename;
-  int FD;
-  if (options::obj_path.empty()) {
-    std::error_code EC =
-        sys::fs::createTemporaryFile("lto-llvm", "o", FD, Filename);
-    if (EC)
-      message(LDPL_FATAL, "Could not create temporary file: %s",
-              EC.message().c_str());
-  } else {
-    Filename = options::obj_path;
-    std::error_code EC =
-        sys::fs::openFileForWrite(Filename.c_str(), FD, sys::fs::F_None);
-    if (EC)
-      message(LDPL_FATAL, "Could not open file: %s", EC.message().c_str());
+    // The interleaved vtables (and the sentinel vtable of the masked checks)
+    // are laid out relative to each other, keep them in one object file. The
+    // range checks refer to them through hidden symbols from any partition.
+    splitCodeGen(std::move(M), OSPtrs, options::mcpu, Features.getString(),
+                 Options, RelocationModel, CodeModel::Default, CGOptLevel,
+                 TargetMachine::CGFT_ObjectFile,
+                 [](const GlobalValue *GV) {
+                   return sd_isNewVtableName(GV->getName()) ||
+                          GV->getName() == SD_SENTINEL_VTABLE_NAME;
+                 });
   }
 
-  {
-    raw_fd_ostream OS(FD, true);
+  for (SmallString<128> &Filename : Filenames) {
+    if (add_input_file(Filename.c_str()) != LDPS_OK)
+      message(LDPL_FATAL,
+              "Unable to add .o file to the link. File left behind in: %s",
+              Filename.c_str());
+
+    if (options::obj_path.empty())
+      Cleanup.push_back(Filename.c_str());
+  }
+}
+
+static void setTargetTriple(Module &M) {
+  if (!options::triple.empty())
+    M.setTargetTriple(options::triple.c_str());
+  else if (M.getTargetTriple().empty())
+    M.setTargetTriple(sys::getDefaultTargetTriple());
+}
+
+/// Apply the fixups of files linked after the ones already in To.
+static void mergeFixups(linkage_fixups &To, const linkage_fixups &From) {
+  for (const auto &Name : From.Internalize)
+    To.Internalize.insert(Name.first());
+  for (const auto &Name : From.NotMaybe) {
+    To.Maybe.erase(Name.first());
+    To.NotMaybe.insert(Name.first());
+  }
+  for (const auto &Name : From.Maybe)
+    To.Maybe.insert(Name.first());
+}
+
+/// Load and link the files of B into a fresh context and serialize the
+/// result, so that it can be linked into the main context.
+static void loadBatch(load_batch &B) {
+  LLVMContext Context;
+  Context.setDiagnosticHandler(batchDiagnosticHandler, &B, true);
+
+  std::unique_ptr<Module> Combined(new Module("ld-temp.o", Context));
+  Linker L(Combined.get());
+
+  for (unsigned I = 0, E = B.Files.size(); I != E; ++I) {
+    ErrorOr<std::unique_ptr<Module>> MOrErr =
+        getModuleForFile(Context, *B.Files[I], B.Buffers[I], nullptr, B.Fixups);
+    if (std::error_code EC = MOrErr.getError()) {
+      B.Error = "Could not read bitcode from file : " + EC.message();
+      return;
+    }
+    std::unique_ptr<Module> M = std::move(*MOrErr);
+    setTargetTriple(*M);
+
+    if (L.linkInModule(M.get())) {
+      B.Error = "Failed to link module";
+      return;
+    }
+  }
 
-    if (TM->addPassesToEmitFile(CodeGenPasses, OS,
-                                TargetMachine::CGFT_ObjectFile))
-      message(LDPL_FATAL, "Failed to setup codegen");
-    CodeGenPasses.run(M);
+  raw_svector_ostream OS(B.Bitcode);
+  WriteBitcodeToFile(Combined.get(), OS);
+  OS.flush();
+}
+
+/// Link all claimed files into Combined. With jobs=N the files are split
+/// into N batches that are parsed, resolved and linked concurrently, then the
+/// batch modules are linked pairwise by Linker::LinkBitcodeModules and the
+/// result replaces Combined.
+static void linkClaimedFiles(std::unique_ptr<Module> &Combined, Linker &L,
+                             raw_fd_ostream *ApiFile, linkage_fixups &Fixups) {
+  LLVMContext &Context = L.getModule()->getContext();
+
+  // The api file is written in link order, keep it serial. Only one file is
+  // held by gold at a time.
+  unsigned NumBatches = std::min<size_t>(options::Parallelism, Modules.size());
+  if (NumBatches <= 1 || options::generate_api_file) {
+    for (claimed_file &F : Modules) {
+      ld_plugin_input_file File;
+      if (get_input_file(F.handle, &File) != LDPS_OK)
+        message(LDPL_FATAL, "Failed to get file information");
+
+      ErrorOr<std::unique_ptr<Module>> MOrErr = getModuleForFile(
+          Context, F, getFileBuffer(F, File), ApiFile, Fixups);
+      if (std::error_code EC = MOrErr.getError())
+        message(LDPL_FATAL, "Could not read bitcode from file : %s",
+                EC.message().c_str());
+      std::unique_ptr<Module> M = std::move(*MOrErr);
+      setTargetTriple(*M);
+
+      if (L.linkInModule(M.get()))
+        message(LDPL_FATAL, "Failed to link module");
+      if (release_input_file(F.handle) != LDPS_OK)
+        message(LDPL_FATAL, "Failed to release file information");
+    }
+    return;
   }
 
-  if (add_input_file(Filename.c_str()) != LDPS_OK)
-    message(LDPL_FATAL,
-            "Unable to add .o file to the link. File left behind in: %s",
-            Filename.c_str());
+  // gold's callbacks may only be used from this thread, fetch all the
+  // resolutions and views before the batches start.
+  std::vector<claimed_file *> Files;
+  std::vector<MemoryBufferRef> Buffers;
+  for (claimed_file &F : Modules) {
+    ld_plugin_input_file File;
+    if (get_input_file(F.handle, &File) != LDPS_OK)
+      message(LDPL_FATAL, "Failed to get file information");
+    Files.push_back(&F);
+    Buffers.push_back(getFileBuffer(F, File));
+  }
+
+  // Balance the batches by file size. They stay contiguous so that the
+  // modules are linked in the same order as in a serial link.
+  uint64_t TotalSize = 0;
+  for (MemoryBufferRef &Buffer : Buffers)
+    TotalSize += Buffer.getBufferSize();
+
+  std::vector<load_batch> Batches(NumBatches);
+  uint64_t Size = 0;
+  for (unsigned I = 0, E = Files.size(); I != E; ++I) {
+    unsigned BatchNo = std::min<uint64_t>(Size * NumBatches / (TotalSize + 1),
+                                          NumBatches - 1);
+    Batches[BatchNo].Files.push_back(Files[I]);
+    Batches[BatchNo].Buffers.push_back(Buffers[I]);
+    Size += Buffers[I].getBufferSize();
+  }
+
+  ThreadPool Pool(NumBatches);
+  for (load_batch &B : Batches) {
+    load_batch *Batch = &B;
+    if (!B.Files.empty())
+      Pool.async([Batch] { loadBatch(*Batch); });
+  }
+  Pool.wait();
+
+  std::vector<SmallVector<char, 0>> Parts;
+  for (load_batch &B : Batches) {
+    for (auto &D : B.Diagnostics)
+      reportDiagnostic(D.first, D.second);
+    if (!B.Error.empty())
+      message(LDPL_FATAL, "%s", B.Error.c_str());
+    if (B.Files.empty())
+      continue;
+    mergeFixups(Fixups, B.Fixups);
+    Parts.push_back(std::move(B.Bitcode));
+  }
 
-  if (options::obj_path.empty())
-    Cleanup.push_back(Filename.c_str());
+  std::vector<std::pair<ld_plugin_level, std::string>> Diagnostics;
+  bool Failed = Linker::LinkBitcodeModules(
+      Pool, Parts, [&](const DiagnosticInfo &DI) {
+        ld_plugin_level Level;
+        std::string ErrStorage;
+        if (formatDiagnostic(DI, Level, ErrStorage))
+          Diagnostics.push_back(std::make_pair(Level, ErrStorage));
+      });
+  for (auto &D : Diagnostics)
+    reportDiagnostic(D.first, D.second);
+  if (Failed)
+    message(LDPL_FATAL, "Failed to link module");
+
+  ErrorOr<Module *> MOrErr = parseBitcodeFile(
+      MemoryBufferRef(StringRef(Parts[0].data(), Parts[0].size()),
+                      "ld-temp.o"),
+      Context);
+  if (std::error_code EC = MOrErr.getError())
+    message(LDPL_FATAL, "Could not read linked bitcode: %s",
+            EC.message().c_str());
+  Combined.reset(*MOrErr);
+  L.setModule(Combined.get());
+
+  for (claimed_file *F : Files)
+    if (release_input_file(F->handle) != LDPS_OK)
+      message(LDPL_FATAL, "Failed to release file information");
 }
 
 /// gold informs us that all symbols have been read. At this point, we use
@@ -840,27 +1083,10 @@ static ld_plugin_status allSymbolsReadHook(raw_fd_ostream *ApiFile) {
   std::unique_ptr<Module> Combined(new Module("ld-temp.o", Context));
   Linker L(Combined.get());
 
-  std::string DefaultTriple = sys::getDefaultTargetTriple();
-
-  StringSet<> Internalize;
-  StringSet<> Maybe;
-  for (claimed_file &F : Modules) {
-    ld_plugin_input_file File;
-    if (get_input_file(F.handle, &File) != LDPS_OK)
-      message(LDPL_FATAL, "Failed to get file information");
-    std::unique_ptr<Module> M =
-        getModuleForFile(Context, F, File, ApiFile, Internalize, Maybe);
-    if (!options::triple.empty())
-      M->setTargetTriple(options::triple.c_str());
-    else if (M->getTargetTriple().empty()) {
-      M->setTargetTriple(DefaultTriple);
-    }
-
-    if (L.linkInModule(M.get()))
-      message(LDPL_FATAL, "Failed to link module");
-    if (release_input_file(F.handle) != LDPS_OK)
-      message(LDPL_FATAL, "Failed to release file information");
-  }
+  linkage_fixups Fixups;
+  linkClaimedFiles(Combined, L, ApiFile, Fixups);
+  StringSet<> &Internalize = Fixups.Internalize;
+  StringSet<> &Maybe = Fixups.Maybe;
 
   for (const auto &Name : Internalize) {
     GlobalValue *GV = Combined->getNamedValue(Name.first());
@@ -891,7 +1117,7 @@ static ld_plugin_status allSymbolsReadHook(raw_fd_ostream *ApiFile) {
       return LDPS_OK;
   }
 
-  codegen(*L.getModule());
+  codegen(std::move(Combined));
 
   if (!options::extra_library_path.empty() &&
       set_extra_library_path(options::extra_library_path.c_str()) != LDPS_OK)
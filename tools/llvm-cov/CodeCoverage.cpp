@@ -31,13 +31,44 @@
 #include "llvm/Support/PrettyStackTrace.h"
 #include "llvm/Support/Process.h"
 #include "llvm/Support/Signals.h"
+#include "llvm/Support/ThreadPool.h"
 #include <functional>
+#include <mutex>
 #include <system_error>
+#include <thread>
 
 using namespace llvm;
 using namespace coverage;
 
 namespace {
+/// \brief A string stream that keeps the color changes as escape codes, so
+/// that a view rendered into a buffer looks the same once it is printed.
+class ColoredStringOstream : public raw_string_ostream {
+  void writeCode(const char *Code) {
+    if (Code)
+      write(Code, strlen(Code));
+  }
+
+public:
+  explicit ColoredStringOstream(std::string &Str) : raw_string_ostream(Str) {}
+
+  raw_ostream &changeColor(Colors Color, bool Bold, bool BG) override {
+    writeCode(Color == SAVEDCOLOR ? sys::Process::OutputBold(BG)
+                                  : sys::Process::OutputColor(Color, Bold, BG));
+    return *this;
+  }
+
+  raw_ostream &resetColor() override {
+    writeCode(sys::Process::ResetColor());
+    return *this;
+  }
+
+  raw_ostream &reverseColor() override {
+    writeCode(sys::Process::OutputReverse());
+    return *this;
+  }
+};
+
 /// \brief The implementation of the coverage tool.
 class CodeCoverageTool {
 public:
@@ -67,6 +98,11 @@ public:
   std::unique_ptr<SourceCoverageView>
   createSourceFileView(StringRef SourceFile, CoverageMapping &Coverage);
 
+  /// \brief Render the view of a source file, or a warning if it isn't
+  /// covered, to the given stream.
+  void renderSourceFile(StringRef SourceFile, CoverageMapping &Coverage,
+                        bool ShowFilenames, raw_ostream &OS);
+
   /// \brief Load the coverage mapping data. Return true if an error occured.
   std::unique_ptr<CoverageMapping> load();
 
@@ -87,6 +123,9 @@ public:
   std::vector<std::string> SourceFiles;
   std::vector<std::pair<std::string, std::unique_ptr<MemoryBuffer>>>
       LoadedSourceFiles;
+  /// \brief Guards LoadedSourceFiles, views are created on several threads.
+  std::mutex LoadedSourceFilesLock;
+  unsigned NumThreads;
   bool CompareFilenamesOnly;
   StringMap<std::string> RemappedFilenames;
   llvm::Triple::ArchType CoverageArch;
@@ -108,6 +147,7 @@ CodeCoverageTool::getSourceFile(StringRef SourceFile) {
     if (Loc != RemappedFilenames.end())
       SourceFile = Loc->second;
   }
+  std::lock_guard<std::mutex> Lock(LoadedSourceFilesLock);
   for (const auto &Files : LoadedSourceFiles)
     if (sys::fs::equivalent(SourceFile, Files.first))
       return *Files.second;
@@ -195,6 +235,26 @@ CodeCoverageTool::createSourceFileView(StringRef SourceFile,
   return View;
 }
 
+void CodeCoverageTool::renderSourceFile(StringRef SourceFile,
+                                        CoverageMapping &Coverage,
+                                        bool ShowFilenames, raw_ostream &OS) {
+  auto mainView = createSourceFileView(SourceFile, Coverage);
+  if (!mainView) {
+    ViewOpts.colored_ostream(OS, raw_ostream::RED)
+        << "warning: The file '" << SourceFile << "' isn't covered.";
+    OS << "\n";
+    return;
+  }
+
+  if (ShowFilenames) {
+    ViewOpts.colored_ostream(OS, raw_ostream::CYAN) << SourceFile << ":";
+    OS << "\n";
+  }
+  mainView->render(OS, /*Wholefile=*/true);
+  if (SourceFiles.size() > 1)
+    OS << "\n";
+}
+
 std::unique_ptr<CoverageMapping> CodeCoverageTool::load() {
   auto CoverageOrErr = CoverageMapping::load(ObjectFilename, PGOFilename,
                                              CoverageArch);
@@ -298,6 +358,13 @@ int CodeCoverageTool::run(Command Cmd, int argc, const char **argv) {
       "use-color", cl::desc("Emit colored output (default=autodetect)"),
       cl::init(cl::BOU_UNSET));
 
+  cl::opt<unsigned> NumThreadsOpt(
+      "num-threads", cl::init(0),
+      cl::desc("Number of threads used to build and render the source files "
+               "(default: autodetect)"));
+  cl::alias NumThreadsA("j", cl::desc("Alias for --num-threads"),
+                        cl::aliasopt(NumThreadsOpt));
+
   auto commandLineParser = [&, this](int argc, const char **argv) -> int {
     cl::ParseCommandLineOptions(argc, argv, "LLVM code coverage tool\n");
     ViewOpts.Debug = DebugDump;
@@ -307,6 +374,18 @@ int CodeCoverageTool::run(Command Cmd, int argc, const char **argv) {
                           ? sys::Process::StandardOutHasColors()
                           : UseColor == cl::BOU_TRUE;
 
+    NumThreads = NumThreadsOpt;
+#if LLVM_ENABLE_THREADS
+    if (!NumThreads)
+      NumThreads = std::thread::hardware_concurrency();
+#endif
+    // Views are rendered into buffers when running in parallel, that doesn't
+    // work for consoles which are colored through API calls. The debug dump
+    // goes straight to stderr and would interleave.
+    if (!NumThreads || ViewOpts.Debug ||
+        (ViewOpts.Colors && sys::Process::ColorNeedsFlush()))
+      NumThreads = 1;
+
     // Create the function filters
     if (!NameFilters.empty() || !NameRegexFilters.empty()) {
       auto NameFilterer = new CoverageFilters;
@@ -443,22 +522,27 @@ int CodeCoverageTool::show(int argc, const char **argv,
     for (StringRef Filename : Coverage->getUniqueSourceFiles())
       SourceFiles.push_back(Filename);
 
-  for (const auto &SourceFile : SourceFiles) {
-    auto mainView = createSourceFileView(SourceFile, *Coverage);
-    if (!mainView) {
-      ViewOpts.colored_ostream(outs(), raw_ostream::RED)
-          << "warning: The file '" << SourceFile << "' isn't covered.";
-      outs() << "\n";
-      continue;
-    }
+  if (NumThreads == 1) {
+    for (const auto &SourceFile : SourceFiles)
+      renderSourceFile(SourceFile, *Coverage, ShowFilenames, outs());
+    return 0;
+  }
 
-    if (ShowFilenames) {
-      ViewOpts.colored_ostream(outs(), raw_ostream::CYAN) << SourceFile << ":";
-      outs() << "\n";
-    }
-    mainView->render(outs(), /*Wholefile=*/true);
-    if (SourceFiles.size() > 1)
-      outs() << "\n";
+  // Build and render the files on the pool, each one into its own buffer. The
+  // buffers are printed in the original order as they complete so that the
+  // output doesn't depend on the scheduling.
+  ThreadPool Pool(NumThreads);
+  std::vector<std::string> Buffers(SourceFiles.size());
+  std::vector<std::shared_future<void>> Rendered;
+  for (unsigned I = 0, E = SourceFiles.size(); I < E; ++I)
+    Rendered.push_back(Pool.async([&, I] {
+      ColoredStringOstream OS(Buffers[I]);
+      renderSourceFile(SourceFiles[I], *Coverage, ShowFilenames, OS);
+    }));
+  for (unsigned I = 0, E = SourceFiles.size(); I < E; ++I) {
+    Rendered[I].wait();
+    outs() << Buffers[I];
+    std::string().swap(Buffers[I]);
   }
 
   return 0;
@@ -474,7 +558,7 @@ int CodeCoverageTool::report(int argc, const char **argv,
   if (!Coverage)
     return 1;
 
-  CoverageReport Report(ViewOpts, std::move(Coverage));
+  CoverageReport Report(ViewOpts, std::move(Coverage), NumThreads);
   if (SourceFiles.empty())
     Report.renderFileReports(llvm::outs());
   else
@@ -15,6 +15,7 @@
 #include "RenderingSupport.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Format.h"
+#include "llvm/Support/Parallel.h"
 
 using namespace llvm;
 namespace {
@@ -155,10 +156,30 @@ void CoverageReport::render(const FunctionCoverageSummary &Function,
   OS << "\n";
 }
 
+std::vector<std::vector<FunctionCoverageSummary>>
+CoverageReport::summarizeFunctions(ArrayRef<StringRef> Files) {
+  std::vector<std::vector<FunctionCoverageSummary>> Summaries(Files.size());
+  auto Summarize = [&](const StringRef &Filename) {
+    auto &FileSummaries = Summaries[&Filename - Files.begin()];
+    for (const auto &F : Coverage->getCoveredFunctions(Filename))
+      FileSummaries.push_back(FunctionCoverageSummary::get(F));
+  };
+  if (NumThreads <= 1) {
+    std::for_each(Files.begin(), Files.end(), Summarize);
+  } else {
+    ThreadPool Pool(NumThreads);
+    parallel_for_each(Pool, Files.begin(), Files.end(), Summarize);
+  }
+  return Summaries;
+}
+
 void CoverageReport::renderFunctionReports(ArrayRef<std::string> Files,
                                            raw_ostream &OS) {
+  std::vector<StringRef> Filenames(Files.begin(), Files.end());
+  auto Summaries = summarizeFunctions(Filenames);
   bool isFirst = true;
-  for (StringRef Filename : Files) {
+  for (unsigned I = 0, E = Filenames.size(); I < E; ++I) {
+    StringRef Filename = Filenames[I];
     if (isFirst)
       isFirst = false;
     else
@@ -175,8 +196,7 @@ void CoverageReport::renderFunctionReports(ArrayRef<std::string> Files,
     renderDivider(FunctionReportColumns, OS);
     OS << "\n";
     FunctionCoverageSummary Totals("TOTAL");
-    for (const auto &F : Coverage->getCoveredFunctions(Filename)) {
-      FunctionCoverageSummary Function = FunctionCoverageSummary::get(F);
+    for (const auto &Function : Summaries[I]) {
       ++Totals.ExecutionCount;
       Totals.RegionCoverage += Function.RegionCoverage;
       Totals.LineCoverage += Function.LineCoverage;
@@ -200,11 +220,12 @@ void CoverageReport::renderFileReports(raw_ostream &OS) {
      << "\n";
   renderDivider(FileReportColumns, OS);
   OS << "\n";
+  std::vector<StringRef> Filenames = Coverage->getUniqueSourceFiles();
+  auto Summaries = summarizeFunctions(Filenames);
   FileCoverageSummary Totals("TOTAL");
-  for (StringRef Filename : Coverage->getUniqueSourceFiles()) {
-    FileCoverageSummary Summary(Filename);
-    for (const auto &F : Coverage->getCoveredFunctions(Filename)) {
-      FunctionCoverageSummary Function = FunctionCoverageSummary::get(F);
+  for (unsigned I = 0, E = Filenames.size(); I < E; ++I) {
+    FileCoverageSummary Summary(Filenames[I]);
+    for (const auto &Function : Summaries[I]) {
       Summary.addFunction(Function);
       Totals.addFunction(Function);
     }
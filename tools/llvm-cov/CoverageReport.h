@@ -23,14 +23,22 @@ namespace llvm {
 class CoverageReport {
   const CoverageViewOptions &Options;
   std::unique_ptr<coverage::CoverageMapping> Coverage;
+  unsigned NumThreads;
+
+  /// \brief Summarize the functions of each of the files, on NumThreads
+  /// threads.
+  std::vector<std::vector<FunctionCoverageSummary>>
+  summarizeFunctions(ArrayRef<StringRef> Files);
 
   void render(const FileCoverageSummary &File, raw_ostream &OS);
   void render(const FunctionCoverageSummary &Function, raw_ostream &OS);
 
 public:
   CoverageReport(const CoverageViewOptions &Options,
-                 std::unique_ptr<coverage::CoverageMapping> Coverage)
-      : Options(Options), Coverage(std::move(Coverage)) {}
+                 std::unique_ptr<coverage::CoverageMapping> Coverage,
+                 unsigned NumThreads = 1)
+      : Options(Options), Coverage(std::move(Coverage)),
+        NumThreads(NumThreads) {}
 
   void renderFunctionReports(ArrayRef<std::string> Files, raw_ostream &OS);
 
@@ -9,22 +9,36 @@
 //
 // Dumps C++ data resident in object files and archives.
 //
+// SafeDispatch clouds (_SD<root> tables) are dumped along with the Itanium
+// vtables. Given a whole-program bitcode file that still carries the
+// sd.class_info records, the clouds are laid out the way the linker plugin
+// would and the placement of every class inside them is dumped.
+//
 //===----------------------------------------------------------------------===//
 
 #include "llvm-cxxdump.h"
 #include "Error.h"
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/IR/SafeDispatchMD.h"
 #include "llvm/Object/Archive.h"
 #include "llvm/Object/ObjectFile.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/Endian.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/PrettyStackTrace.h"
 #include "llvm/Support/Signals.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/IPO/SafeDispatchLayoutBuilder.h"
+#include "llvm/Transforms/IPO/SafeDispatchTools.h"
 #include <map>
 #include <string>
 #include <system_error>
@@ -37,6 +51,10 @@ namespace opts {
 cl::list<std::string> InputFilenames(cl::Positional,
                                      cl::desc("<input object files>"),
                                      cl::ZeroOrMore);
+
+cl::opt<bool> SDInterleave("sd-ivtbl",
+                           cl::desc("Interleave the SafeDispatch clouds of "
+                                    "bitcode inputs (default: order them)"));
 } // namespace opts
 
 static int ReturnValue = EXIT_SUCCESS;
@@ -135,6 +153,40 @@ static bool collectRelocationOffsets(
   return false;
 }
 
+/// SafeDispatch clouds are named after the vtable of their root class, with
+/// SD_NEW_VTABLE_PREFIX in front.
+static bool isSDCloud(StringRef SymName) {
+  // Mach-O prepends an underscore to every symbol
+  if (SymName.startswith("_" SD_NEW_VTABLE_PREFIX))
+    SymName = SymName.drop_front();
+  return sd_isNewVtableName(SymName);
+}
+
+namespace {
+/// Sizes summed over all SafeDispatch clouds of an input.
+struct SDCloudTotals {
+  uint64_t Clouds = 0;
+  uint64_t Size = 0;
+  uint64_t Padding = 0;
+  uint64_t Relocations = 0;
+
+  void add(uint64_t CloudSize, uint64_t CloudPadding,
+           uint64_t CloudRelocations) {
+    ++Clouds;
+    Size += CloudSize;
+    Padding += CloudPadding;
+    Relocations += CloudRelocations;
+  }
+
+  void dump(StringRef PaddingName) const {
+    outs() << "SafeDispatch[Clouds]: " << Clouds << '\n';
+    outs() << "SafeDispatch[Size]: " << Size << '\n';
+    outs() << "SafeDispatch[" << PaddingName << "]: " << Padding << '\n';
+    outs() << "SafeDispatch[Relocations]: " << Relocations << '\n';
+  }
+};
+} // end anonymous namespace
+
 static void dumpCXXData(const ObjectFile *Obj) {
   struct CompleteObjectLocator {
     StringRef Symbols[2];
@@ -184,9 +236,32 @@ static void dumpCXXData(const ObjectFile *Obj) {
   std::map<std::pair<StringRef, uint64_t>, int64_t> VTableDataEntries;
   std::map<std::pair<StringRef, uint64_t>, StringRef> VTTEntries;
   std::map<StringRef, StringRef> TINames;
+  std::map<StringRef, uint64_t> SDClouds;
 
   uint8_t BytesInAddress = Obj->getBytesInAddress();
 
+  // Linked images don't keep the relocations of their data, so the slots of
+  // the clouds are matched against the symbol table instead.
+  std::map<uint64_t, StringRef> SymbolsByAddress;
+  bool SymbolsByAddressDone = Obj->isRelocatableObject();
+  auto lookupSymbolByAddress = [&](uint64_t Address) -> StringRef {
+    if (!SymbolsByAddressDone) {
+      for (const object::SymbolRef &Sym : Obj->symbols()) {
+        SymbolRef::Type Type;
+        StringRef Name;
+        uint64_t SymAddress;
+        if (Sym.getType(Type) || Sym.getName(Name) ||
+            Sym.getAddress(SymAddress) || Name.empty())
+          continue;
+        if (Type == SymbolRef::ST_Function || Type == SymbolRef::ST_Data)
+          SymbolsByAddress.insert(std::make_pair(SymAddress, Name));
+      }
+      SymbolsByAddressDone = true;
+    }
+    auto I = SymbolsByAddress.find(Address);
+    return I == SymbolsByAddress.end() ? StringRef() : I->second;
+  };
+
   for (const object::SymbolRef &Sym : Obj->symbols()) {
     StringRef SymName;
     if (error(Sym.getName(SymName)))
@@ -344,6 +419,30 @@ static void dumpCXXData(const ObjectFile *Obj) {
         VTableDataEntries[Key] = VData;
       }
     }
+    // SafeDispatch clouds are laid out like one big vtable, a slot either
+    // names a symbol or holds data.
+    else if (isSDCloud(SymName)) {
+      collectRelocationOffsets(Obj, Sec, SecAddress, SymAddress, SymSize,
+                               SymName, VTableSymEntries);
+      for (uint64_t SymOffI = 0; SymOffI < SymSize; SymOffI += BytesInAddress) {
+        auto Key = std::make_pair(SymName, SymOffI);
+        if (VTableSymEntries.count(Key))
+          continue;
+        const char *DataPtr =
+            SymContents.substr(SymOffI, BytesInAddress).data();
+        int64_t VData;
+        if (BytesInAddress == 8)
+          VData = *reinterpret_cast<const little64_t *>(DataPtr);
+        else
+          VData = *reinterpret_cast<const little32_t *>(DataPtr);
+        StringRef Target = VData ? lookupSymbolByAddress(VData) : StringRef();
+        if (!Target.empty())
+          VTableSymEntries[Key] = Target;
+        else
+          VTableDataEntries[Key] = VData;
+      }
+      SDClouds[SymName] = SymSize;
+    }
     // Typeinfo structures in the Itanium ABI start with '_ZTI' or '__ZTI'.
     else if (SymName.startswith("_ZTI") || SymName.startswith("__ZTI")) {
       // FIXME: Do something with these!
@@ -503,6 +602,174 @@ static void dumpCXXData(const ObjectFile *Obj) {
       continue;
     }
   }
+
+  SDCloudTotals Totals;
+  for (const auto &CloudPair : SDClouds) {
+    StringRef CloudName = CloudPair.first;
+    uint64_t Size = CloudPair.second;
+    uint64_t Relocations = 0, Nulls = 0, TypeInfos = 0;
+
+    for (auto I = VTableSymEntries.lower_bound(std::make_pair(CloudName, 0)),
+              E = VTableSymEntries.upper_bound(
+                  std::make_pair(CloudName, UINT64_MAX));
+         I != E; ++I) {
+      ++Relocations;
+      if (I->second.startswith("_ZTI") || I->second.startswith("__ZTI"))
+        ++TypeInfos;
+    }
+    for (auto I = VTableDataEntries.lower_bound(std::make_pair(CloudName, 0)),
+              E = VTableDataEntries.upper_bound(
+                  std::make_pair(CloudName, UINT64_MAX));
+         I != E; ++I)
+      if (I->second == 0)
+        ++Nulls;
+
+    // Without the class info, padding can't be told apart from zero offsets
+    // and the classes of a cloud are only known by their typeinfo slots,
+    // which are null for classes built without RTTI.
+    outs() << CloudName << "[Size]: " << Size << '\n';
+    outs() << CloudName << "[Slots]: " << Size / BytesInAddress << '\n';
+    outs() << CloudName << "[TypeInfos]: " << TypeInfos << '\n';
+    outs() << CloudName << "[NullSlots]: " << Nulls << '\n';
+    outs() << CloudName << "[Relocations]: " << Relocations << '\n';
+
+    Totals.add(Size, Nulls, Relocations);
+  }
+  if (!SDClouds.empty())
+    Totals.dump("NullSlots");
+}
+
+static void dumpSDLayout(StringRef File, Module &M) {
+  bool HasClassInfo = false;
+  for (const NamedMDNode &MD : M.named_metadata())
+    HasClassInfo |= MD.getName().startswith(SD_MD_CLASSINFO);
+  if (!HasClassInfo) {
+    reportError(File, "no SafeDispatch class info found");
+    return;
+  }
+
+  // lay the clouds out exactly like the linker plugin does
+  SDBuildCHA *CHA = new SDBuildCHA();
+  SDLayoutBuilder *Layout = new SDLayoutBuilder(opts::SDInterleave);
+  legacy::PassManager PM;
+  PM.add(createSDFixPass());
+  PM.add(CHA);
+  PM.add(Layout);
+  PM.run(M);
+
+  // every slot of a cloud holds a pointer
+  const uint64_t SlotSize = M.getDataLayout().getPointerSize();
+  typedef SDLayoutBuilder::vtbl_t vtbl_t;
+
+  auto getSlotName = [](const Constant *C, bool &IsRelocated) -> std::string {
+    IsRelocated = false;
+    if (C->isNullValue())
+      return "0";
+    if (const auto *CE = dyn_cast<ConstantExpr>(C))
+      if (CE->getOpcode() == Instruction::IntToPtr)
+        if (const auto *CI = dyn_cast<ConstantInt>(CE->getOperand(0)))
+          return std::to_string(CI->getSExtValue());
+    const Value *V = C->stripPointerCasts();
+    if (const auto *GEP = dyn_cast<GEPOperator>(V))
+      V = GEP->getPointerOperand()->stripPointerCasts();
+    IsRelocated = true;
+    return V->hasName() ? V->getName().str() : "<unnamed>";
+  };
+
+  SDCloudTotals Totals;
+  for (const auto &CloudPair : Layout->interleavingMap) {
+    const std::string &Root = CloudPair.first;
+    std::vector<SDLayoutBuilder::interleaving_t> Slots(CloudPair.second.begin(),
+                                                       CloudPair.second.end());
+    GlobalVariable *Cloud = Layout->cloudStartMap[SD_NEW_VTABLE_PREFIX + Root];
+    assert(Cloud && Cloud->hasInitializer());
+    const Constant *Init = Cloud->getInitializer();
+    StringRef CloudName = Cloud->getName();
+
+    uint64_t Alignment = Layout->alignmentMap[Root];
+    uint64_t Block =
+        opts::SDInterleave
+            ? Layout->getInterleaveBlock(Root, CHA->preorder(vtbl_t(Root, 0)))
+            : 1;
+    uint64_t Padding = 0, Relocations = 0;
+
+    // The padding of the ordered clouds belongs to the class following it,
+    // in the interleaved ones to the class owning the block.
+    std::vector<const vtbl_t *> Owners(Slots.size(), nullptr);
+    for (uint64_t I = 0; I < Slots.size(); ++I) {
+      if (Slots[I].first != Layout->dummyVtable) {
+        Owners[I] = &Slots[I].first;
+        continue;
+      }
+      ++Padding;
+      uint64_t J = opts::SDInterleave ? I - I % Block : I + 1;
+      uint64_t E = opts::SDInterleave ? J + Block : Slots.size();
+      for (; J < E && J < Slots.size() && !Owners[I]; ++J)
+        if (Slots[J].first != Layout->dummyVtable)
+          Owners[I] = &Slots[J].first;
+    }
+
+    std::map<vtbl_t, uint64_t> AddrPts;
+    for (uint64_t I = 0; I < Slots.size(); ++I)
+      if (Owners[I] == &Slots[I].first &&
+          Slots[I].second == CHA->addrPt(Slots[I].first))
+        AddrPts[Slots[I].first] = I * SlotSize;
+
+    outs() << CloudName << "[Alignment]: " << Alignment << '\n';
+    outs() << CloudName << "[Size]: " << Slots.size() * SlotSize << '\n';
+    outs() << CloudName << "[Slots]: " << Slots.size() << '\n';
+    outs() << CloudName << "[Members]: " << AddrPts.size() << '\n';
+
+    for (uint64_t I = 0; I < Slots.size(); ++I) {
+      bool IsRelocated;
+      std::string Name =
+          getSlotName(Init->getAggregateElement(I), IsRelocated);
+      if (IsRelocated)
+        ++Relocations;
+      outs() << CloudName << '[' << I * SlotSize << "]: " << Name << '\n';
+    }
+
+    for (const vtbl_t &V : CHA->preorder(vtbl_t(Root, 0))) {
+      if (CHA->isUndefined(V) || !AddrPts.count(V))
+        continue;
+
+      // vptrs of the class and everything deriving from it pass the checks
+      uint64_t First = UINT64_MAX, Last = 0;
+      for (const vtbl_t &D : CHA->preorder(V)) {
+        auto I = AddrPts.find(D);
+        if (I == AddrPts.end())
+          continue;
+        First = std::min(First, I->second);
+        Last = std::max(Last, I->second);
+      }
+
+      uint64_t ClassPadding = 0;
+      for (uint64_t I = 0; I < Slots.size(); ++I)
+        if (Owners[I] && *Owners[I] == V && Slots[I].first != V)
+          ++ClassPadding;
+
+      std::string ClassName =
+          (Twine(V.first) + "," + Twine(V.second)).str();
+      uint64_t AddrPt = CHA->addrPt(V);
+      outs() << CloudName << '[' << ClassName << "][AddressPoint]: "
+             << AddrPts[V] << '\n';
+      outs() << CloudName << '[' << ClassName << "][Range]: " << First << '-'
+             << Last << '\n';
+      outs() << CloudName << '[' << ClassName << "][Padding]: " << ClassPadding
+             << '\n';
+      for (uint64_t I = 0; I < Slots.size(); ++I)
+        if (Slots[I].first == V)
+          outs() << CloudName << '[' << ClassName << "]["
+                 << (int64_t)Slots[I].second - (int64_t)AddrPt
+                 << "]: " << I * SlotSize << '\n';
+    }
+
+    outs() << CloudName << "[Padding]: " << Padding << '\n';
+    outs() << CloudName << "[Relocations]: " << Relocations << '\n';
+
+    Totals.add(Slots.size() * SlotSize, Padding, Relocations);
+  }
+  Totals.dump("Padding");
 }
 
 static void dumpArchive(const Archive *Arc) {
@@ -529,13 +796,37 @@ static void dumpInput(StringRef File) {
     return;
   }
 
+  ErrorOr<std::unique_ptr<MemoryBuffer>> BufferOrErr =
+      MemoryBuffer::getFileOrSTDIN(File);
+  if (std::error_code EC = BufferOrErr.getError()) {
+    reportError(File, EC);
+    return;
+  }
+  std::unique_ptr<MemoryBuffer> &Buffer = BufferOrErr.get();
+
+  // Bitcode is laid out from its SafeDispatch class info.
+  if (sys::fs::identify_magic(Buffer->getBuffer()) ==
+      sys::fs::file_magic::bitcode) {
+    LLVMContext Context;
+    ErrorOr<Module *> ModuleOrErr =
+        parseBitcodeFile(Buffer->getMemBufferRef(), Context);
+    if (std::error_code EC = ModuleOrErr.getError()) {
+      reportError(File, EC);
+      return;
+    }
+    std::unique_ptr<Module> M(ModuleOrErr.get());
+    dumpSDLayout(File, *M);
+    return;
+  }
+
   // Attempt to open the binary.
-  ErrorOr<OwningBinary<Binary>> BinaryOrErr = createBinary(File);
+  ErrorOr<std::unique_ptr<Binary>> BinaryOrErr =
+      createBinary(Buffer->getMemBufferRef());
   if (std::error_code EC = BinaryOrErr.getError()) {
     reportError(File, EC);
     return;
   }
-  Binary &Binary = *BinaryOrErr.get().getBinary();
+  Binary &Binary = *BinaryOrErr.get();
 
   if (Archive *Arc = dyn_cast<Archive>(&Binary))
     dumpArchive(Arc);
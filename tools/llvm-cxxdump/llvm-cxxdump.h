@@ -15,6 +15,7 @@
 
 namespace opts {
 extern llvm::cl::list<std::string> InputFilenames;
+extern llvm::cl::opt<bool> SDInterleave;
 } // namespace opts
 
 #define LLVM_CXXDUMP_ENUM_ENT(ns, enum)                                        \
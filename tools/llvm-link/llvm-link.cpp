@@ -30,8 +30,10 @@
 #include "llvm/Support/Signals.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/SystemUtils.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/ToolOutputFile.h"
 #include <memory>
+#include <thread>
 using namespace llvm;
 
 static cl::list<std::string>
@@ -64,6 +66,13 @@ static cl::opt<bool>
 SuppressWarnings("suppress-warnings", cl::desc("Suppress all linking warnings"),
                  cl::init(false));
 
+static cl::opt<unsigned>
+NumThreads("num-threads", cl::init(1),
+           cl::desc("Number of threads linking the input files "
+                    "(0: autodetect)"));
+static cl::alias NumThreadsA("j", cl::desc("Alias for --num-threads"),
+                             cl::aliasopt(NumThreads));
+
 static cl::opt<bool> PreserveBitcodeUseListOrder(
     "preserve-bc-uselistorder",
     cl::desc("Preserve use-list order when writing LLVM bitcode."),
@@ -78,12 +87,13 @@ static cl::opt<bool> PreserveAssemblyUseListOrder(
 // link path for the specified file to try to find it...
 //
 static std::unique_ptr<Module>
-loadFile(const char *argv0, const std::string &FN, LLVMContext &Context) {
+loadFile(const char *argv0, const std::string &FN, LLVMContext &Context,
+         raw_ostream &OS) {
   SMDiagnostic Err;
-  if (Verbose) errs() << "Loading '" << FN << "'\n";
+  if (Verbose) OS << "Loading '" << FN << "'\n";
   std::unique_ptr<Module> Result = getLazyIRFileModule(FN, Err, Context);
   if (!Result)
-    Err.print(argv0, errs());
+    Err.print(argv0, OS);
 
   Result->materializeMetadata();
   UpgradeDebugInfo(*Result);
@@ -91,52 +101,171 @@ loadFile(const char *argv0, const std::string &FN, LLVMContext &Context) {
   return Result;
 }
 
-static void diagnosticHandler(const DiagnosticInfo &DI) {
+static void printDiagnostic(const DiagnosticInfo &DI, raw_ostream &OS) {
   unsigned Severity = DI.getSeverity();
   switch (Severity) {
   case DS_Error:
-    errs() << "ERROR: ";
+    OS << "ERROR: ";
     break;
   case DS_Warning:
     if (SuppressWarnings)
       return;
-    errs() << "WARNING: ";
+    OS << "WARNING: ";
     break;
   case DS_Remark:
   case DS_Note:
     llvm_unreachable("Only expecting warnings and errors");
   }
 
-  DiagnosticPrinterRawOStream DP(errs());
+  DiagnosticPrinterRawOStream DP(OS);
   DI.print(DP);
-  errs() << '\n';
+  OS << '\n';
+}
+
+static void diagnosticHandler(const DiagnosticInfo &DI) {
+  printDiagnostic(DI, errs());
 }
 
 static bool linkFiles(const char *argv0, LLVMContext &Context, Linker &L,
-                      const cl::list<std::string> &Files,
-                      bool OverrideDuplicateSymbols) {
+                      ArrayRef<std::string> Files,
+                      bool OverrideDuplicateSymbols, bool LinkAllDefinitions,
+                      raw_ostream &OS) {
   for (const auto &File : Files) {
-    std::unique_ptr<Module> M = loadFile(argv0, File, Context);
+    std::unique_ptr<Module> M = loadFile(argv0, File, Context, OS);
     if (!M.get()) {
-      errs() << argv0 << ": error loading file '" << File << "'\n";
+      OS << argv0 << ": error loading file '" << File << "'\n";
       return false;
     }
 
-    if (verifyModule(*M, &errs())) {
-      errs() << argv0 << ": " << File << ": error: input module is broken!\n";
+    if (verifyModule(*M, &OS)) {
+      OS << argv0 << ": " << File << ": error: input module is broken!\n";
       return false;
     }
 
     if (Verbose)
-      errs() << "Linking in '" << File << "'\n";
+      OS << "Linking in '" << File << "'\n";
 
-    if (L.linkInModule(M.get(), OverrideDuplicateSymbols))
+    if (L.linkInModule(M.get(), OverrideDuplicateSymbols, LinkAllDefinitions))
       return false;
   }
 
   return true;
 }
 
+namespace {
+/// A contiguous slice of the input files, linked on its own thread and in its
+/// own context. Its messages are kept until all the slices are done so that
+/// they are printed in order.
+struct LinkBatch {
+  ArrayRef<std::string> Files;
+  SmallVector<char, 0> Bitcode;
+  std::string Log;
+  bool Failed = false;
+};
+}
+
+static void batchDiagnosticHandler(const DiagnosticInfo &DI, void *Context) {
+  printDiagnostic(DI, *static_cast<raw_ostream *>(Context));
+}
+
+static void linkBatch(const char *argv0, LinkBatch &B) {
+  LLVMContext Context;
+  raw_string_ostream Log(B.Log);
+  Context.setDiagnosticHandler(batchDiagnosticHandler, &Log, true);
+
+  Module Part("llvm-link", Context);
+  Linker L(&Part, [&](const DiagnosticInfo &DI) { printDiagnostic(DI, Log); });
+  if (!linkFiles(argv0, Context, L, B.Files, false, true, Log)) {
+    B.Failed = true;
+    return;
+  }
+
+  raw_svector_ostream OS(B.Bitcode);
+  WriteBitcodeToFile(&Part, OS);
+}
+
+/// The slices keep all their definitions since another slice may use them.
+/// Drop the local, linkonce and available_externally definitions that are
+/// still unused, as a serial link would not have linked them.
+static void dropUnusedDefinitions(Module &M) {
+  bool Changed;
+  do {
+    std::vector<GlobalValue *> Dead;
+    auto Visit = [&](GlobalValue &GV) {
+      if (GV.isDeclaration() || GV.hasComdat() ||
+          !(GV.hasLocalLinkage() || GV.hasLinkOnceLinkage() ||
+            GV.hasAvailableExternallyLinkage()))
+        return;
+      GV.removeDeadConstantUsers();
+      if (GV.use_empty())
+        Dead.push_back(&GV);
+    };
+    for (Function &F : M)
+      Visit(F);
+    for (GlobalVariable &GV : M.globals())
+      Visit(GV);
+    for (GlobalAlias &GA : M.aliases())
+      Visit(GA);
+
+    Changed = !Dead.empty();
+    for (GlobalValue *GV : Dead)
+      GV->eraseFromParent();
+  } while (Changed);
+}
+
+/// Link the regular input files with -num-threads threads: slices of the
+/// files are linked in parallel, then the slices are linked pairwise by
+/// Linker::LinkBitcodeModules. The result replaces the (still empty)
+/// composite module.
+static bool linkInputFilesInParallel(const char *argv0, LLVMContext &Context,
+                                     std::unique_ptr<Module> &Composite,
+                                     Linker &L, unsigned Threads) {
+  ArrayRef<std::string> Files = InputFilenames;
+  unsigned NumBatches = std::min<size_t>(Threads, Files.size());
+  ThreadPool Pool(NumBatches);
+
+  std::vector<LinkBatch> Batches(NumBatches);
+  for (unsigned I = 0; I != NumBatches; ++I) {
+    size_t Begin = Files.size() * I / NumBatches;
+    size_t End = Files.size() * (I + 1) / NumBatches;
+    Batches[I].Files = Files.slice(Begin, End - Begin);
+  }
+  for (LinkBatch &B : Batches) {
+    LinkBatch *Batch = &B;
+    Pool.async([argv0, Batch] { linkBatch(argv0, *Batch); });
+  }
+  Pool.wait();
+
+  bool Failed = false;
+  for (LinkBatch &B : Batches) {
+    errs() << B.Log;
+    Failed |= B.Failed;
+  }
+  if (Failed)
+    return false;
+
+  std::vector<SmallVector<char, 0>> Parts;
+  for (LinkBatch &B : Batches)
+    Parts.push_back(std::move(B.Bitcode));
+  if (Linker::LinkBitcodeModules(Pool, Parts, diagnosticHandler))
+    return false;
+
+  ErrorOr<Module *> MOrErr = parseBitcodeFile(
+      MemoryBufferRef(StringRef(Parts[0].data(), Parts[0].size()),
+                      "llvm-link"),
+      Context);
+  if (std::error_code EC = MOrErr.getError()) {
+    errs() << argv0 << ": error: could not read linked bitcode: "
+           << EC.message() << '\n';
+    return false;
+  }
+
+  Composite.reset(*MOrErr);
+  dropUnusedDefinitions(*Composite);
+  L.setModule(Composite.get());
+  return true;
+}
+
 int main(int argc, char **argv) {
   // Print a stack trace if we signal out.
   sys::PrintStackTraceOnErrorSignal();
@@ -149,12 +278,20 @@ int main(int argc, char **argv) {
   auto Composite = make_unique<Module>("llvm-link", Context);
   Linker L(Composite.get(), diagnosticHandler);
 
+  unsigned Threads = NumThreads;
+  if (!Threads)
+    Threads = std::max(std::thread::hardware_concurrency(), 1u);
+
   // First add all the regular input files
-  if (!linkFiles(argv[0], Context, L, InputFilenames, false))
+  if (Threads > 1 && InputFilenames.size() > 1) {
+    if (!linkInputFilesInParallel(argv[0], Context, Composite, L, Threads))
+      return 1;
+  } else if (!linkFiles(argv[0], Context, L, InputFilenames, false, false,
+                        errs()))
     return 1;
 
   // Next the -override ones.
-  if (!linkFiles(argv[0], Context, L, OverridingInputs, true))
+  if (!linkFiles(argv[0], Context, L, OverridingInputs, true, false, errs()))
     return 1;
 
   if (DumpAsm) errs() << "Here's the assembly:\n" << *Composite;
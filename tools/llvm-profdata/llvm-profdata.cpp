@@ -25,7 +25,10 @@
 #include "llvm/Support/Path.h"
 #include "llvm/Support/PrettyStackTrace.h"
 #include "llvm/Support/Signals.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/raw_ostream.h"
+#include <mutex>
+#include <thread>
 
 using namespace llvm;
 
@@ -39,8 +42,61 @@ static void exitWithError(const Twine &Message, StringRef Whence = "") {
 
 enum ProfileKinds { instr, sample };
 
+namespace {
+/// The counts merged by one worker of a parallel merge, along with what went
+/// wrong, which is only reported once all the workers are done. Several
+/// inputs share a context, and the pool may load them at the same time.
+struct WriterContext {
+  std::mutex Lock;
+  InstrProfWriter Writer;
+  std::string Warnings;
+  std::error_code Err;
+  std::string ErrWhence;
+};
+}
+
+static void loadInput(StringRef Filename, WriterContext &Context) {
+  std::unique_lock<std::mutex> CtxGuard{Context.Lock};
+
+  if (Context.Err)
+    return;
+
+  auto ReaderOrErr = InstrProfReader::create(Filename);
+  if (std::error_code EC = ReaderOrErr.getError()) {
+    Context.Err = EC;
+    Context.ErrWhence = Filename;
+    return;
+  }
+
+  raw_string_ostream Warnings(Context.Warnings);
+  auto Reader = std::move(ReaderOrErr.get());
+  for (const auto &I : *Reader)
+    if (std::error_code EC =
+            Context.Writer.addFunctionCounts(I.Name, I.Hash, I.Counts))
+      Warnings << Filename << ": " << I.Name << ": " << EC.message() << "\n";
+  if (Reader->hasError()) {
+    Context.Err = Reader->getError();
+    Context.ErrWhence = Filename;
+  }
+}
+
+/// Merge the counts of \p Src into \p Dst.
+static void mergeWriterContexts(WriterContext &Dst, WriterContext &Src) {
+  if (!Dst.Err && Src.Err) {
+    Dst.Err = Src.Err;
+    Dst.ErrWhence = Src.ErrWhence;
+  }
+  Dst.Warnings += Src.Warnings;
+
+  raw_string_ostream Warnings(Dst.Warnings);
+  Dst.Writer.mergeRecordsFromWriter(
+      std::move(Src.Writer), [&](StringRef Name, std::error_code EC) {
+        Warnings << Name << ": " << EC.message() << "\n";
+      });
+}
+
 static void mergeInstrProfile(const cl::list<std::string> &Inputs,
-                              StringRef OutputFilename) {
+                              StringRef OutputFilename, unsigned NumThreads) {
   if (OutputFilename.compare("-") == 0)
     exitWithError("Cannot write indexed profdata format to stdout.");
 
@@ -49,21 +105,54 @@ static void mergeInstrProfile(const cl::list<std::string> &Inputs,
   if (EC)
     exitWithError(EC.message(), OutputFilename);
 
-  InstrProfWriter Writer;
-  for (const auto &Filename : Inputs) {
-    auto ReaderOrErr = InstrProfReader::create(Filename);
-    if (std::error_code ec = ReaderOrErr.getError())
-      exitWithError(ec.message(), Filename);
-
-    auto Reader = std::move(ReaderOrErr.get());
-    for (const auto &I : *Reader)
-      if (std::error_code EC =
-              Writer.addFunctionCounts(I.Name, I.Hash, I.Counts))
-        errs() << Filename << ": " << I.Name << ": " << EC.message() << "\n";
-    if (Reader->hasError())
-      exitWithError(Reader->getError().message(), Filename);
+  // Each worker needs at least two inputs for the threads to pay off.
+  if (NumThreads == 0)
+    NumThreads = std::thread::hardware_concurrency();
+  NumThreads = std::max(1u, std::min(NumThreads, unsigned(Inputs.size() + 1) / 2));
+
+  std::vector<std::unique_ptr<WriterContext>> Contexts;
+  for (unsigned I = 0; I < NumThreads; ++I)
+    Contexts.emplace_back(new WriterContext());
+
+  if (NumThreads == 1) {
+    for (const auto &Filename : Inputs)
+      loadInput(Filename, *Contexts[0]);
+  } else {
+    ThreadPool Pool(NumThreads);
+
+    // Load the inputs in parallel, each worker into its own writer.
+    unsigned Ctx = 0;
+    for (const auto &Filename : Inputs) {
+      Pool.async(loadInput, StringRef(Filename), std::ref(*Contexts[Ctx]));
+      Ctx = (Ctx + 1) % NumThreads;
+    }
+    Pool.wait();
+
+    // Merge the writers pairwise until only the first one is left.
+    unsigned Mid = Contexts.size() / 2;
+    unsigned End = Contexts.size();
+    do {
+      for (unsigned I = 0; I < Mid; ++I)
+        Pool.async(mergeWriterContexts, std::ref(*Contexts[I]),
+                   std::ref(*Contexts[I + Mid]));
+      Pool.wait();
+      // An odd writer out is merged in the next round.
+      if (End & 1) {
+        Pool.async(mergeWriterContexts, std::ref(*Contexts[0]),
+                   std::ref(*Contexts[End - 1]));
+        Pool.wait();
+      }
+      End = Mid;
+      Mid /= 2;
+    } while (Mid > 0);
   }
-  Writer.write(Output);
+
+  WriterContext &Merged = *Contexts[0];
+  errs() << Merged.Warnings;
+  if (Merged.Err)
+    exitWithError(Merged.Err.message(), Merged.ErrWhence);
+
+  Merged.Writer.write(Output);
 }
 
 static void mergeSampleProfile(const cl::list<std::string> &Inputs,
@@ -121,10 +210,17 @@ static int merge_main(int argc, const char *argv[]) {
                  clEnumValN(sampleprof::SPF_GCC, "gcc", "GCC encoding"),
                  clEnumValEnd));
 
+  cl::opt<unsigned> NumThreads(
+      "num-threads", cl::init(0),
+      cl::desc("Number of merge threads to use (default: autodetect, only "
+               "meaningful for instrumentation profiles)"));
+  cl::alias NumThreadsA("j", cl::desc("Alias for --num-threads"),
+                        cl::aliasopt(NumThreads));
+
   cl::ParseCommandLineOptions(argc, argv, "LLVM profile data merger\n");
 
   if (ProfileKind == instr)
-    mergeInstrProfile(Inputs, OutputFilename);
+    mergeInstrProfile(Inputs, OutputFilename, NumThreads);
   else
     mergeSampleProfile(Inputs, OutputFilename, OutputFormat);
 
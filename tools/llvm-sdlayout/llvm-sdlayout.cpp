@@ -0,0 +1,195 @@
+//===- llvm-sdlayout.cpp - Split SafeDispatch vtable layout ---------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Computes interleaved/ordered vtables without linking the whole program into
+// a single module:
+//
+//  llvm-sdlayout -summarize -j 8 a.bc b.bc          (writes a.bc.sdsum, ...)
+//  llvm-sdlayout -link -sd-ivtbl -sd-layout=app.sdlayout \
+//                a.bc.sdsum b.bc.sdsum -o sdvtables.bc
+//  llvm-sdlayout -apply -sd-layout=app.sdlayout -j 8 a.bc b.bc
+//                                                    (writes a.bc.sd, ...)
+//
+// The rewritten modules and sdvtables.bc are then compiled and linked as
+// usual. The inputs of -summarize and -apply have to be given by the same
+// names, local symbols used by the vtables are renamed based on them.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Linker/Linker.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/DiagnosticPrinter.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/SafeDispatchSummary.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+using namespace llvm;
+
+enum ModeTy { Summarize, Link, Apply };
+
+static cl::opt<ModeTy>
+Mode(cl::desc("Mode:"), cl::Required,
+     cl::values(clEnumValN(Summarize, "summarize",
+                           "Reduce each input to a class summary"),
+                clEnumValN(Link, "link",
+                           "Compute the layout from the class summaries"),
+                clEnumValN(Apply, "apply",
+                           "Rewrite each input against the layout"),
+                clEnumValEnd));
+
+static cl::list<std::string>
+InputFilenames(cl::Positional, cl::OneOrMore,
+               cl::desc("<input bitcode files>"));
+
+static cl::opt<std::string>
+OutputFilename("o", cl::desc("Output filename of -link"), cl::init("-"),
+               cl::value_desc("filename"));
+
+static cl::opt<bool>
+Interleave("sd-ivtbl", cl::desc("Interleave the vtables (default: order them)"));
+
+static cl::opt<unsigned>
+Jobs("j", cl::desc("Number of modules processed in parallel"), cl::init(1));
+
+static std::mutex ErrsLock;
+
+static void diagnosticHandler(const DiagnosticInfo &DI) {
+  std::lock_guard<std::mutex> Guard(ErrsLock);
+  errs() << (DI.getSeverity() == DS_Error ? "ERROR: " : "WARNING: ");
+  DiagnosticPrinterRawOStream DP(errs());
+  DI.print(DP);
+  errs() << '\n';
+}
+
+static std::unique_ptr<Module> loadFile(const char *argv0, const std::string &FN,
+                                        LLVMContext &Context) {
+  SMDiagnostic Err;
+  std::unique_ptr<Module> Result = parseIRFile(FN, Err, Context);
+  if (!Result) {
+    std::lock_guard<std::mutex> Guard(ErrsLock);
+    Err.print(argv0, errs());
+  }
+  return Result;
+}
+
+static bool writeFile(const char *argv0, Module &M, const std::string &FN) {
+  std::error_code EC;
+  tool_output_file Out(FN, EC, sys::fs::F_None);
+  if (EC) {
+    std::lock_guard<std::mutex> Guard(ErrsLock);
+    errs() << argv0 << ": " << FN << ": " << EC.message() << '\n';
+    return false;
+  }
+
+  WriteBitcodeToFile(&M, Out.os());
+  Out.keep();
+  return true;
+}
+
+/// Summarize or rewrite a single input, each in its own context.
+static bool processFile(const char *argv0, const std::string &FN) {
+  LLVMContext Context;
+  std::unique_ptr<Module> M = loadFile(argv0, FN, Context);
+  if (!M)
+    return false;
+
+  if (Mode == Summarize) {
+    sd_buildClassSummary(*M);
+  } else {
+    legacy::PassManager PM;
+    PM.add(createSDApplyLayoutPass());
+    PM.add(createSDSubstModule3Pass());
+    PM.run(*M);
+  }
+
+  if (verifyModule(*M, &errs())) {
+    std::lock_guard<std::mutex> Guard(ErrsLock);
+    errs() << argv0 << ": " << FN << ": error: output module is broken!\n";
+    return false;
+  }
+
+  return writeFile(argv0, *M, FN + (Mode == Summarize ? ".sdsum" : ".sd"));
+}
+
+static bool processFiles(const char *argv0) {
+  // the workers share the layout, parse it before they start
+  if (Mode == Apply)
+    sd_getLayout();
+
+  std::atomic<unsigned> Next(0);
+  std::atomic<bool> Failed(false);
+
+  auto Worker = [&]() {
+    for (unsigned I = Next++; I < InputFilenames.size(); I = Next++)
+      if (!processFile(argv0, InputFilenames[I]))
+        Failed = true;
+  };
+
+  std::vector<std::thread> Threads;
+  for (unsigned I = 1; I < Jobs; ++I)
+    Threads.emplace_back(Worker);
+  Worker();
+  for (std::thread &T : Threads)
+    T.join();
+
+  return !Failed;
+}
+
+static bool linkSummaries(const char *argv0) {
+  LLVMContext &Context = getGlobalContext();
+  auto Composite = make_unique<Module>("llvm-sdlayout", Context);
+  Linker L(Composite.get(), diagnosticHandler);
+
+  for (const auto &File : InputFilenames) {
+    std::unique_ptr<Module> M = loadFile(argv0, File, Context);
+    if (!M || L.linkInModule(M.get()))
+      return false;
+  }
+
+  legacy::PassManager PM;
+  PM.add(createSDBuildCHAPass());
+  PM.add(createSDLayoutBuilderPass(Interleave));
+  PM.add(createSDExportLayoutPass());
+  PM.run(*Composite);
+
+  if (verifyModule(*Composite, &errs())) {
+    errs() << argv0 << ": error: vtable module is broken!\n";
+    return false;
+  }
+
+  return writeFile(argv0, *Composite, OutputFilename);
+}
+
+int main(int argc, char **argv) {
+  // Print a stack trace if we signal out.
+  sys::PrintStackTraceOnErrorSignal();
+  PrettyStackTraceProgram X(argc, argv);
+
+  llvm_shutdown_obj Y;  // Call llvm_shutdown() on exit.
+  cl::ParseCommandLineOptions(argc, argv, "SafeDispatch split layout\n");
+
+  bool Success = Mode == Link ? linkSummaries(argv[0]) : processFiles(argv[0]);
+  return Success ? 0 : 1;
+}
@@ -20,10 +20,15 @@
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/Compression.h"
 #include "llvm/Support/DataExtractor.h"
+#include "llvm/Support/EndianStream.h"
 #include "llvm/Support/Errc.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
 #include <sstream>
 #include <stdlib.h>
 
@@ -202,6 +207,79 @@ const char LLVMSymbolizer::kBadString[] = "??";
 
 std::string LLVMSymbolizer::symbolizeCode(const std::string &ModuleName,
                                           uint64_t ModuleOffset) {
+  return symbolize(/*IsData=*/false, ModuleName, ModuleOffset);
+}
+
+std::string LLVMSymbolizer::symbolizeData(const std::string &ModuleName,
+                                          uint64_t ModuleOffset) {
+  return symbolize(/*IsData=*/true, ModuleName, ModuleOffset);
+}
+
+std::string LLVMSymbolizer::symbolize(bool IsData,
+                                      const std::string &ModuleName,
+                                      uint64_t ModuleOffset) {
+  CachedResults *Cache = getOrLoadCache(ModuleName);
+  if (Cache) {
+    const auto &I = Cache->Results.find(std::make_pair(IsData, ModuleOffset));
+    if (I != Cache->Results.end())
+      return I->second;
+  }
+  std::string Result = IsData ? symbolizeDataImpl(ModuleName, ModuleOffset)
+                              : symbolizeCodeImpl(ModuleName, ModuleOffset);
+  if (Cache) {
+    Cache->Results[std::make_pair(IsData, ModuleOffset)] = Result;
+    Cache->Dirty = true;
+  }
+  return Result;
+}
+
+std::vector<std::string>
+LLVMSymbolizer::symbolizeBatch(ArrayRef<Request> Requests,
+                               unsigned NumThreads) {
+  // Group the requests by module, in offset order so that the line tables
+  // are walked forward.
+  std::map<std::string, std::vector<unsigned>> Groups;
+  for (unsigned I = 0, E = Requests.size(); I != E; ++I)
+    Groups[Requests[I].ModuleName].push_back(I);
+  for (auto &Group : Groups)
+    std::stable_sort(Group.second.begin(), Group.second.end(),
+                     [&](unsigned LHS, unsigned RHS) {
+      return Requests[LHS].ModuleOffset < Requests[RHS].ModuleOffset;
+    });
+
+  // Open the modules up front, the maps they live in aren't thread safe. The
+  // debug info itself is only parsed on the worker threads, each module
+  // having its own context. Modules whose results are all cached aren't
+  // opened at all.
+  for (const auto &Group : Groups) {
+    CachedResults *Cache = getOrLoadCache(Group.first);
+    for (unsigned I : Group.second) {
+      const Request &R = Requests[I];
+      if (!Cache ||
+          !Cache->Results.count(std::make_pair(R.IsData, R.ModuleOffset))) {
+        getOrCreateModuleInfo(Group.first);
+        break;
+      }
+    }
+  }
+
+  std::vector<std::string> Results(Requests.size());
+  ThreadPool Pool(std::max(1u, NumThreads));
+  for (const auto &Group : Groups) {
+    const std::vector<unsigned> *Indices = &Group.second;
+    Pool.async([&, Indices] {
+      for (unsigned I : *Indices) {
+        const Request &R = Requests[I];
+        Results[I] = symbolize(R.IsData, R.ModuleName, R.ModuleOffset);
+      }
+    });
+  }
+  Pool.wait();
+  return Results;
+}
+
+std::string LLVMSymbolizer::symbolizeCodeImpl(const std::string &ModuleName,
+                                              uint64_t ModuleOffset) {
   ModuleInfo *Info = getOrCreateModuleInfo(ModuleName);
   if (!Info)
     return printDILineInfo(DILineInfo());
@@ -221,8 +299,8 @@ std::string LLVMSymbolizer::symbolizeCode(const std::string &ModuleName,
   return printDILineInfo(LineInfo);
 }
 
-std::string LLVMSymbolizer::symbolizeData(const std::string &ModuleName,
-                                          uint64_t ModuleOffset) {
+std::string LLVMSymbolizer::symbolizeDataImpl(const std::string &ModuleName,
+                                              uint64_t ModuleOffset) {
   std::string Name = kBadString;
   uint64_t Start = 0;
   uint64_t Size = 0;
@@ -238,6 +316,8 @@ std::string LLVMSymbolizer::symbolizeData(const std::string &ModuleName,
 }
 
 void LLVMSymbolizer::flush() {
+  saveCaches();
+  Caches.clear();
   DeleteContainerSeconds(Modules);
   ObjectPairForPathArch.clear();
   ObjectFileForArch.clear();
@@ -438,13 +518,11 @@ LLVMSymbolizer::getObjectFileFromBinary(Binary *Bin,
   return Res;
 }
 
-ModuleInfo *
-LLVMSymbolizer::getOrCreateModuleInfo(const std::string &ModuleName) {
-  const auto &I = Modules.find(ModuleName);
-  if (I != Modules.end())
-    return I->second;
-  std::string BinaryName = ModuleName;
-  std::string ArchName = Opts.DefaultArch;
+void LLVMSymbolizer::splitModuleName(const std::string &ModuleName,
+                                     std::string &BinaryName,
+                                     std::string &ArchName) const {
+  BinaryName = ModuleName;
+  ArchName = Opts.DefaultArch;
   size_t ColonPos = ModuleName.find_last_of(':');
   // Verify that substring after colon form a valid arch name.
   if (ColonPos != std::string::npos) {
@@ -454,6 +532,15 @@ LLVMSymbolizer::getOrCreateModuleInfo(const std::string &ModuleName) {
       ArchName = ArchStr;
     }
   }
+}
+
+ModuleInfo *
+LLVMSymbolizer::getOrCreateModuleInfo(const std::string &ModuleName) {
+  const auto &I = Modules.find(ModuleName);
+  if (I != Modules.end())
+    return I->second;
+  std::string BinaryName, ArchName;
+  splitModuleName(ModuleName, BinaryName, ArchName);
   ObjectPair Objects = getOrCreateObjects(BinaryName, ArchName);
 
   if (!Objects.first) {
@@ -461,13 +548,136 @@ LLVMSymbolizer::getOrCreateModuleInfo(const std::string &ModuleName) {
     Modules.insert(make_pair(ModuleName, (ModuleInfo *)nullptr));
     return nullptr;
   }
-  DIContext *Context = new DWARFContextInMemory(*Objects.second);
+  DWARFContext *Context = new DWARFContextInMemory(*Objects.second);
   assert(Context);
+  if (Opts.LazyDwarf)
+    Context->setLazyAddressLookup(Opts.MaxDwarfUnits);
   ModuleInfo *Info = new ModuleInfo(Objects.first, Context);
   Modules.insert(make_pair(ModuleName, Info));
   return Info;
 }
 
+// Cache files start with this magic, followed by one record per result: the
+// kind of request (1 for data), the module offset and the size of the result
+// text, then the text. Integers are little endian.
+static const char kCacheMagic[] = "LLVMSYM1";
+
+static bool getBuildID(const ObjectFile *Obj, ArrayRef<uint8_t> &BuildID) {
+  if (auto *MachO = dyn_cast<MachOObjectFile>(Obj)) {
+    BuildID = MachO->getUuid();
+    return !BuildID.empty();
+  }
+  for (const SectionRef &Section : Obj->sections()) {
+    StringRef Name;
+    StringRef Data;
+    if (Section.getName(Name) || Name != ".note.gnu.build-id" ||
+        Section.getContents(Data))
+      continue;
+    // An ELF note: name size, descriptor size, type, then the name and the
+    // descriptor padded to 4 bytes.
+    DataExtractor DE(Data, Obj->isLittleEndian(), 0);
+    uint32_t Offset = 0;
+    uint32_t NameSize = DE.getU32(&Offset);
+    uint32_t DescSize = DE.getU32(&Offset);
+    Offset += 4 + RoundUpToAlignment(NameSize, 4);
+    if (!DescSize || !DE.isValidOffsetForDataOfSize(Offset, DescSize))
+      return false;
+    BuildID = ArrayRef<uint8_t>(Data.bytes_begin() + Offset, DescSize);
+    return true;
+  }
+  return false;
+}
+
+static void readCacheFile(StringRef Path,
+                          std::map<std::pair<bool, uint64_t>, std::string> &Results) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> BufOrErr = MemoryBuffer::getFile(Path);
+  if (!BufOrErr)
+    return; // Nothing cached yet.
+  StringRef Buffer = BufOrErr.get()->getBuffer();
+  if (!Buffer.startswith(kCacheMagic))
+    return;
+  DataExtractor DE(Buffer, /*IsLittleEndian=*/true, 0);
+  uint32_t Offset = strlen(kCacheMagic);
+  while (DE.isValidOffsetForDataOfSize(Offset, 13)) {
+    bool IsData = DE.getU8(&Offset);
+    uint64_t ModuleOffset = DE.getU64(&Offset);
+    uint32_t Size = DE.getU32(&Offset);
+    if (!DE.isValidOffsetForDataOfSize(Offset, Size))
+      break;
+    Results.insert(std::make_pair(std::make_pair(IsData, ModuleOffset),
+                                  Buffer.substr(Offset, Size).str()));
+    Offset += Size;
+  }
+}
+
+LLVMSymbolizer::CachedResults *
+LLVMSymbolizer::getOrLoadCache(const std::string &ModuleName) {
+  if (Opts.CacheDir.empty())
+    return nullptr;
+  const auto &I = Caches.find(ModuleName);
+  if (I != Caches.end())
+    return I->second.get();
+
+  std::unique_ptr<CachedResults> &Cache = Caches[ModuleName];
+  std::string BinaryName, ArchName;
+  splitModuleName(ModuleName, BinaryName, ArchName);
+  ObjectFile *Obj = getOrCreateObjects(BinaryName, ArchName).first;
+  ArrayRef<uint8_t> BuildID;
+  if (!Obj || !getBuildID(Obj, BuildID))
+    return nullptr;
+
+  // The options that change the output are part of the file name.
+  std::string Name;
+  raw_string_ostream OS(Name);
+  for (uint8_t Byte : BuildID)
+    OS << format("%02x", Byte);
+  OS << '.' << (unsigned)Opts.PrintFunctions << Opts.PrintInlining
+     << Opts.Demangle << Opts.UseSymbolTable;
+  SmallString<128> Path(Opts.CacheDir);
+  sys::path::append(Path, OS.str());
+
+  Cache.reset(new CachedResults());
+  Cache->Path = Path.str();
+  readCacheFile(Cache->Path, Cache->Results);
+  return Cache.get();
+}
+
+void LLVMSymbolizer::saveCaches() {
+  for (const auto &I : Caches) {
+    CachedResults *Cache = I.second.get();
+    if (!Cache || !Cache->Dirty)
+      continue;
+    Cache->Dirty = false;
+    if (sys::fs::create_directories(Opts.CacheDir))
+      return;
+    // Other processes may have added results since the file was read: merge
+    // them in, and replace the file in one go so that readers never see a
+    // partial one.
+    readCacheFile(Cache->Path, Cache->Results);
+    int FD;
+    SmallString<128> TempPath;
+    if (sys::fs::createUniqueFile(Cache->Path + "-%%%%%%", FD, TempPath))
+      continue;
+    raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    support::endian::Writer<support::little> W(OS);
+    OS << kCacheMagic;
+    for (const auto &R : Cache->Results) {
+      W.write<uint8_t>(R.first.first);
+      W.write<uint64_t>(R.first.second);
+      W.write<uint32_t>(R.second.size());
+      OS << R.second;
+    }
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      sys::fs::remove(TempPath);
+      continue;
+    }
+    if (sys::fs::rename(TempPath, Cache->Path))
+      sys::fs::remove(TempPath);
+  }
+}
+
 std::string LLVMSymbolizer::printDILineInfo(DILineInfo LineInfo) const {
   // By default, DILineInfo contains "<invalid>" for function/filename it
   // cannot fetch. We replace it to "??" to make our output closer to addr2line.
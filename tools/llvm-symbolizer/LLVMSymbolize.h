@@ -13,6 +13,7 @@
 #ifndef LLVM_TOOLS_LLVM_SYMBOLIZER_LLVMSYMBOLIZE_H
 #define LLVM_TOOLS_LLVM_SYMBOLIZER_LLVMSYMBOLIZE_H
 
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/DebugInfo/DIContext.h"
 #include "llvm/Object/MachOUniversal.h"
@@ -22,6 +23,7 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace llvm {
 
@@ -41,13 +43,20 @@ public:
     bool Demangle : 1;
     std::string DefaultArch;
     std::vector<std::string> DsymHints;
+    bool LazyDwarf : 1;
+    unsigned MaxDwarfUnits;
+    /// Directory where results are kept across runs, keyed by the build ID of
+    /// the binaries and the offset. Empty to disable the cache.
+    std::string CacheDir;
     Options(bool UseSymbolTable = true,
             FunctionNameKind PrintFunctions = FunctionNameKind::LinkageName,
             bool PrintInlining = true, bool Demangle = true,
-            std::string DefaultArch = "")
+            std::string DefaultArch = "", bool LazyDwarf = false,
+            unsigned MaxDwarfUnits = 0)
         : UseSymbolTable(UseSymbolTable),
           PrintFunctions(PrintFunctions), PrintInlining(PrintInlining),
-          Demangle(Demangle), DefaultArch(DefaultArch) {}
+          Demangle(Demangle), DefaultArch(DefaultArch), LazyDwarf(LazyDwarf),
+          MaxDwarfUnits(MaxDwarfUnits) {}
   };
 
   LLVMSymbolizer(const Options &Opts = Options()) : Opts(Opts) {}
@@ -61,12 +70,46 @@ public:
   symbolizeCode(const std::string &ModuleName, uint64_t ModuleOffset);
   std::string
   symbolizeData(const std::string &ModuleName, uint64_t ModuleOffset);
+
+  struct Request {
+    bool IsData;
+    std::string ModuleName;
+    uint64_t ModuleOffset;
+  };
+  // Returns the results for all the requests, in the same order. The requests
+  // are grouped by module and sorted by offset, and up to NumThreads modules
+  // are symbolized in parallel.
+  std::vector<std::string> symbolizeBatch(ArrayRef<Request> Requests,
+                                          unsigned NumThreads);
+
+  // Writes the new results to the cache and releases all the modules.
   void flush();
   static std::string DemangleName(const std::string &Name);
 private:
   typedef std::pair<ObjectFile*, ObjectFile*> ObjectPair;
 
+  // Results of a binary read from and written to Options::CacheDir.
+  struct CachedResults {
+    std::string Path;
+    std::map<std::pair<bool, uint64_t>, std::string> Results;
+    bool Dirty;
+    CachedResults() : Dirty(false) {}
+  };
+
+  std::string symbolize(bool IsData, const std::string &ModuleName,
+                        uint64_t ModuleOffset);
+  std::string symbolizeCodeImpl(const std::string &ModuleName,
+                                uint64_t ModuleOffset);
+  std::string symbolizeDataImpl(const std::string &ModuleName,
+                                uint64_t ModuleOffset);
+
+  void splitModuleName(const std::string &ModuleName, std::string &BinaryName,
+                       std::string &ArchName) const;
   ModuleInfo *getOrCreateModuleInfo(const std::string &ModuleName);
+  /// \brief Returns the cached results for a module, or null if there is no
+  /// cache or the binary has no build ID.
+  CachedResults *getOrLoadCache(const std::string &ModuleName);
+  void saveCaches();
   ObjectFile *lookUpDsymFile(const std::string &Path, const MachOObjectFile *ExeObj,
                              const std::string &ArchName);
 
@@ -96,6 +139,7 @@ private:
       ObjectFileForArch;
   std::map<std::pair<std::string, std::string>, ObjectPair>
       ObjectPairForPathArch;
+  std::map<std::string, std::unique_ptr<CachedResults>> Caches;
 
   Options Opts;
   static const char kBadString[];
@@ -28,6 +28,7 @@
 #include <cstdio>
 #include <cstring>
 #include <string>
+#include <thread>
 
 using namespace llvm;
 using namespace symbolize;
@@ -68,6 +69,33 @@ ClDsymHint("dsym-hint", cl::ZeroOrMore,
            cl::desc("Path to .dSYM bundles to search for debug info for the "
                     "object files"));
 
+static cl::opt<bool>
+ClLazyDwarf("lazy-dwarf", cl::init(false),
+            cl::desc("Find the unit of an address through .debug_aranges "
+                     "instead of looking at all the units"));
+
+static cl::opt<unsigned>
+ClMaxDwarfUnits("max-dwarf-units", cl::init(0),
+                cl::desc("With -lazy-dwarf, the number of units per object "
+                         "file whose debug info stays parsed (0: no limit)"));
+
+static cl::opt<bool>
+ClBatch("batch", cl::init(false),
+        cl::desc("Read all the input before symbolizing it, grouped by "
+                 "object file"));
+
+static cl::opt<unsigned>
+ClNumThreads("num-threads", cl::init(0),
+             cl::desc("With -batch, the number of object files symbolized "
+                      "in parallel (default: autodetect)"));
+static cl::alias ClNumThreadsA("j", cl::desc("Alias for --num-threads"),
+                               cl::aliasopt(ClNumThreads));
+
+static cl::opt<std::string>
+ClCacheDir("cache-dir", cl::init(""),
+           cl::desc("Directory where results are kept across runs, for "
+                    "object files with a build ID"));
+
 static bool parseCommand(bool &IsData, std::string &ModuleName,
                          uint64_t &ModuleOffset) {
   const char *kDataCmd = "DATA ";
@@ -125,7 +153,8 @@ int main(int argc, char **argv) {
 
   cl::ParseCommandLineOptions(argc, argv, "llvm-symbolizer\n");
   LLVMSymbolizer::Options Opts(ClUseSymbolTable, ClPrintFunctions,
-                               ClPrintInlining, ClDemangle, ClDefaultArch);
+                               ClPrintInlining, ClDemangle, ClDefaultArch,
+                               ClLazyDwarf, ClMaxDwarfUnits);
   for (const auto &hint : ClDsymHint) {
     if (sys::path::extension(hint) == ".dSYM") {
       Opts.DsymHints.push_back(hint);
@@ -134,11 +163,25 @@ int main(int argc, char **argv) {
                 "\" (must have the '.dSYM' extension).\n";
     }
   }
+  Opts.CacheDir = ClCacheDir;
   LLVMSymbolizer Symbolizer(Opts);
 
   bool IsData = false;
   std::string ModuleName;
   uint64_t ModuleOffset;
+  if (ClBatch) {
+    std::vector<LLVMSymbolizer::Request> Requests;
+    while (parseCommand(IsData, ModuleName, ModuleOffset))
+      Requests.push_back({IsData, ModuleName, ModuleOffset});
+    unsigned NumThreads = ClNumThreads;
+    if (!NumThreads)
+      NumThreads = std::thread::hardware_concurrency();
+    for (const std::string &Result :
+         Symbolizer.symbolizeBatch(Requests, NumThreads))
+      outs() << Result << "\n";
+    return 0;
+  }
+
   while (parseCommand(IsData, ModuleName, ModuleOffset)) {
     std::string Result =
         IsData ? Symbolizer.symbolizeData(ModuleName, ModuleOffset)
@@ -0,0 +1,74 @@
+//===- BitstreamWriterTest.cpp - Tests for BitstreamWriter ----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Bitcode/BitstreamWriter.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+
+namespace {
+
+/// Emit nested blocks with records, a blob and an abbreviation.
+static void writeBlocks(BitstreamWriter &Stream) {
+  Stream.Emit((unsigned)'B', 8);
+  Stream.Emit((unsigned)'C', 8);
+
+  Stream.EnterSubblock(8, 3);
+  for (unsigned I = 0; I != 40; ++I) {
+    Stream.EnterSubblock(9, 4);
+    SmallVector<unsigned, 8> Vals;
+    for (unsigned J = 0; J != I; ++J)
+      Vals.push_back(J * 1000);
+    Stream.EmitRecord(1, Vals);
+
+    BitCodeAbbrev *Abbv = new BitCodeAbbrev();
+    Abbv->Add(BitCodeAbbrevOp(2));
+    Abbv->Add(BitCodeAbbrevOp(BitCodeAbbrevOp::Blob));
+    unsigned Abbrev = Stream.EmitAbbrev(Abbv);
+    Vals.clear();
+    Vals.push_back(2);
+    Stream.EmitRecordWithBlob(Abbrev, Vals, StringRef("blob", I % 5));
+    Stream.ExitBlock();
+  }
+  Stream.ExitBlock();
+}
+
+TEST(BitstreamWriterTest, StreamToFile) {
+  SmallVector<char, 0> Expected;
+  {
+    BitstreamWriter Stream(Expected);
+    writeBlocks(Stream);
+  }
+
+  int FD;
+  SmallString<64> Path;
+  ASSERT_FALSE(sys::fs::createTemporaryFile("bitstream", "bc", FD, Path));
+  {
+    raw_fd_ostream OS(FD, true);
+    // Some unrelated data ahead of the bitstream.
+    OS << "head";
+
+    SmallVector<char, 0> Buffer;
+    {
+      BitstreamWriter Stream(Buffer, OS, 16);
+      writeBlocks(Stream);
+    }
+    OS.write(Buffer.data(), Buffer.size());
+  }
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> File = MemoryBuffer::getFile(Path);
+  sys::fs::remove(Path);
+  ASSERT_TRUE(bool(File));
+  EXPECT_EQ("head" + std::string(Expected.data(), Expected.size()),
+            (*File)->getBuffer().str());
+}
+
+} // end anonymous namespace
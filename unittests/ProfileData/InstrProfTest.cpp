@@ -66,6 +66,47 @@ TEST_F(InstrProfTest, write_and_read_one_function) {
   ASSERT_TRUE(++I == E);
 }
 
+TEST_F(InstrProfTest, get_function_counts_in_place) {
+  Writer.addFunctionCounts("a", 0x1234, {1, 2});
+  Writer.addFunctionCounts("function", 0x5678, {3, 4, 5});
+  Writer.addFunctionCounts("another_function", 0x9abc, {6});
+  auto Profile = Writer.writeBuffer();
+  const char *Start = Profile->getBufferStart();
+  const char *End = Profile->getBufferEnd();
+  readProfile(std::move(Profile));
+
+  ArrayRef<uint64_t> Counts;
+  ASSERT_TRUE(NoError(Reader->getFunctionCounts("a", 0x1234, Counts)));
+  ASSERT_EQ(2U, Counts.size());
+  ASSERT_EQ(1U, Counts[0]);
+  ASSERT_EQ(2U, Counts[1]);
+
+  ASSERT_TRUE(NoError(Reader->getFunctionCounts("function", 0x5678, Counts)));
+  ASSERT_EQ(3U, Counts.size());
+  ASSERT_EQ(5U, Counts[2]);
+
+  ArrayRef<uint64_t> Other;
+  ASSERT_TRUE(NoError(
+      Reader->getFunctionCounts("another_function", 0x9abc, Other)));
+  ASSERT_EQ(1U, Other.size());
+  ASSERT_EQ(6U, Other[0]);
+
+  // The counts point into the profile and outlive other lookups.
+  if (sys::IsLittleEndianHost) {
+    ASSERT_TRUE((const char *)Counts.data() >= Start &&
+                (const char *)Counts.end() <= End);
+    ASSERT_EQ(5U, Counts[2]);
+  }
+
+  // The names are not affected by the padding.
+  auto I = Reader->begin(), E = Reader->end();
+  unsigned NumFunctions = 0;
+  for (; I != E; ++I, ++NumFunctions)
+    ASSERT_TRUE(I->Name == "a" || I->Name == "function" ||
+                I->Name == "another_function");
+  ASSERT_EQ(3U, NumFunctions);
+}
+
 TEST_F(InstrProfTest, get_function_counts) {
   Writer.addFunctionCounts("foo", 0x1234, {1, 2});
   auto Profile = Writer.writeBuffer();
@@ -0,0 +1,98 @@
+//===- unittests/Support/ParallelTest.cpp - Parallel algorithm tests ------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Support/Parallel.h"
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <utility>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+TEST(ParallelTest, ForEachVisitsEveryElementOnce) {
+  ThreadPool Pool(4);
+
+  std::vector<std::atomic_int> Counts(1000);
+  for (auto &C : Counts)
+    C = 0;
+
+  parallel_for_each(Pool, Counts.begin(), Counts.end(),
+                    [](std::atomic_int &C) { ++C; });
+
+  for (auto &C : Counts)
+    EXPECT_EQ(1, C);
+}
+
+TEST(ParallelTest, ForEachForwardIterators) {
+  ThreadPool Pool(3);
+
+  std::list<int> Values;
+  for (int I = 0; I < 37; ++I)
+    Values.push_back(I);
+
+  parallel_for_each(Pool, Values.begin(), Values.end(), [](int &V) { V *= 2; },
+                    /*MinChunk=*/5);
+
+  int I = 0;
+  for (int V : Values)
+    EXPECT_EQ(2 * I++, V);
+}
+
+TEST(ParallelTest, ForEachEmpty) {
+  ThreadPool Pool(2);
+  std::vector<int> Empty;
+  parallel_for_each(Pool, Empty.begin(), Empty.end(), [](int &) { FAIL(); });
+}
+
+TEST(ParallelTest, Sort) {
+  ThreadPool Pool(4);
+
+  std::vector<unsigned> Values;
+  unsigned Seed = 1;
+  for (unsigned I = 0; I < 100000; ++I) {
+    Seed = Seed * 1103515245 + 12345;
+    Values.push_back(Seed >> 8);
+  }
+
+  std::vector<unsigned> Expected(Values);
+  std::sort(Expected.begin(), Expected.end());
+
+  parallel_sort(Pool, Values.begin(), Values.end());
+  EXPECT_EQ(Expected, Values);
+}
+
+// Elements that compare equal keep their order, whatever the thread count.
+TEST(ParallelTest, SortIsStable) {
+  typedef std::pair<unsigned, unsigned> KeyIndex;
+
+  std::vector<KeyIndex> Input;
+  for (unsigned I = 0; I < 20000; ++I)
+    Input.push_back(KeyIndex((I * 7919) % 97, I));
+
+  auto ByKey = [](const KeyIndex &A, const KeyIndex &B) {
+    return A.first < B.first;
+  };
+
+  std::vector<KeyIndex> Expected(Input);
+  std::stable_sort(Expected.begin(), Expected.end(), ByKey);
+
+  for (unsigned Threads : {1u, 2u, 3u, 8u}) {
+    ThreadPool Pool(Threads);
+    std::vector<KeyIndex> Values(Input);
+    parallel_sort(Pool, Values.begin(), Values.end(), ByKey, /*MinChunk=*/100);
+    EXPECT_EQ(Expected, Values);
+  }
+}
+
+} // end anonymous namespace
@@ -0,0 +1,81 @@
+//========- unittests/Support/ThreadPoolTest.cpp - ThreadPool tests -======//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Support/ThreadPool.h"
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+TEST(ThreadPoolTest, AsyncBarrier) {
+  std::atomic_int Count(0);
+
+  ThreadPool Pool(4);
+  for (size_t I = 0; I < 100; ++I)
+    Pool.async([&Count] { ++Count; });
+  Pool.wait();
+
+  EXPECT_EQ(100, Count);
+}
+
+static void addToCount(std::atomic_int *Count, int Value) { *Count += Value; }
+
+TEST(ThreadPoolTest, AsyncBarrierArgs) {
+  std::atomic_int Count(0);
+
+  ThreadPool Pool;
+  for (int I = 0; I < 100; ++I)
+    Pool.async(addToCount, &Count, I);
+  Pool.wait();
+
+  EXPECT_EQ(4950, Count);
+}
+
+TEST(ThreadPoolTest, AsyncResult) {
+  ThreadPool Pool(2);
+
+  std::vector<std::shared_future<int>> Futures;
+  for (int I = 0; I < 10; ++I)
+    Futures.push_back(Pool.async([](int N) { return N * N; }, I));
+
+  for (int I = 0; I < 10; ++I)
+    EXPECT_EQ(I * I, Futures[I].get());
+}
+
+TEST(ThreadPoolTest, WaitFuture) {
+  std::atomic_int Count(0);
+
+  ThreadPool Pool(2);
+  std::shared_future<void> Future = Pool.async([&Count] { ++Count; });
+  Future.wait();
+
+  EXPECT_EQ(1, Count);
+}
+
+TEST(ThreadPoolTest, DestructorWaits) {
+  std::atomic_int Count(0);
+  {
+    ThreadPool Pool(3);
+    for (size_t I = 0; I < 50; ++I)
+      Pool.async([&Count] { ++Count; });
+  }
+
+  EXPECT_EQ(50, Count);
+}
+
+TEST(ThreadPoolTest, ThreadCount) {
+  EXPECT_EQ(1u, ThreadPool(0).getThreadCount());
+  EXPECT_LE(1u, ThreadPool().getThreadCount());
+}
+
+} // end anonymous namespace